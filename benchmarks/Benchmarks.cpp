@@ -0,0 +1,434 @@
+#include "TFLite.h"
+#include "EasyTFLite.h"
+#include "SSD_EasyTFLite.h"
+#include "benchmark/benchmark.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <type_traits>
+
+namespace {
+    //! Calls to operator new since the program started
+    std::atomic<size_t> allocation_count{0};
+
+    /*!
+     * Allocates and counts memory for the replaced operator new overloads
+     * @param size Bytes to allocate
+     * @param alignment Alignment of the memory, 0 for malloc's
+     * @return The memory
+     */
+    void *counted_allocation(size_t size, size_t alignment) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0)
+            size = 1;
+        // aligned_alloc wants a size that is a multiple of the alignment
+        void *ptr = alignment == 0 ? std::malloc(size)
+                                   : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+}
+
+// Counts every allocation made through operator new, plain, array and aligned, the aligned ones being the buffers of
+// ScratchArena and TensorBufferPool. Tensorflow Lite's arena and OpenCV's buffers go through malloc and aren't
+// counted, but they are only allocated when tensors or images change size.
+void *operator new(size_t size) {
+    return counted_allocation(size, 0);
+}
+
+void *operator new[](size_t size) {
+    return counted_allocation(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+    //! The models in tests/test-models, indexed by the first benchmark argument
+    const std::array<const char *, 3> test_models = {
+            "../../tests/test-models/multi_input_single_output.tflite",
+            "../../tests/test-models/single_input_multi_output.tflite",
+            "../../tests/test-models/single_volume_input.tflite"
+    };
+
+    //! The example's Single Shot MultiBox Detector
+    const char *ssd_model = "../../examples/objectdetection/detect.tflite";
+
+    //! Interpreter thread counts every benchmark is run with
+    const std::vector<int64_t> thread_counts = {1, 2, 4};
+
+    //! Reports the average number of allocations per iteration since construction
+    class AllocationCounter {
+        size_t start;
+
+    public:
+        AllocationCounter() : start(allocation_count.load()) {}
+
+        void report(benchmark::State &state) const {
+            state.counters["allocs/iter"] = benchmark::Counter(static_cast<double>(allocation_count.load() - start),
+                                                               benchmark::Counter::kAvgIterations);
+        }
+    };
+
+    /*!
+     * Calls func with std::integral_constant<int, rank>, so a tensor's rank can pick a template instantiation
+     * @param rank The tensor's rank, from 1 to 5
+     * @param func A generic callable
+     */
+    template<typename Func>
+    void with_rank(size_t rank, Func &&func) {
+        switch (rank) {
+            case 1:
+                func(std::integral_constant<int, 1>());
+                break;
+            case 2:
+                func(std::integral_constant<int, 2>());
+                break;
+            case 3:
+                func(std::integral_constant<int, 3>());
+                break;
+            case 4:
+                func(std::integral_constant<int, 4>());
+                break;
+            case 5:
+                func(std::integral_constant<int, 5>());
+                break;
+            default:
+                LOG(FATAL) << "Error: benchmarks support tensors of rank 1 to 5, not " << rank << '\n';
+        }
+    }
+
+    /*!
+     * Sums the size in bytes of float tensors
+     * @param tflite The model
+     * @param tensor_indexes Indexes of the tensors
+     * @return The number of bytes
+     */
+    int64_t tensor_bytes(TFLite &tflite, const std::vector<int> &tensor_indexes) {
+        int64_t bytes = 0;
+        for (int index : tensor_indexes)
+            bytes += static_cast<int64_t>(tflite.get_tensor_element_count(index)) * sizeof(float);
+        return bytes;
+    }
+
+    /*!
+     * Creates random data for every input of a model
+     * @param tflite The model
+     * @return One vector per input tensor
+     */
+    std::vector<std::vector<float>> random_inputs(TFLite &tflite) {
+        std::mt19937 gen(42);
+        std::normal_distribution<float> dist(0.0f, 1.0f);
+        std::vector<std::vector<float>> inputs;
+        for (int index : tflite.input_tensors()) {
+            std::vector<float> input(tflite.get_tensor_element_count(index));
+            std::generate(input.begin(), input.end(), [&]() { return dist(gen); });
+            inputs.push_back(std::move(input));
+        }
+        return inputs;
+    }
+
+    /*!
+     * Creates a random image
+     * @param width The image's width
+     * @param height The image's height
+     * @return A 3 channel 8 bit image
+     */
+    cv::Mat random_image(int width, int height) {
+        cv::Mat image(height, width, CV_8UC3);
+        cv::randu(image, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+        return image;
+    }
+
+    ////////////// TFLite //////////////
+    void BM_FillTensor_Pointer(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<int> input_indexes = tflite.input_tensors();
+        std::vector<std::vector<float>> inputs = random_inputs(tflite);
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            for (size_t i = 0; i < input_indexes.size(); i++)
+                tflite.fill_tensor(inputs[i].data(), input_indexes[i]);
+            benchmark::ClobberMemory();
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, input_indexes));
+    }
+
+    void BM_FillTensor_Eigen(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<int> input_indexes = tflite.input_tensors();
+
+        // One fill per input, each holding an Eigen tensor of the input's rank
+        std::vector<std::function<void()>> fills;
+        for (int index : input_indexes) {
+            std::vector<int> dims = tflite.get_tensor_dims(index);
+            with_rank(dims.size(), [&](auto rank) {
+                Eigen::Tensor<float, decltype(rank)::value> tensor;
+                std::array<Eigen::Index, decltype(rank)::value> shape;
+                std::copy(dims.begin(), dims.end(), shape.begin());
+                tensor.resize(shape);
+                tensor.setRandom();
+                fills.emplace_back([&tflite, tensor, index]() { tflite.fill_tensor(tensor, index); });
+            });
+        }
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            for (auto &fill : fills)
+                fill();
+            benchmark::ClobberMemory();
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, input_indexes));
+    }
+
+    void BM_GetTensor(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<std::vector<float>> inputs = random_inputs(tflite);
+        std::vector<int> input_indexes = tflite.input_tensors();
+        for (size_t i = 0; i < input_indexes.size(); i++)
+            tflite.fill_tensor(inputs[i].data(), input_indexes[i]);
+        tflite.invoke();
+        std::vector<int> output_indexes = tflite.output_tensors();
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            for (int index : output_indexes) {
+                with_rank(tflite.get_tensor_dims(index).size(), [&](auto rank) {
+                    benchmark::DoNotOptimize(tflite.get_tensor<float, decltype(rank)::value>(index));
+                });
+            }
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, output_indexes));
+    }
+
+    void BM_GetTensorStable(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<std::vector<float>> inputs = random_inputs(tflite);
+        std::vector<int> input_indexes = tflite.input_tensors();
+        for (size_t i = 0; i < input_indexes.size(); i++)
+            tflite.fill_tensor(inputs[i].data(), input_indexes[i]);
+        tflite.invoke();
+        std::vector<int> output_indexes = tflite.output_tensors();
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            for (int index : output_indexes) {
+                with_rank(tflite.get_tensor_dims(index).size(), [&](auto rank) {
+                    benchmark::DoNotOptimize(tflite.get_tensor_stable<float, decltype(rank)::value>(index));
+                });
+            }
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, output_indexes));
+    }
+
+    void BM_GetOutputTensors(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<std::vector<float>> inputs = random_inputs(tflite);
+        std::vector<int> input_indexes = tflite.input_tensors();
+        for (size_t i = 0; i < input_indexes.size(); i++)
+            tflite.fill_tensor(inputs[i].data(), input_indexes[i]);
+        tflite.invoke();
+        std::vector<int> output_indexes = tflite.output_tensors();
+
+        // get_output_tensors returns every output with the same rank
+        size_t rank = tflite.get_tensor_dims(output_indexes[0]).size();
+        for (int index : output_indexes) {
+            if (tflite.get_tensor_dims(index).size() != rank) {
+                state.SkipWithError("outputs have different ranks");
+                return;
+            }
+        }
+
+        AllocationCounter allocations;
+        with_rank(rank, [&](auto rank_constant) {
+            for (auto _ : state)
+                benchmark::DoNotOptimize(tflite.get_output_tensors<float, decltype(rank_constant)::value>());
+        });
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, output_indexes));
+    }
+
+    void BM_Invoke(benchmark::State &state) {
+        TFLite tflite(boost::filesystem::path(test_models[state.range(0)]));
+        tflite.set_num_threads(static_cast<int>(state.range(1)));
+        std::vector<int> input_indexes = tflite.input_tensors();
+        std::vector<std::vector<float>> inputs = random_inputs(tflite);
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            for (size_t i = 0; i < input_indexes.size(); i++)
+                tflite.fill_tensor(inputs[i].data(), input_indexes[i]);
+            tflite.invoke();
+            benchmark::DoNotOptimize(tflite.get_output_tensor_ptrs<float>());
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * tensor_bytes(tflite, input_indexes));
+    }
+
+    ////////////// EasyTFLite and SSD_EasyTFLite //////////////
+    void BM_EasyTFLite_RunInferencePtrs(benchmark::State &state) {
+        boost::filesystem::path model_path(ssd_model);
+        EasyTFLite model(model_path);
+        model.set_num_threads(static_cast<int>(state.range(2)));
+        cv::Mat image = random_image(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+
+        AllocationCounter allocations;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(model.run_inference_ptrs(image));
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.total() * image.elemSize()));
+    }
+
+    void BM_SSD_RunInference(benchmark::State &state) {
+        boost::filesystem::path model_path(ssd_model);
+        SSD_EasyTFLite model(model_path);
+        model.set_num_threads(static_cast<int>(state.range(2)));
+        cv::Mat image = random_image(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+
+        AllocationCounter allocations;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(model.run_inference(image));
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.total() * image.elemSize()));
+    }
+
+    void BM_SSD_Detect(benchmark::State &state) {
+        boost::filesystem::path model_path(ssd_model);
+        SSD_EasyTFLite model(model_path);
+        model.set_num_threads(static_cast<int>(state.range(2)));
+        cv::Mat image = random_image(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+        std::vector<Detection> detections;
+
+        AllocationCounter allocations;
+        for (auto _ : state) {
+            model.detect(image, detections, 0.5f);
+            benchmark::DoNotOptimize(detections.data());
+        }
+        allocations.report(state);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.total() * image.elemSize()));
+    }
+
+    /*!
+     * Milliseconds since a time point
+     * @param start The time point
+     * @return The elapsed time in milliseconds
+     */
+    double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ////////////// Cold start //////////////
+    // Every iteration is a restart, construction and the first detection. The counters split it in construction, the
+    // first detection and a steady state detection, so warm-up shows up as the first one nearing the last one.
+    void BM_SSD_ColdStart(benchmark::State &state) {
+        boost::filesystem::path model_path(ssd_model);
+        ExecutionConfig config;
+        config.warmup_invokes = static_cast<int>(state.range(0));
+        config.num_threads = static_cast<int>(state.range(1));
+        cv::Mat image = random_image(640, 480);
+        std::vector<Detection> detections;
+
+        double construct_ms = 0, first_ms = 0, steady_ms = 0;
+        for (auto _ : state) {
+            auto start = std::chrono::steady_clock::now();
+            SSD_EasyTFLite model(model_path, config);
+            construct_ms += elapsed_ms(start);
+
+            start = std::chrono::steady_clock::now();
+            model.detect(image, detections, 0.5f);
+            first_ms += elapsed_ms(start);
+
+            state.PauseTiming();
+            for (int i = 0; i < 4; i++)
+                model.detect(image, detections, 0.5f);
+            start = std::chrono::steady_clock::now();
+            model.detect(image, detections, 0.5f);
+            steady_ms += elapsed_ms(start);
+            state.ResumeTiming();
+        }
+        state.counters["construct_ms"] = benchmark::Counter(construct_ms, benchmark::Counter::kAvgIterations);
+        state.counters["first_ms"] = benchmark::Counter(first_ms, benchmark::Counter::kAvgIterations);
+        state.counters["steady_ms"] = benchmark::Counter(steady_ms, benchmark::Counter::kAvgIterations);
+    }
+
+    //! Every test model with every thread count
+    void model_arguments(benchmark::internal::Benchmark *benchmark) {
+        benchmark->ArgNames({"model", "threads"})->ArgsProduct({{0, 1, 2}, thread_counts})->UseRealTime();
+    }
+
+    //! Common camera resolutions with every thread count
+    void image_arguments(benchmark::internal::Benchmark *benchmark) {
+        benchmark->ArgNames({"width", "height", "threads"});
+        for (auto size : std::vector<std::pair<int, int>>{{320, 240}, {640, 480}, {1280, 720}, {1920, 1080}})
+            for (int64_t threads : thread_counts)
+                benchmark->Args({size.first, size.second, threads});
+        benchmark->UseRealTime();
+    }
+}
+
+BENCHMARK(BM_FillTensor_Pointer)->Apply(model_arguments);
+BENCHMARK(BM_FillTensor_Eigen)->Apply(model_arguments);
+BENCHMARK(BM_GetTensor)->Apply(model_arguments);
+BENCHMARK(BM_GetTensorStable)->Apply(model_arguments);
+BENCHMARK(BM_GetOutputTensors)->Apply(model_arguments);
+BENCHMARK(BM_Invoke)->Apply(model_arguments);
+BENCHMARK(BM_EasyTFLite_RunInferencePtrs)->Apply(image_arguments);
+BENCHMARK(BM_SSD_RunInference)->Apply(image_arguments);
+BENCHMARK(BM_SSD_Detect)->Apply(image_arguments);
+BENCHMARK(BM_SSD_ColdStart)->ArgNames({"warmup", "threads"})->ArgsProduct({{0, 1, 3}, thread_counts})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -22,8 +22,8 @@ int main(int argc, char **argv) {
     fs::path source(project_path.string() + "/examples/galaxyclassification/110887.jpg");
     fs::path model_path(project_path.string() + "/examples/galaxyclassification/galaxmobilenet.tflite");
 
-    // Image scale function
-    std::function<float(unsigned char)> scale_func = [](unsigned char x) -> float {
+    // Image scale function, a plain lambda is inlined into the scaling loop
+    auto scale_func = [](unsigned char x) -> float {
         return static_cast<float>(x) / 255.0f;
     };
 
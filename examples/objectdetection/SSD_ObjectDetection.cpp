@@ -8,6 +8,10 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <SSD_EasyTFLite.h>
+#include <TiledDetector.h>
+#include <Tracker.h>
+#include <GatedDetector.h>
+#include <Pipeline.h>
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
@@ -26,12 +30,81 @@ std::vector<std::string> label_parse(const fs::path &label_path) {
     return output;
 }
 
+// Per frame state, recycled by the pipeline so buffers are reused from frame to frame
+struct Frame {
+    cv::Mat image;
+    // The detections above the threshold, its capacity is kept between frames
+    std::vector<Detection> detections;
+};
+
+// Draws the frame's detections
+void draw_detections(Frame &frame, const std::vector<std::string> &labels, float threshold) {
+    // Set colors
+    cv::Scalar label_text_color(255, 255, 255);
+    cv::Scalar box_color(255, 128, 0);
+
+    for (const Detection &detection : frame.detections) {
+        // Calculate scaled score
+        float scaled_score = (detection.score - threshold) * 100 / (1 - threshold);
+
+        // Set background score color
+        cv::Scalar label_background_color(0, static_cast<int>(scaled_score), 75);
+
+        // Prepare the class label
+        std::string label = labels[detection.class_id] + " (" + std::to_string(detection.score * 100) + "%)";
+
+        int box_top = static_cast<int>(detection.box.y);
+        int box_left = static_cast<int>(detection.box.x);
+        int box_bottom = static_cast<int>(detection.box.y + detection.box.height);
+        int box_right = static_cast<int>(detection.box.x + detection.box.width);
+
+        // Draw rectangle of detection
+        cv::rectangle(frame.image, cv::Point(box_left, box_top), cv::Point(box_right, box_bottom), box_color, 2);
+
+        // Draw the classification string just above and to the left of the rectangle
+        int baseline = 0;
+        cv::Size label_size = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
+        baseline += 1;
+
+        int label_left = box_left;
+        int label_top = box_top - label_size.height;
+        if (label_top < 1)
+            label_top = 1;
+        int label_right = label_left + label_size.width;
+        int label_bottom = label_top + label_size.height;
+        cv::rectangle(frame.image, cv::Point(label_left - 1, label_top - 1),
+                      cv::Point(label_right + 1, label_bottom + 1), label_background_color, -1);
+        cv::putText(frame.image, label, cv::Point(label_left, label_bottom), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+                    label_text_color, 1);
+    }
+
+    // display text to let user know how to exit
+    cv::rectangle(
+            frame.image,
+            cv::Rect(0, 0, 100, 15),
+            cv::Scalar(255, 0, 0)
+    );
+    cv::putText(
+            frame.image,
+            "q to Quit",
+            cv::Point(10, 12),
+            cv::FONT_HERSHEY_SIMPLEX,
+            0.4,
+            cv::Scalar(255, 0, 0)
+    );
+}
+
 int main(int argc, char **argv) {
     // Init google logging
     google::InitGoogleLogging(argv[0]);
 
     // Get Arguments
     float threshold = 0.6;
+    int tile_size = 0;
+    int detect_interval = 1;
+    int max_stale_frames = 0;
+    int metrics_port = 0;
+    ExecutionConfig execution_config;
     std::string videosource("0");
     fs::path project_path(fs::current_path().parent_path());
     fs::path model_path(project_path.string() + "/examples/objectdetection/detect.tflite");
@@ -48,6 +121,24 @@ int main(int argc, char **argv) {
              "The path to the labels")
             ("threshold", po::value<float>(&threshold)->default_value(threshold),
              "Detection Threshold")
+            ("tile-size", po::value<int>(&tile_size)->default_value(tile_size),
+             "Detect on overlapping tiles of this size for small objects in large frames, 0 to disable")
+            ("detect-interval", po::value<int>(&detect_interval)->default_value(detect_interval),
+             "Run the detector every this many frames and track objects in between, 1 to detect on every frame")
+            ("change-gate", po::value<int>(&max_stale_frames)->default_value(max_stale_frames),
+             "Skip inference on static frames and only infer changed regions, inferring the whole frame at least "
+             "every this many frames, 0 to disable")
+            ("threads", po::value<int>(&execution_config.num_threads)->default_value(execution_config.num_threads),
+             "Interpreter threads, -1 lets TensorFlow Lite decide")
+            ("xnnpack", po::bool_switch(&execution_config.use_xnnpack), "Run on the XNNPACK delegate")
+            ("autotune", po::bool_switch(&execution_config.autotune),
+             "Time thread counts and delegates at startup and keep the fastest, cached per model and host")
+            ("warmup", po::value<int>(&execution_config.warmup_invokes)->default_value(execution_config.warmup_invokes),
+             "Invokes on synthetic inputs before the first frame")
+            ("weight-cache", po::value<fs::path>(&execution_config.xnnpack_weight_cache),
+             "Directory XNNPACK's packed weights are cached in across restarts")
+            ("metrics-port", po::value<int>(&metrics_port)->default_value(metrics_port),
+             "Serve Prometheus metrics on this local port, 0 to disable")
             ("output", po::value(&output)->default_value(output),
              "The path to the output video")
             ("help", "Produce help message");
@@ -65,12 +156,27 @@ int main(int argc, char **argv) {
     // Get labels
     auto labels = label_parse(label_path);
 
-    // Set colors
-    cv::Scalar label_text_color(255, 255, 255);
-    cv::Scalar box_color(255, 128, 0);
-
-    // Init model
-    SSD_EasyTFLite model(model_path);
+    // Init model, either on the whole frame or on tiles
+    std::shared_ptr<const tflite::FlatBufferModel> shared_model = TFLite::load_model(model_path);
+    SSD_EasyTFLite model(shared_model, execution_config);
+    std::unique_ptr<TiledDetector> tiled_model;
+    if (tile_size > 0) {
+        TilingOptions tiling_options;
+        tiling_options.tile_width = tile_size;
+        tiling_options.tile_height = tile_size;
+        InterpreterPoolOptions pool_options;
+        pool_options.config = execution_config;
+        tiled_model = std::make_unique<TiledDetector>(shared_model, tiling_options, pool_options);
+    }
+    std::unique_ptr<GatedDetector> gated_model;
+    if (max_stale_frames > 0 && !tiled_model) {
+        ChangeGateOptions gate_options;
+        gate_options.max_stale_frames = max_stale_frames;
+        gated_model = std::make_unique<GatedDetector>(shared_model, gate_options, execution_config);
+    }
+    TrackingOptions tracking_options;
+    tracking_options.detection_interval = detect_interval;
+    Tracker tracker(tracking_options);
 
     // Init video capture
     cv::VideoCapture cap;
@@ -88,79 +194,56 @@ int main(int argc, char **argv) {
     if (!cap.isOpened())
         LOG(FATAL) << "Error: Video capture couldn't be opened\n";
 
-    cv::Mat frame;
-    while (cap.read(frame)) {
-        // Run model inference on captured frame
-        // First tensor contains the location data
-        // Second tensor contains the detected classes
-        // Third tensor contains the score for the classes
-        // Fourth tensor contains the number of detections
-        std::array<Eigen::Tensor<float, 2>, 4> model_output = model.run_inference(frame);
-
-        // Get and loop the number of detections
-        int n_detections = static_cast<int>(model_output[3](0, 0));
-        for (int i = 0; i < n_detections; i++) {
-
-            // Get the score for the object
-            float score = model_output[2](0, i);
-
-            // Filter out scores under threshold
-            if (score < threshold)
-                continue;
-
-            // Calculate scaled score
-            float scaled_score = (score - threshold) * 100 / (threshold - score);
-
-            // Set background score color
-            cv::Scalar label_background_color(0, static_cast<int>(scaled_score), 75);
-
-            // Get class & prepare the class label
-            int cls = static_cast<int>(model_output[1](0, i));
-            std::string label = labels[cls] + " (" + std::to_string(scaled_score) + "%)";
-
-            int box_top = model_output[0](i, 0);
-            int box_left = model_output[0](i, 1);
-            int box_bottom = model_output[0](i, 2);
-            int box_right = model_output[0](i, 3);
-
-            // Draw rectangle of detection
-            cv::rectangle(frame, cv::Point(box_left, box_top), cv::Point(box_right, box_bottom), box_color, 2);
-
-            // Draw the classification string just above and to the left of the rectangle
-            int baseline = 0;
-            cv::Size label_size = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
-            baseline += 1;
-
-            int label_left = box_left;
-            int label_top = box_top - label_size.height;
-            if (label_top < 1)
-                label_top = 1;
-            int label_right = label_left + label_size.width;
-            int label_bottom = label_top + label_size.height;
-            cv::rectangle(frame, cv::Point(label_left - 1, label_top - 1), cv::Point(label_right + 1, label_bottom + 1),
-                          label_background_color, -1);
-            cv::putText(frame, label, cv::Point(label_left, label_bottom), cv::FONT_HERSHEY_SIMPLEX, 0.5,
-                        label_text_color, 1);
-        }
-
-        // display text to let user know how to exit
-        cv::rectangle(
-                frame,
-                cv::Rect(0, 0, 100, 15),
-                cv::Scalar(255, 0, 0)
-        );
-        cv::putText(
-                frame,
-                "q to Quit",
-                cv::Point(10, 12),
-                cv::FONT_HERSHEY_SIMPLEX,
-                0.4,
-                cv::Scalar(255, 0, 0)
-        );
-
-        writer.write(frame);
+    // Capture, inference, drawing and writing each run on their own thread
+    PipelineOptions pipeline_options;
+    // A live camera skips stale frames instead of falling behind, a video file is processed completely
+    if (videosource == "0")
+        pipeline_options.overflow = OverflowPolicy::DropOldest;
+
+    // Latencies, invoke counts, queue depths and dropped frames, served for Prometheus to scrape
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    if (metrics_port > 0) {
+        model.enable_metrics(model_path.stem().string());
+        pipeline_options.metrics = &MetricsRegistry::global();
+        pipeline_options.name = "detection";
+        MetricsExportOptions export_options;
+        export_options.port = metrics_port;
+        metrics_exporter = std::make_unique<MetricsExporter>(MetricsRegistry::global(), export_options);
     }
 
+    Pipeline<Frame> pipeline(
+            [&](Frame &frame) { return cap.read(frame.image); },
+            {
+                    [&](Frame &frame) {
+                        if (detect_interval > 1) {
+                            // The tracker decides whether the detector runs on this frame
+                            const std::vector<Track> &tracks =
+                                    tiled_model ? tracker.track(frame.image, *tiled_model, threshold) :
+                                    gated_model ? tracker.track(frame.image, *gated_model, threshold) :
+                                    tracker.track(frame.image, model, threshold);
+                            frame.detections.clear();
+                            for (const Track &track : tracks)
+                                frame.detections.push_back(track.detection);
+                        } else if (tiled_model)
+                            tiled_model->detect(frame.image, frame.detections, threshold);
+                        else if (gated_model)
+                            gated_model->detect(frame.image, frame.detections, threshold);
+                        else
+                            model.detect(frame.image, frame.detections, threshold);
+                    },
+                    [&](Frame &frame) { draw_detections(frame, labels, threshold); }
+            },
+            [&](Frame &frame, uint64_t) { writer.write(frame.image); },
+            pipeline_options);
+    pipeline.start();
+    pipeline.wait();
+
+    if (pipeline.frames_dropped() > 0)
+        std::cout << "Dropped " << pipeline.frames_dropped() << " frames" << std::endl;
+    if (detect_interval > 1)
+        std::cout << "Ran the detector on " << tracker.detector_runs() << " of " << tracker.frames() << " frames"
+                  << std::endl;
+
     // Clean up
     cap.release();
     writer.release();
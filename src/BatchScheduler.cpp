@@ -0,0 +1,159 @@
+#include "BatchScheduler.h"
+
+#include <algorithm>
+
+BatchScheduler::BatchScheduler(const boost::filesystem::path &model_path,
+                               const BatchSchedulerOptions &scheduler_options)
+        : model(model_path, scheduler_options.config), options(scheduler_options) {
+    start();
+}
+
+BatchScheduler::BatchScheduler(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                               const BatchSchedulerOptions &scheduler_options)
+        : model(std::move(shared_model), scheduler_options.config), options(scheduler_options) {
+    start();
+}
+
+void BatchScheduler::start() {
+    if (options.max_batch_size == 0)
+        LOG(FATAL) << "Error: max_batch_size must be at least 1\n";
+    batch.reserve(options.max_batch_size);
+    batch_images.reserve(options.max_batch_size);
+    dequantized.resize(model.output_tensors().size());
+
+    // One allocated interpreter per power of two batch size
+    size_t batch_sizes = 1;
+    for (size_t size = 1; size < options.max_batch_size; size *= 2)
+        batch_sizes++;
+    model.set_shape_cache_size(batch_sizes);
+
+    if (options.metrics != nullptr) {
+        model.enable_metrics(options.name, *options.metrics);
+        queue_depth = &options.metrics->gauge("easytflite_batch_queue_depth", "Requests waiting to be batched",
+                                              {{"model", options.name}});
+        queue_delay = &options.metrics->histogram("easytflite_batch_queue_delay_seconds",
+                                                  "Time requests waited before their batch ran",
+                                                  {{"model", options.name}});
+    }
+    worker = std::thread(&BatchScheduler::work, this);
+}
+
+BatchScheduler::~BatchScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+std::future<BatchScheduler::Result> BatchScheduler::submit(const cv::Mat &image) {
+    Request request;
+    request.image = image;
+    request.submitted = std::chrono::steady_clock::now();
+    std::future<Result> result = request.result.get_future();
+
+    queue.push(std::move(request));
+    pending.fetch_add(1);
+    if (queue_depth != nullptr)
+        queue_depth->add(1);
+
+    // Only touch the mutex when the worker may be waiting
+    if (sleeping.load()) {
+        { std::lock_guard<std::mutex> lock(wake_mutex); }
+        wake.notify_one();
+    }
+    return result;
+}
+
+void BatchScheduler::drain_queue() {
+    while (batch.size() < options.max_batch_size && pending.load() > 0) {
+        Request request;
+        // A counted push can sit behind one still linking its node, which is counted and wakes the worker once linked
+        if (!queue.try_pop(request)) {
+            wait_for_submit(pending.load());
+            continue;
+        }
+        pending.fetch_sub(1);
+        if (queue_depth != nullptr)
+            queue_depth->add(-1);
+        batch.push_back(std::move(request));
+    }
+}
+
+void BatchScheduler::wait_for_submit(size_t seen) {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    sleeping = true;
+    // Only the worker takes requests out, so the count changes only when a submit finishes
+    wake.wait(lock, [this, seen]() { return pending.load() != seen; });
+    sleeping = false;
+}
+
+void BatchScheduler::run_batch() {
+    batch_images.clear();
+    auto now = std::chrono::steady_clock::now();
+    for (const Request &request : batch) {
+        batch_images.push_back(request.image);
+        if (queue_delay != nullptr)
+            queue_delay->record(std::chrono::duration_cast<std::chrono::microseconds>(now - request.submitted)
+                                        .count());
+    }
+
+    // Invoke with the next power of two, capped at the largest batch, so only a few batch sizes are ever allocated.
+    // The slots past the images aren't preprocessed, their outputs are ignored.
+    size_t batch_size = 1;
+    while (batch_size < batch.size())
+        batch_size *= 2;
+    batch_size = std::min(batch_size, options.max_batch_size);
+    auto outputs = model.run_inference_batch<float>(batch_images, options.preprocess, static_cast<int>(batch_size));
+
+    // Copy every image's slice out, the output tensors are overwritten by the next batch. Float outputs are sliced in
+    // place, the others are dequantized once for the whole batch first.
+    const std::vector<int> &ot = model.output_tensors();
+    std::vector<Result> results(batch.size(), Result(ot.size()));
+    for (size_t j = 0; j < ot.size(); j++) {
+        const float *values = outputs[0][j];
+        if (model.get_tensor_type(ot[j]) != kTfLiteFloat32) {
+            model.get_tensor_dequantized(ot[j], dequantized[j]);
+            values = dequantized[j].data();
+        }
+        long image_elements = model.get_tensor_element_count(ot[j]) / static_cast<long>(batch_size);
+        for (size_t i = 0; i < batch.size(); i++)
+            results[i][j].assign(values + i * image_elements, values + (i + 1) * image_elements);
+    }
+    for (size_t i = 0; i < batch.size(); i++)
+        batch[i].result.set_value(std::move(results[i]));
+    batch.clear();
+}
+
+void BatchScheduler::work() {
+    while (true) {
+        // Sleep until a request arrives
+        if (pending.load() == 0) {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            sleeping = true;
+            wake.wait(lock, [this]() { return pending.load() > 0 || stopping.load(); });
+            sleeping = false;
+            if (pending.load() == 0)
+                break;
+        }
+
+        // The oldest request sets the deadline for the batch
+        drain_queue();
+        auto deadline = batch.front().submitted + options.max_queue_delay;
+        while (batch.size() < options.max_batch_size && !stopping.load() &&
+               std::chrono::steady_clock::now() < deadline) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                sleeping = true;
+                wake.wait_until(lock, deadline, [this]() {
+                    return pending.load() + batch.size() >= options.max_batch_size || stopping.load();
+                });
+                sleeping = false;
+            }
+            drain_queue();
+        }
+
+        run_batch();
+    }
+}
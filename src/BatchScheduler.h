@@ -0,0 +1,146 @@
+#ifndef EASYTFLITE_BATCHSCHEDULER_H
+#define EASYTFLITE_BATCHSCHEDULER_H
+
+#include "EasyTFLite.h"
+#include "MPSCQueue.h"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+//! Options for BatchScheduler
+struct BatchSchedulerOptions {
+    //! Largest batch run in one invoke
+    size_t max_batch_size = 8;
+    //! Longest a request waits for others to join its batch
+    std::chrono::microseconds max_queue_delay = std::chrono::microseconds(2000);
+    //! How images are resized and normalized
+    PreprocessOptions preprocess = PreprocessOptions::minus_one_to_one();
+    //! Execution config of the model, threads, delegates and warm-up
+    ExecutionConfig config;
+    //! Registry the model's, queue's and batches' metrics are exported to, null to disable
+    MetricsRegistry *metrics = nullptr;
+    //! Value of the model label of the metrics
+    std::string name = "batch_scheduler";
+};
+
+//! The BatchScheduler class gathers concurrent single image requests into batched invokes
+/*!
+ * Any number of threads submit one image at a time. Requests are pushed to a lock-free queue and a worker thread forms
+ * a batch once max_batch_size requests are waiting or the oldest one has waited max_queue_delay, whichever comes
+ * first. The batch is run with EasyTFLite::run_inference_batch and every caller's future receives a copy of its own
+ * slice of the outputs, dequantized to float when the output tensor is quantized. Batches are invoked with the next
+ * power of two, capped at max_batch_size, and the model keeps one allocated interpreter per such size, so changing
+ * batch sizes never allocates tensors on the hot path. The model must accept a variable batch dimension, with
+ * max_batch_size 1 any single input image model works.
+ */
+class BatchScheduler {
+public:
+    //! The outputs of one image, one float vector per output tensor
+    using Result = std::vector<std::vector<float>>;
+
+private:
+    //! A submitted image and the promise its result is delivered to
+    struct Request {
+        //! The image, it shares the caller's pixels
+        cv::Mat image;
+        //! Receives the outputs
+        std::promise<Result> result;
+        //! When the request was submitted
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    //! The model, only used by the worker thread
+    EasyTFLite model;
+    //! The scheduler options
+    BatchSchedulerOptions options;
+    //! Submitted requests that haven't been batched yet
+    MPSCQueue<Request> queue;
+    //! Number of requests in queue
+    std::atomic<size_t> pending{0};
+    //! Whether the worker is, or is about to be, waiting for requests
+    std::atomic<bool> sleeping{false};
+    //! Set to stop the worker once the queue is drained
+    std::atomic<bool> stopping{false};
+    //! Only used to put the worker to sleep, submitting doesn't take it unless the worker sleeps
+    std::mutex wake_mutex;
+    //! Wakes the worker
+    std::condition_variable wake;
+    //! The current batch
+    std::vector<Request> batch;
+    //! The current batch's images
+    std::vector<cv::Mat> batch_images;
+    //! Dequantized values of every output tensor that isn't float, reused between batches
+    std::vector<std::vector<float>> dequantized;
+    //! The thread forming and running batches
+    std::thread worker;
+    //! Requests waiting to be batched, null when metrics are disabled
+    Gauge *queue_depth = nullptr;
+    //! Time requests waited before their batch ran, null when metrics are disabled
+    LatencyHistogram *queue_delay = nullptr;
+
+    /*!
+     * Checks the options, registers the metrics and starts the worker thread, the last step of both constructors
+     */
+    void start();
+
+    /*!
+     * Pops waiting requests into batch, up to max_batch_size
+     */
+    void drain_queue();
+
+    /*!
+     * Sleeps until another request is submitted
+     * @param seen The number of pending requests when the caller gave up popping
+     */
+    void wait_for_submit(size_t seen);
+
+    /*!
+     * Runs the current batch and fulfills its promises
+     */
+    void run_batch();
+
+    /*!
+     * The worker thread's loop
+     */
+    void work();
+
+public:
+    /*!
+     * Loads the model and starts the worker thread
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param scheduler_options The scheduler options
+     */
+    explicit BatchScheduler(const boost::filesystem::path &model_path,
+                            const BatchSchedulerOptions &scheduler_options = BatchSchedulerOptions());
+
+    /*!
+     * Builds the model from an already loaded model and starts the worker thread
+     * @param shared_model A model loaded with TFLite::load_model
+     * @param scheduler_options The scheduler options
+     */
+    explicit BatchScheduler(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                            const BatchSchedulerOptions &scheduler_options = BatchSchedulerOptions());
+
+    /*!
+     * Runs the requests still waiting and stops the worker thread
+     */
+    ~BatchScheduler();
+
+    BatchScheduler(const BatchScheduler &) = delete;
+
+    BatchScheduler &operator=(const BatchScheduler &) = delete;
+
+    /*!
+     * Submits an image for inference, safe to call from any thread. The image's pixels are not copied, so they must
+     * not be modified until the future is ready.
+     * @param image OpenCV's Mat image to run inference on
+     * @return A future receiving the image's outputs
+     */
+    std::future<Result> submit(const cv::Mat &image);
+};
+
+
+#endif //EASYTFLITE_BATCHSCHEDULER_H
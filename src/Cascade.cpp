@@ -0,0 +1,94 @@
+#include "Cascade.h"
+
+#include <cmath>
+
+Cascade::Cascade(const boost::filesystem::path &detector_path, const boost::filesystem::path &classifier_path,
+                 const CascadeOptions &cascade_options)
+        : Cascade(TFLite::load_model(detector_path), TFLite::load_model(classifier_path), cascade_options) {}
+
+Cascade::Cascade(std::shared_ptr<const tflite::FlatBufferModel> detector_model,
+                 std::shared_ptr<const tflite::FlatBufferModel> classifier_model,
+                 const CascadeOptions &cascade_options)
+        : detector(std::move(detector_model), cascade_options.detector_config),
+          classifier(std::move(classifier_model), cascade_options.classifier_config), options(cascade_options) {
+    if (options.max_batch_size < 1)
+        LOG(FATAL) << "Error: the cascade's batch size must be at least 1\n";
+    if (classifier.get_tensor_type(classifier.output_tensors()[0]) != kTfLiteFloat32)
+        LOG(FATAL) << "Error: the cascade's classifier must have a float first output\n";
+
+    // One allocated interpreter per power of two batch size
+    size_t batch_sizes = 1;
+    for (int size = 1; size < options.max_batch_size; size *= 2)
+        batch_sizes++;
+    classifier.set_shape_cache_size(batch_sizes);
+}
+
+void Cascade::run(const cv::Mat &frame, std::vector<CascadeDetection> &results, float threshold,
+                  const std::vector<int> &classes) {
+    detector.detect(frame, detections, threshold, classes);
+    classify(frame, detections, results);
+}
+
+void Cascade::classify(const cv::Mat &frame, const std::vector<Detection> &frame_detections,
+                       std::vector<CascadeDetection> &results) {
+    results.resize(frame_detections.size());
+    crops.clear();
+    crop_owners.clear();
+
+    cv::Rect2f frame_rect(0.0f, 0.0f, static_cast<float>(frame.cols), static_cast<float>(frame.rows));
+    for (size_t i = 0; i < frame_detections.size(); i++) {
+        CascadeDetection &result = results[i];
+        result.detection = frame_detections[i];
+        result.label = -1;
+        result.label_score = 0.0f;
+        result.scores.clear();
+
+        // Pad the box, clip it to the frame and take a view of it
+        const cv::Rect2f &box = frame_detections[i].box;
+        float pad_x = box.width * options.crop_padding;
+        float pad_y = box.height * options.crop_padding;
+        float left = std::max(frame_rect.x, box.x - pad_x);
+        float top = std::max(frame_rect.y, box.y - pad_y);
+        float right = std::min(frame_rect.width, box.x + box.width + pad_x);
+        float bottom = std::min(frame_rect.height, box.y + box.height + pad_y);
+        cv::Rect crop(static_cast<int>(std::floor(left)), static_cast<int>(std::floor(top)),
+                      static_cast<int>(std::ceil(right) - std::floor(left)),
+                      static_cast<int>(std::ceil(bottom) - std::floor(top)));
+        if (crop.width < options.min_crop_size || crop.height < options.min_crop_size)
+            continue;
+
+        crops.push_back(frame(crop));
+        crop_owners.push_back(i);
+        if (static_cast<int>(crops.size()) == options.max_batch_size)
+            classify_batch(results);
+    }
+    if (!crops.empty())
+        classify_batch(results);
+}
+
+void Cascade::classify_batch(std::vector<CascadeDetection> &results) {
+    // Invoke with the next power of two, capped at the largest batch, so only a few batch sizes are ever allocated.
+    // The slots past the crops aren't preprocessed, their scores are ignored.
+    size_t n_crops = crops.size();
+    size_t batch_size = 1;
+    while (batch_size < n_crops)
+        batch_size *= 2;
+    batch_size = std::min(batch_size, static_cast<size_t>(options.max_batch_size));
+
+    std::vector<std::vector<float *>> outputs = classifier.run_inference_batch<float>(crops, options.preprocess,
+                                                                                      static_cast<int>(batch_size));
+    auto n_scores = static_cast<size_t>(classifier.get_tensor_element_count(classifier.output_tensors()[0]) /
+                                        static_cast<int>(batch_size));
+    for (size_t i = 0; i < n_crops; i++) {
+        CascadeDetection &result = results[crop_owners[i]];
+        const float *scores = outputs[i][0];
+        result.scores.assign(scores, scores + n_scores);
+        Eigen::Index label;
+        result.label_score = Eigen::Map<const Eigen::ArrayXf>(scores, static_cast<Eigen::Index>(n_scores))
+                .maxCoeff(&label);
+        result.label = static_cast<int>(label);
+    }
+
+    crops.clear();
+    crop_owners.clear();
+}
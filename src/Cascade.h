@@ -0,0 +1,105 @@
+#ifndef EASYTFLITE_CASCADE_H
+#define EASYTFLITE_CASCADE_H
+
+#include "SSD_EasyTFLite.h"
+#include "Detection.h"
+
+//! Options for Cascade
+struct CascadeOptions {
+    //! How crops are normalized for the classifier
+    PreprocessOptions preprocess = PreprocessOptions::minus_one_to_one();
+    //! Fraction of a box's size added on every side of its crop, for context around the object
+    float crop_padding = 0.1f;
+    //! Most crops classified in one invoke, larger sets are split into several batches
+    int max_batch_size = 32;
+    //! Crops narrower or shorter than this many pixels aren't classified
+    int min_crop_size = 4;
+    //! How the detector executes, see ExecutionConfig
+    ExecutionConfig detector_config;
+    //! How the classifier executes, see ExecutionConfig
+    ExecutionConfig classifier_config;
+};
+
+//! A detection with the classification of its crop attached
+struct CascadeDetection {
+    //! The first stage's detection
+    Detection detection;
+    //! Index of the classifier's highest score, -1 when the crop was too small to classify
+    int label = -1;
+    //! The classifier's highest score
+    float label_score = 0.0f;
+    //! Every score of the classifier's first output, its capacity is kept between frames
+    std::vector<float> scores;
+};
+
+//! The Cascade class runs a detector, crops every detection and classifies all crops with a second model
+/*!
+ * Crops are ROI views of the frame, they are resized and normalized straight into the classifier's batched input so
+ * all crops are classified in a single invoke. Batches are invoked with the next power of two batch size, so only a
+ * handful of batch sizes are ever allocated and the classifier switches between them without reallocating, the slots
+ * past the crops are neither preprocessed nor read. The classifier must have a
+ * single rank 4 image input whose batch dimension can be resized and a float first output, whose first dimension is
+ * the batch.
+ */
+class Cascade {
+    //! The first stage
+    SSD_EasyTFLite detector;
+    //! The second stage
+    EasyTFLite classifier;
+    //! The cascade options
+    CascadeOptions options;
+    //! The first stage's detections, reused between frames
+    std::vector<Detection> detections;
+    //! Crops of the current batch, views of the frame
+    std::vector<cv::Mat> crops;
+    //! Index in the results of every crop of the current batch
+    std::vector<size_t> crop_owners;
+
+    /*!
+     * Classifies the crops gathered so far in one invoke and attaches the results
+     * @param results The results the crops belong to
+     */
+    void classify_batch(std::vector<CascadeDetection> &results);
+
+public:
+    /*!
+     * Loads both models
+     * @param detector_path The path to a Single Shot MultiBox Detector Tensorflow Lite Flatbuffer Model
+     * @param classifier_path The path to the classifier Tensorflow Lite Flatbuffer Model
+     * @param cascade_options The cascade options
+     */
+    Cascade(const boost::filesystem::path &detector_path, const boost::filesystem::path &classifier_path,
+            const CascadeOptions &cascade_options = CascadeOptions());
+
+    /*!
+     * Builds both stages from already loaded models
+     * @param detector_model A Single Shot MultiBox Detector model loaded with TFLite::load_model
+     * @param classifier_model A classifier model loaded with TFLite::load_model
+     * @param cascade_options The cascade options
+     */
+    Cascade(std::shared_ptr<const tflite::FlatBufferModel> detector_model,
+            std::shared_ptr<const tflite::FlatBufferModel> classifier_model,
+            const CascadeOptions &cascade_options = CascadeOptions());
+
+    /*!
+     * Runs the detector then classifies every detection
+     * @param frame The frame
+     * @param results Resized to the number of detections and filled, its elements are reused between frames
+     * @param threshold Lowest detection score kept
+     * @param classes Detection class indexes kept, every class is kept when empty
+     */
+    void run(const cv::Mat &frame, std::vector<CascadeDetection> &results, float threshold = 0.5f,
+             const std::vector<int> &classes = std::vector<int>());
+
+    /*!
+     * Classifies detections found by another detector, a TiledDetector for instance
+     * @param frame The frame the detections were found in
+     * @param frame_detections The detections, boxes in pixels of frame
+     * @param results Resized to the number of detections and filled, its elements are reused between frames
+     */
+    void classify(const cv::Mat &frame, const std::vector<Detection> &frame_detections,
+                  std::vector<CascadeDetection> &results);
+};
+
+
+#endif //EASYTFLITE_CASCADE_H
@@ -0,0 +1,62 @@
+#include "ChangeGate.h"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <glog/logging.h>
+
+ChangeGate::ChangeGate(const ChangeGateOptions &gate_options) : options(gate_options) {
+    if (options.downsample < 1)
+        LOG(FATAL) << "Error: the change gate's downsample factor must be at least 1\n";
+}
+
+GateDecision ChangeGate::evaluate(const cv::Mat &frame, cv::Rect &region) {
+    // Gray thumbnail of the frame
+    cv::Size thumbnail_size(std::max(1, frame.cols / options.downsample),
+                            std::max(1, frame.rows / options.downsample));
+    cv::resize(frame, resized, thumbnail_size, 0, 0, cv::INTER_AREA);
+    if (resized.channels() == 3)
+        cv::cvtColor(resized, current, cv::COLOR_BGR2GRAY);
+    else if (resized.channels() == 4)
+        cv::cvtColor(resized, current, cv::COLOR_BGRA2GRAY);
+    else
+        resized.copyTo(current);
+
+    stale_frames++;
+    if (reference.empty() || reference.size() != current.size() ||
+        (options.max_stale_frames > 0 && stale_frames >= options.max_stale_frames))
+        return GateDecision::Full;
+
+    cv::absdiff(current, reference, changes);
+    cv::threshold(changes, changes, options.pixel_threshold, 255, cv::THRESH_BINARY);
+    int changed = cv::countNonZero(changes);
+    if (changed <= options.min_changed_fraction * static_cast<float>(changes.total()))
+        return GateDecision::Skip;
+
+    // The changed thumbnail pixels' bounds, scaled back to the frame and padded
+    cv::Rect bounds = cv::boundingRect(changes);
+    float scale_x = static_cast<float>(frame.cols) / static_cast<float>(current.cols);
+    float scale_y = static_cast<float>(frame.rows) / static_cast<float>(current.rows);
+    float pad_x = bounds.width * scale_x * options.region_padding;
+    float pad_y = bounds.height * scale_y * options.region_padding;
+    int left = std::max(0, static_cast<int>(bounds.x * scale_x - pad_x));
+    int top = std::max(0, static_cast<int>(bounds.y * scale_y - pad_y));
+    int right = std::min(frame.cols, static_cast<int>((bounds.x + bounds.width) * scale_x + pad_x + 1.0f));
+    int bottom = std::min(frame.rows, static_cast<int>((bounds.y + bounds.height) * scale_y + pad_y + 1.0f));
+    region = cv::Rect(left, top, right - left, bottom - top);
+
+    if (region.area() > options.max_region_fraction * static_cast<float>(frame.cols) * static_cast<float>(frame.rows))
+        return GateDecision::Full;
+    return GateDecision::Region;
+}
+
+void ChangeGate::accepted(GateDecision decision) {
+    // Everything outside a region was under the threshold, so the whole thumbnail becomes the reference
+    cv::swap(reference, current);
+    if (decision == GateDecision::Full)
+        stale_frames = 0;
+}
+
+void ChangeGate::reset() {
+    reference.release();
+    stale_frames = 0;
+}
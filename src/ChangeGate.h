@@ -0,0 +1,77 @@
+#ifndef EASYTFLITE_CHANGEGATE_H
+#define EASYTFLITE_CHANGEGATE_H
+
+#include <opencv2/core.hpp>
+
+//! Options for ChangeGate
+struct ChangeGateOptions {
+    //! Frames are shrunk by this factor before being compared
+    int downsample = 8;
+    //! Smallest difference of a downsampled gray pixel counted as a change
+    int pixel_threshold = 20;
+    //! Fraction of changed downsampled pixels under which the frame is considered static
+    float min_changed_fraction = 0.002f;
+    //! Changed regions covering more than this fraction of the frame run on the whole frame
+    float max_region_fraction = 0.4f;
+    //! Fraction of the changed region's size added on every side, so moving objects are whole in the crop
+    float region_padding = 0.25f;
+    //! The whole frame is inferred at least once every this many frames, 0 to never force it
+    int max_stale_frames = 30;
+};
+
+//! What to do with a frame
+enum class GateDecision {
+    //! Nothing changed, the last results still hold
+    Skip,
+    //! Only a region changed, inference can run on a crop of it
+    Region,
+    //! Inference must run on the whole frame
+    Full
+};
+
+//! The ChangeGate class decides whether a frame needs inference by comparing it with the last inferred frame
+/*!
+ * Frames are shrunk to gray thumbnails with OpenCV's vectorized resize and compared with an absolute difference, so
+ * gating a frame costs a small fraction of an inference. Buffers are reused, nothing is allocated once the frame size
+ * settles.
+ */
+class ChangeGate {
+    //! The gate options
+    ChangeGateOptions options;
+    //! Thumbnail of the last inferred frame
+    cv::Mat reference;
+    //! Thumbnail of the frame being evaluated
+    cv::Mat current;
+    //! Color thumbnail before the gray conversion
+    cv::Mat resized;
+    //! Changed thumbnail pixels
+    cv::Mat changes;
+    //! Frames since the last whole frame inference
+    int stale_frames = 0;
+
+public:
+    /*!
+     * Creates a gate which infers the first frame
+     * @param gate_options The gate options
+     */
+    explicit ChangeGate(const ChangeGateOptions &gate_options = ChangeGateOptions());
+
+    /*!
+     * Compares a frame with the last inferred frame
+     * @param frame The frame
+     * @param region Set to the changed region in pixels of frame, padded and clipped, when the decision is Region
+     * @return The decision, to be followed by a call to accepted if inference ran
+     */
+    GateDecision evaluate(const cv::Mat &frame, cv::Rect &region);
+
+    /*!
+     * Makes the last evaluated frame the reference the next frames are compared with
+     * @param decision The decision inference followed, Full resets the staleness
+     */
+    void accepted(GateDecision decision);
+
+    //! Forgets the reference, the next frame is inferred whole
+    void reset();
+};
+
+#endif //EASYTFLITE_CHANGEGATE_H
@@ -0,0 +1,53 @@
+#include "Detection.h"
+
+#include <algorithm>
+
+float box_overlap(const cv::Rect2f &a, const cv::Rect2f &b, OverlapMetric metric) {
+    float width = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+    float height = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+    if (width <= 0.0f || height <= 0.0f)
+        return 0.0f;
+    float intersection = width * height;
+    float area_a = a.width * a.height;
+    float area_b = b.width * b.height;
+    float denominator = metric == OverlapMetric::IoU ? area_a + area_b - intersection : std::min(area_a, area_b);
+    return denominator > 0.0f ? intersection / denominator : 0.0f;
+}
+
+void non_max_suppression(std::vector<Detection> &detections, float overlap_threshold, OverlapMetric metric,
+                         bool class_aware, size_t max_detections) {
+    // With class awareness each class is a contiguous run, so the inner loop stops at the end of the run
+    if (class_aware)
+        std::sort(detections.begin(), detections.end(), [](const Detection &a, const Detection &b) {
+            return a.class_id != b.class_id ? a.class_id < b.class_id : a.score > b.score;
+        });
+    else
+        std::sort(detections.begin(), detections.end(), [](const Detection &a, const Detection &b) {
+            return a.score > b.score;
+        });
+
+    // Suppressed detections are marked with a negative score and removed afterwards
+    size_t n = detections.size();
+    for (size_t i = 0; i < n; i++) {
+        const Detection &kept = detections[i];
+        if (kept.score < 0.0f)
+            continue;
+        for (size_t j = i + 1; j < n; j++) {
+            Detection &other = detections[j];
+            if (class_aware && other.class_id != kept.class_id)
+                break;
+            if (other.score >= 0.0f && box_overlap(kept.box, other.box, metric) > overlap_threshold)
+                other.score = -1.0f;
+        }
+    }
+    detections.erase(std::remove_if(detections.begin(), detections.end(), [](const Detection &detection) {
+        return detection.score < 0.0f;
+    }), detections.end());
+
+    if (class_aware)
+        std::sort(detections.begin(), detections.end(), [](const Detection &a, const Detection &b) {
+            return a.score > b.score;
+        });
+    if (max_detections > 0 && detections.size() > max_detections)
+        detections.resize(max_detections);
+}
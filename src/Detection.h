@@ -0,0 +1,47 @@
+#ifndef EASYTFLITE_DETECTION_H
+#define EASYTFLITE_DETECTION_H
+
+#include <vector>
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+//! A detected object
+struct Detection {
+    //! The object's bounding box, in pixels of the image inference was run on
+    cv::Rect2f box;
+    //! The class index, as output by the model
+    int class_id = 0;
+    //! The detection's confidence, between 0 and 1
+    float score = 0.0f;
+};
+
+//! How the overlap of two boxes is measured
+enum class OverlapMetric {
+    //! Intersection over union
+    IoU,
+    //! Intersection over the area of the smaller box, also catches a box cut by a tile seam inside a whole one
+    IoMin
+};
+
+/*!
+ * Measures the overlap of two boxes
+ * @param a The first box
+ * @param b The second box
+ * @param metric How the overlap is measured
+ * @return The overlap, between 0 and 1
+ */
+float box_overlap(const cv::Rect2f &a, const cv::Rect2f &b, OverlapMetric metric = OverlapMetric::IoU);
+
+/*!
+ * Greedy non-maximum suppression, in place and without allocating. Detections are visited from the highest score
+ * down and every lower scoring detection overlapping a kept one by more than overlap_threshold is removed.
+ * @param detections The detections, left sorted by decreasing score
+ * @param overlap_threshold Largest overlap two kept detections may have
+ * @param metric How the overlap is measured
+ * @param class_aware Only suppress detections of the same class
+ * @param max_detections Most detections kept, 0 for no limit
+ */
+void non_max_suppression(std::vector<Detection> &detections, float overlap_threshold,
+                         OverlapMetric metric = OverlapMetric::IoU, bool class_aware = true, size_t max_detections = 0);
+
+#endif //EASYTFLITE_DETECTION_H
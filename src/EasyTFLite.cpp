@@ -4,10 +4,139 @@
 
 #include "EasyTFLite.h"
 
+int EasyTFLite::image_input_index(int batch_size, cv::Size image_size) {
+    // Reads the interpreter's own index and dims arrays, so steady state inference doesn't allocate
+    const std::vector<int> &it = interpreter->inputs();
+
+    // Assuming a one input model
+    if (it.size() != 1)
+        LOG(FATAL) << "Error: OpenCV's Mat inferencing can only be done on models with one input.\n";
+    int input_index = it[0];
+    // Assuming a Rank 4 input tensor for the model with the following [batch, y, x, c]
+    const TfLiteIntArray *dims = interpreter->tensor(input_index)->dims;
+    if (dims->size != 4)
+        LOG(FATAL) << "Error: OpenCV's Mat inferencing requires a model with a Rank 4 input tensor.\n";
+
+    int height = dims->data[1];
+    int width = dims->data[2];
+    if (native_multiple > 0 && !image_size.empty()) {
+        height = std::max(native_multiple, image_size.height / native_multiple * native_multiple);
+        width = std::max(native_multiple, image_size.width / native_multiple * native_multiple);
+    } else if (native_multiple == 0 && !model_resolution.empty()) {
+        height = model_resolution.height;
+        width = model_resolution.width;
+    }
+
+    // Only changes shape when the batch size or resolution changes
+    if (dims->data[0] != batch_size || dims->data[1] != height || dims->data[2] != width)
+        set_input_shape(input_index, {batch_size, height, width, dims->data[3]});
+    return input_index;
+}
+
+void EasyTFLite::set_native_resolution(bool enabled, int multiple) {
+    if (enabled && multiple < 1)
+        LOG(FATAL) << "Error: native resolution multiple must be at least 1\n";
+    // Remember the model's own resolution the first time, the input follows the images afterwards
+    if (enabled && model_resolution.empty()) {
+        const TfLiteIntArray *dims = interpreter->tensor(interpreter->inputs()[0])->dims;
+        if (dims->size == 4)
+            model_resolution = cv::Size(dims->data[2], dims->data[1]);
+    }
+    native_multiple = enabled ? multiple : 0;
+}
+
+const cv::Mat &EasyTFLite::resize_image(const cv::Mat &image, cv::Size target_size) {
+    // A header over the arena, cv::resize writes into it since the size and type already match
+    size_t bytes = static_cast<size_t>(target_size.area()) * image.elemSize();
+    resized_image = cv::Mat(target_size, image.type(), arena.get<unsigned char>(0, bytes));
+    cv::resize(image, resized_image, target_size);
+    return resized_image;
+}
+
+ArenaStats EasyTFLite::scratch_stats() const {
+    ArenaStats stats = arena.stats();
+    stats += preprocessor.arena_stats();
+    for (const FusedPreprocessor &batch_preprocessor : batch_preprocessors)
+        stats += batch_preprocessor.arena_stats();
+    return stats;
+}
+
+void EasyTFLite::preprocess_into(const cv::Mat &image, const PreprocessOptions &options, int batch_index,
+                                 FusedPreprocessor &slot_preprocessor) {
+    int input_index = interpreter->inputs()[0];
+    const TfLiteTensor *tensor = interpreter->tensor(input_index);
+    const int *dims = tensor->dims->data;
+    long offset = static_cast<long>(batch_index) * dims[1] * dims[2] * dims[3];
+
+    // Integer tensors without quantization parameters take the normalized values rounded, raw pixels with the
+    // default options
+    float quant_scale = tensor->params.scale;
+    int quant_zero_point = tensor->params.zero_point;
+    if (quant_scale == 0.0f) {
+        quant_scale = 1.0f;
+        quant_zero_point = 0;
+    }
+
+    switch (tensor->type) {
+        case kTfLiteFloat32:
+            slot_preprocessor.run(image, options, interpreter->typed_tensor<float>(input_index) + offset, dims[1],
+                                  dims[2], dims[3]);
+            break;
+        case kTfLiteUInt8:
+            slot_preprocessor.run(image, options, interpreter->typed_tensor<uint8_t>(input_index) + offset,
+                                  dims[1], dims[2], dims[3], quant_scale, quant_zero_point);
+            break;
+        case kTfLiteInt8:
+            slot_preprocessor.run(image, options, interpreter->typed_tensor<int8_t>(input_index) + offset,
+                                  dims[1], dims[2], dims[3], quant_scale, quant_zero_point);
+            break;
+        case kTfLiteInt16:
+            slot_preprocessor.run(image, options, interpreter->typed_tensor<int16_t>(input_index) + offset,
+                                  dims[1], dims[2], dims[3], quant_scale, quant_zero_point);
+            break;
+        case kTfLiteFloat16:
+            // TfLiteFloat16 and Eigen::half are the same IEEE half precision value
+            slot_preprocessor.run(image, options, reinterpret_cast<Eigen::half *>(tensor->data.f16) + offset, dims[1],
+                                  dims[2], dims[3]);
+            break;
+        default:
+            LOG(FATAL) << "Error: cannot preprocess into input type " << tensor->type << '\n';
+    }
+}
+
+void EasyTFLite::preprocess(const cv::Mat &image, const PreprocessOptions &options) {
+    image_input_index(1, image.size());
+    ScopedStage stage(profiler.get(), "preprocess", metrics.get());
+    preprocess_into(image, options, 0, preprocessor);
+}
+
 std::vector<float *> EasyTFLite::run_inference_ptrs(const cv::Mat &image) {
     // Assuming a scale between -1 and 1
-    std::function<float(unsigned char)> scale_func = [](unsigned char x) -> float {
-        return static_cast<float>(x) / 127.5f - 1.0f;
-    };
-    return run_inference_ptrs(image, scale_func);
+    return run_inference_ptrs<float>(image, PreprocessOptions::minus_one_to_one());
+}
+
+std::vector<float *> EasyTFLite::run_inference_ptrs(const cv::Mat &image, const PreprocessOptions &options) {
+    return run_inference_ptrs<float>(image, options);
+}
+
+void EasyTFLite::run_inference_dequantized(const cv::Mat &image, const PreprocessOptions &options,
+                                           std::vector<std::vector<float>> &outputs) {
+    ScopedInference inference(metrics.get(), "run_inference_dequantized");
+    preprocess(image, options);
+    invoke();
+
+    const std::vector<int> &ot = interpreter->outputs();
+    outputs.resize(ot.size());
+    for (size_t i = 0; i < ot.size(); i++)
+        get_tensor_dequantized(ot[i], outputs[i]);
+}
+
+std::vector<std::vector<float *>> EasyTFLite::run_inference_batch(const std::vector<cv::Mat> &images) {
+    // Assuming a scale between -1 and 1
+    return run_inference_batch<float>(images, PreprocessOptions::minus_one_to_one());
+}
+
+std::vector<std::vector<float *>> EasyTFLite::run_inference_batch(const std::vector<cv::Mat> &images,
+                                                                  const PreprocessOptions &options) {
+    return run_inference_batch<float>(images, options);
 }
@@ -6,8 +6,11 @@
 #define EASYTFLITE_EASYTFLITE_H
 
 #include "TFLite.h"
+#include "Preprocess.h"
+#include "ScaleLUT.h"
 
 #include <functional>
+#include <type_traits>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/imgproc.hpp>
 
@@ -18,8 +21,147 @@
  * A single function that runs inferencing on OpenCV's Mat class.
  */
 class EasyTFLite : protected TFLite {
+    //! Resizes, normalizes and quantizes images straight into the input tensor
+    FusedPreprocessor preprocessor;
+    //! Owns the resized image's pixels between calls
+    ScratchArena arena;
+    //! Header over the arena's resized image
+    cv::Mat resized_image;
+    //! One preprocessor per batch slot, so a batch can be preprocessed in parallel
+    std::vector<FusedPreprocessor> batch_preprocessors;
+    //! Input height and width are rounded down to a multiple of this with native resolution, 0 when disabled
+    int native_multiple = 0;
+    //! The input height and width before native resolution was enabled, restored when it is disabled
+    cv::Size model_resolution;
+
+    /*!
+     * Resizes an image to the model's input and applies scale_func to every byte, writing straight into the input
+     * tensor. The model must only have a single rank 4 input, [1, height, width, channels].
+     * @tparam InputType The input tensor data type
+     * @tparam ScaleFunc Any callable taking an unsigned char and returning an InputType, or a ScaleLUT
+     * @param image OpenCV's Mat image to scale
+     * @param scale_func The scale function
+     */
+    template<typename InputType, typename ScaleFunc>
+    void scale_into_input(const cv::Mat &image, ScaleFunc &scale_func) {
+        int input_index = image_input_index(1);
+        const std::vector<int> &dims = get_tensor_dims(input_index);
+
+        // Resize image, images already at the model's size are used as they are
+        const cv::Mat *source = &image;
+        cv::Size target_size(dims[2], dims[1]);
+        if (image.size() != target_size) {
+            ScopedStage stage(profiler.get(), "resize", metrics.get());
+            source = &resize_image(image, target_size);
+        }
+        if (source->channels() != dims[3])
+            LOG(FATAL) << "Error: image channels do not match the model's input channels\n";
+
+        // Scale row by row straight into the input tensor, rows of an ROI aren't contiguous
+        auto *tensor_ptr = get_tensor_ptr<InputType>(input_index);
+        if (tensor_ptr == nullptr)
+            LOG(FATAL) << "Error: scale function type does not match the model's input type\n";
+        ScopedStage stage(profiler.get(), "convert", metrics.get());
+        int row_elements = source->cols * source->channels();
+        for (int row = 0; row < source->rows; row++) {
+            const unsigned char *row_ptr = source->ptr<unsigned char>(row);
+            InputType *output_ptr = tensor_ptr + static_cast<long>(row) * row_elements;
+            if constexpr (is_scale_lut<std::decay_t<ScaleFunc>>::value)
+                scale_func.apply(row_ptr, output_ptr, row_elements);
+            else
+                std::transform(row_ptr, row_ptr + row_elements, output_ptr, scale_func);
+        }
+    }
+
+protected:
+    /*!
+     * Checks that the model has a single rank 4 input, [batch, height, width, channels], and resizes its batch
+     * dimension to batch_size if it differs. With native resolution enabled, its height and width are also set to the
+     * image's.
+     * @param batch_size The wanted batch size
+     * @param image_size Size of the image about to be preprocessed, ignored unless native resolution is enabled
+     * @return The index of the input tensor
+     */
+    int image_input_index(int batch_size, cv::Size image_size = cv::Size());
+
+    /*!
+     * Resizes an image into the arena, the result is valid until the next resize
+     * @param image OpenCV's Mat image to resize
+     * @param target_size The wanted size
+     * @return The resized image
+     */
+    const cv::Mat &resize_image(const cv::Mat &image, cv::Size target_size);
+
+    /*!
+     * Preprocesses an OpenCV Mat image into one slot of the input tensor's batch, see preprocess
+     * @param image OpenCV's Mat image to preprocess
+     * @param options The preprocess options
+     * @param batch_index Slot of the batch the image is written to
+     * @param slot_preprocessor The preprocessor used, a thread must not share it with another thread
+     */
+    void preprocess_into(const cv::Mat &image, const PreprocessOptions &options, int batch_index,
+                         FusedPreprocessor &slot_preprocessor);
+
+    /*!
+     * Preprocesses an OpenCV Mat image straight into the model's input tensor in a single pass. The model must only
+     * have a single input and that input must be a rank 4 Tensor, [1, height, width, channels] of type float, uint8 or
+     * int8. Integer inputs are quantized with the tensor's scale and zero point, if the tensor has none the normalized
+     * values are rounded, the raw pixel values with the default options.
+     * @param image OpenCV's Mat image to preprocess
+     * @param options The preprocess options
+     */
+    void preprocess(const cv::Mat &image, const PreprocessOptions &options);
+
 public:
     using TFLite::TFLite;
+    using TFLite::input_tensors;
+    using TFLite::output_tensors;
+    using TFLite::get_tensor_dims;
+    using TFLite::get_tensor_type;
+    using TFLite::get_tensor_element_count;
+    using TFLite::get_input_view;
+    using TFLite::get_input_span;
+    using TFLite::get_input_views;
+    using TFLite::bind_input_buffer;
+    using TFLite::get_quantization;
+    using TFLite::fill_tensor_quantized;
+    using TFLite::get_tensor_dequantized;
+    using TFLite::get_tensor_view;
+    using TFLite::get_output_views;
+    using TFLite::get_tensor_stable;
+    using TFLite::set_input_shape;
+    using TFLite::set_input_shapes;
+    using TFLite::set_shape_cache_size;
+    using TFLite::set_num_threads;
+    using TFLite::set_execution_config;
+    using TFLite::get_execution_config;
+    using TFLite::warmup;
+    using TFLite::get_model_fingerprint;
+    using TFLite::enable_profiling;
+    using TFLite::disable_profiling;
+    using TFLite::reset_profiling;
+    using TFLite::profiling_summary;
+    using TFLite::profiling_chrome_trace;
+    using TFLite::enable_metrics;
+    using TFLite::disable_metrics;
+
+    /*!
+     * Runs the fused preprocessing paths at the image's own resolution instead of resizing to the model's input
+     * dims, for models that accept variable resolution. The input's height and width follow every image, rounded
+     * down to a multiple, and interpreters for recently used resolutions are kept allocated, see
+     * TFLite::set_input_shape. Batches use the first image's resolution. Disabling it goes back to the model's
+     * own resolution.
+     * @param enabled Whether to run at native resolution
+     * @param multiple The input height and width are rounded down to a multiple of this, 32 for many detectors
+     */
+    void set_native_resolution(bool enabled, int multiple = 1);
+
+    /*!
+     * Gets the allocation counters of every preprocessing buffer, the resized image and the preprocessors' tables and
+     * rows. Once warmed up on same sized frames the allocation count stays flat.
+     * @return The counters summed over the instance's arenas
+     */
+    ArenaStats scratch_stats() const;
 
     /*!
      * Runs inference on an OpenCV Mat image, returns a vector of pointers to output data.
@@ -31,6 +173,119 @@ public:
      */
     std::vector<float *> run_inference_ptrs(const cv::Mat &image);
 
+    /*!
+     * Runs inference on an OpenCV Mat image, returns a vector of pointers to output data. The image is resized,
+     * normalized and, for quantized models, quantized straight into the input tensor in a single pass. The model must
+     * only have a single input and that input must be a rank 4 Tensor, [1, height, width, channels].
+     * @tparam OutputType The output tensor data type, must be uint8_t or float, depending if model is quantized or not
+     * @param image OpenCV's Mat image to run inference on
+     * @param options The resize, channel order and normalization options
+     * @return A vector of pointers to the output tensors
+     */
+    template<typename OutputType>
+    std::vector<OutputType *> run_inference_ptrs(const cv::Mat &image, const PreprocessOptions &options) {
+        ScopedInference inference(metrics.get(), "run_inference_ptrs");
+        preprocess(image, options);
+
+        // Invoke model
+        invoke();
+
+        return get_output_tensor_ptrs<OutputType>();
+    }
+
+    /*!
+     * Runs inference on an OpenCV Mat image using the fused preprocessing pass, returns a vector of pointers to the
+     * float output data. See run_inference_ptrs<OutputType>(const cv::Mat &, const PreprocessOptions &)
+     * @param image OpenCV's Mat image to run inference on
+     * @param options The resize, channel order and normalization options
+     * @return A vector of pointers to the output tensors
+     */
+    std::vector<float *> run_inference_ptrs(const cv::Mat &image, const PreprocessOptions &options);
+
+    /*!
+     * Runs inference on an OpenCV Mat image and reads every output as float, whatever the model's output types.
+     * Quantized outputs are dequantized with their own parameters, so fully integer models can be used without
+     * handling scales and zero points. See run_inference_ptrs<OutputType>(const cv::Mat &, const PreprocessOptions &)
+     * @param image OpenCV's Mat image to run inference on
+     * @param options The resize, channel order and normalization options
+     * @param outputs Resized to the number of outputs, each filled with an output's float data. The vectors' capacity
+     * is reused between calls.
+     */
+    void run_inference_dequantized(const cv::Mat &image, const PreprocessOptions &options,
+                                   std::vector<std::vector<float>> &outputs);
+
+    /*!
+     * Runs inference on a batch of OpenCV Mat images in a single invoke. The batch dimension of the model's input is
+     * resized to the number of images, tensors are only reallocated when the batch size changes. The images are
+     * preprocessed in parallel straight into their slot of the input tensor. The model must have a single rank 4
+     * input, [batch, height, width, channels], and outputs whose first dimension is the batch.
+     * @tparam OutputType The output tensor data type, must be uint8_t or float, depending if model is quantized or not
+     * @param images OpenCV's Mat images to run inference on
+     * @param options The resize, channel order and normalization options
+     * @param batch_size Batch size the model is invoked with, 0 for the number of images. A larger one keeps the
+     * number of allocated batch sizes small, the slots past the images aren't preprocessed and their outputs ignored.
+     * @return For every image, a vector of pointers to that image's part of the output tensors. The pointers are
+     * valid until the next inference.
+     */
+    template<typename OutputType>
+    std::vector<std::vector<OutputType *>> run_inference_batch(const std::vector<cv::Mat> &images,
+                                                               const PreprocessOptions &options, int batch_size = 0) {
+        if (images.empty())
+            return {};
+        ScopedInference inference(metrics.get(), "run_inference_batch");
+        int n_images = static_cast<int>(images.size());
+        if (batch_size == 0)
+            batch_size = n_images;
+        if (batch_size < n_images)
+            LOG(FATAL) << "Error: batch size " << batch_size << " is smaller than the " << n_images << " images\n";
+        image_input_index(batch_size, images[0].size());
+        if (batch_preprocessors.size() < images.size())
+            batch_preprocessors.resize(images.size());
+
+        // Preprocess every image into its slot of the batch
+        {
+            ScopedStage stage(profiler.get(), "preprocess", metrics.get());
+            cv::parallel_for_(cv::Range(0, n_images), [&](const cv::Range &range) {
+                for (int i = range.start; i < range.end; i++)
+                    preprocess_into(images[i], options, i, batch_preprocessors[i]);
+            });
+        }
+
+        // Invoke model
+        invoke();
+
+        // Split every output into per image views
+        const std::vector<int> &ot = output_tensors();
+        std::vector<std::vector<OutputType *>> output(images.size(), std::vector<OutputType *>(ot.size()));
+        for (size_t j = 0; j < ot.size(); j++) {
+            const std::vector<int> &dims = get_tensor_dims(ot[j]);
+            if (dims.empty() || dims[0] != batch_size)
+                LOG(FATAL) << "Error: output tensor " << ot[j] << " doesn't have the batch as first dimension\n";
+            OutputType *output_ptr = get_tensor_ptr<OutputType>(ot[j]);
+            int image_elements = get_tensor_element_count(ot[j]) / batch_size;
+            for (int i = 0; i < n_images; i++)
+                output[i][j] = output_ptr + static_cast<long>(i) * image_elements;
+        }
+        return output;
+    }
+
+    /*!
+     * Runs inference on a batch of OpenCV Mat images in a single invoke with the values scaled to between -1 and 1,
+     * see run_inference_batch<OutputType>
+     * @param images OpenCV's Mat images to run inference on
+     * @return For every image, a vector of pointers to that image's part of the float output tensors
+     */
+    std::vector<std::vector<float *>> run_inference_batch(const std::vector<cv::Mat> &images);
+
+    /*!
+     * Runs inference on a batch of OpenCV Mat images in a single invoke, see run_inference_batch<OutputType>
+     * @param images OpenCV's Mat images to run inference on
+     * @param options The resize, channel order and normalization options
+     * @return For every image, a vector of pointers to that image's part of the float output tensors
+     */
+    std::vector<std::vector<float *>> run_inference_batch(const std::vector<cv::Mat> &images,
+                                                          const PreprocessOptions &options);
+
     /*!
      * Runs inference on an OpenCV Mat image, returns a vector of pointers to the output data. You can use this function
      * to define a custom scale function and preprocess an image between it being scaled and the image data being sent
@@ -46,36 +301,10 @@ public:
      */
     template<typename InputType, typename OutputType>
     std::vector<OutputType *> run_inference_ptrs(const cv::Mat &image, const std::function<InputType(unsigned char)> &scale_func) {
-        std::vector<int> it = input_tensors();
-        std::vector<int> ot = output_tensors();
-        int input_index = it[0];
-
-        // Assuming a one input model
-        if (it.size() != 1)
-            LOG(FATAL) << "Error: OpenCV's Mat inferencing can only be done on models with one input.\n";
-        // Assuming a Rank 4 input tensor for the model with the following [1, x, y, c]
-        std::vector<int> dims = get_tensor_dims(input_index);
-        if (dims.size() != 4)
-            LOG(FATAL) << "Error: OpenCV's Mat inferencing requires a model with a Rank 4 input tensor.\n";
-
-        // Resize image
-        cv::Mat resized_image;
-        cv::Size target_size(dims[1], dims[2]);
-        cv::resize(image, resized_image, target_size);
-
-        // Get the number of elements in image
-        int total_elements = resized_image.channels() * resized_image.rows * resized_image.cols;
-        const unsigned char *resized_image_ptr = resized_image.data;
-
-        // Where converted data will be stored
-        std::vector<InputType> float_data;
-
-        // Run Scale and convert function
-        std::transform(resized_image_ptr, resized_image_ptr + total_elements, std::back_inserter(float_data),
-                       scale_func);
-
-        // Fill input tensor
-        fill_tensor<InputType>(float_data.data(), input_index);
+        ScopedInference inference(metrics.get(), "run_inference_ptrs");
+        // A std::function can't be inlined, so it is evaluated once into a table instead of once per byte
+        ScaleLUT<InputType> scale_lut(scale_func);
+        scale_into_input<InputType>(image, scale_lut);
 
         // Invoke model
         invoke();
@@ -100,6 +329,37 @@ public:
         return run_inference_ptrs<T, T>(image, scale_func);
     }
 
+    /*!
+     * Runs inference on an OpenCV Mat image, returns a vector of pointers to the output data. The same as the
+     * std::function overloads but the scale function can be any callable, lambdas and functors are inlined into the
+     * scaling loop, and a ScaleLUT is applied with its vectorized lookup. The model must only have a single input and
+     * the input must be a rank 4 Tensor, [1, height, width, channels].
+     * @tparam ScaleFunc Any callable taking an unsigned char, deduced
+     * @tparam InputType The input tensor data type, deduced from the return type of ScaleFunc
+     * @tparam OutputType The output tensor data type, defaults to InputType
+     * @param image OpenCV's Mat image to run inference on
+     * @param scale_func Your custom scale function, it is applied to all elements of image after it has been scaled
+     * to the size of model
+     * @return A vector of pointers to the output tensors
+     */
+    template<typename ScaleFunc,
+            typename InputType = std::decay_t<std::invoke_result_t<ScaleFunc &, unsigned char>>,
+            typename OutputType = InputType>
+    std::vector<OutputType *> run_inference_ptrs(const cv::Mat &image, ScaleFunc &&scale_func) {
+        ScopedInference inference(metrics.get(), "run_inference_ptrs");
+        if constexpr (is_std_function<std::decay_t<ScaleFunc>>::value) {
+            ScaleLUT<InputType> scale_lut(scale_func);
+            scale_into_input<InputType>(image, scale_lut);
+        } else {
+            scale_into_input<InputType>(image, scale_func);
+        }
+
+        // Invoke model
+        invoke();
+
+        return get_output_tensor_ptrs<OutputType>();
+    }
+
     /*!
      * Runs inference on an OpenCV Mat image, returns a vector of pointers to the output data. You can use this function
      * to define a custom preprocess function between the image being scaled and the image data being sent to the
@@ -115,25 +375,23 @@ public:
      */
     template<typename InputType, typename OutputType>
     std::vector<OutputType *> run_inference_ptrs(const cv::Mat &image, const std::function<std::vector<InputType>(cv::Mat)> &preprocess_func) {
-        std::vector<int> it = input_tensors();
-        std::vector<int> ot = output_tensors();
-        int input_index = it[0];
-
-        // Assuming a one input model
-        if (it.size() != 1)
-            LOG(FATAL) << "Error: OpenCV's Mat inferencing can only be done on models with one input.\n";
-        // Assuming a Rank 4 input tensor for the model with the following [1, x, y, c]
-        std::vector<int> dims = get_tensor_dims(input_index);
-        if (dims.size() != 4)
-            LOG(FATAL) << "Error: OpenCV's Mat inferencing requires a model with a Rank 4 input tensor.\n";
-
-        // Resize image
-        cv::Mat resized_image;
-        cv::Size target_size(dims[1], dims[2]);
-        cv::resize(image, resized_image, target_size);
+        ScopedInference inference(metrics.get(), "run_inference_ptrs");
+        int input_index = image_input_index(1);
+        const std::vector<int> &dims = get_tensor_dims(input_index);
+
+        // Resize image into the arena so its buffer is reused
+        cv::Size target_size(dims[2], dims[1]);
+        {
+            ScopedStage stage(profiler.get(), "resize", metrics.get());
+            resize_image(image, target_size);
+        }
 
         // Apply preprocess function
-        std::vector<InputType> float_data = preprocess_func(resized_image);
+        std::vector<InputType> float_data;
+        {
+            ScopedStage stage(profiler.get(), "convert", metrics.get());
+            float_data = preprocess_func(resized_image);
+        }
 
         // Fill input tensor
         fill_tensor<InputType>(float_data.data(), input_index);
@@ -170,6 +428,7 @@ public:
      */
     template<typename InputType, typename OutputType>
     std::vector<OutputType *> run_inference_ptrs(const std::vector<InputType *> input_ptrs) {
+        ScopedInference inference(metrics.get(), "run_inference_ptrs");
         // Fill input tensors
         fill_input_tensors<InputType>(input_ptrs);
         // Invoke Network
@@ -192,6 +451,7 @@ public:
      */
     template<typename InputType, typename OutputType, int InputRank, int OutputRank>
     std::vector<Eigen::Tensor<OutputType, OutputRank>> run_inference(const std::vector<Eigen::Tensor<InputType, InputRank>> input_tensors) {
+        ScopedInference inference(metrics.get(), "run_inference");
         // Fill input tensors
         fill_input_tensors<InputType, InputRank>(input_tensors);
         // Invoke Network
@@ -0,0 +1,199 @@
+#include "ExecutionConfig.h"
+
+#include <map>
+#include <mutex>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <glog/logging.h>
+#include <boost/filesystem.hpp>
+#include <tensorflow/lite/version.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+uint64_t model_fingerprint(const tflite::FlatBufferModel &model) {
+    const tflite::Allocation *allocation = model.allocation();
+    if (allocation == nullptr)
+        LOG(FATAL) << "Error: the model has no flatbuffer to fingerprint\n";
+
+    uint64_t hash = 14695981039346656037ULL;
+    const auto *bytes = static_cast<const unsigned char *>(allocation->base());
+    for (size_t i = 0; i < allocation->bytes(); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t shared_model_fingerprint(const std::shared_ptr<const tflite::FlatBufferModel> &model) {
+    // Keyed by address, the weak pointer tells a live model from a new one allocated at the same address
+    static std::mutex mutex;
+    static std::map<const tflite::FlatBufferModel *,
+                    std::pair<std::weak_ptr<const tflite::FlatBufferModel>, uint64_t>> fingerprints;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = fingerprints.find(model.get());
+        if (it != fingerprints.end() && it->second.first.lock() == model)
+            return it->second.second;
+    }
+
+    // Hashed outside the lock, two instances racing on a new model both hash it once
+    uint64_t fingerprint = model_fingerprint(*model);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto entry = fingerprints.begin(); entry != fingerprints.end();) {
+        if (entry->second.first.expired())
+            entry = fingerprints.erase(entry);
+        else
+            ++entry;
+    }
+    fingerprints[model.get()] = {model, fingerprint};
+    return fingerprint;
+}
+
+boost::filesystem::path autotune_cache_path(const ExecutionConfig &config) {
+    if (!config.autotune_cache.empty())
+        return config.autotune_cache;
+    const char *cache_home = std::getenv("XDG_CACHE_HOME");
+    if (cache_home != nullptr && *cache_home != '\0')
+        return boost::filesystem::path(cache_home) / "easytflite" / "autotune.txt";
+    const char *home = std::getenv("HOME");
+    return boost::filesystem::path(home != nullptr ? home : ".") / ".cache" / "easytflite" / "autotune.txt";
+}
+
+namespace {
+    /*!
+     * Parses a line of the autotune cache, "key threads xnnpack"
+     * @param line The line
+     * @param key Set to the line's key
+     * @param config Its num_threads and use_xnnpack are set
+     * @return Whether the line is a result
+     */
+    bool parse_autotune_line(const std::string &line, uint64_t &key, ExecutionConfig &config) {
+        std::istringstream fields(line);
+        int threads, xnnpack;
+        if (!(fields >> std::hex >> key >> std::dec >> threads >> xnnpack))
+            return false;
+        config.num_threads = threads;
+        config.use_xnnpack = xnnpack != 0;
+        return true;
+    }
+}
+
+bool load_autotune_result(const boost::filesystem::path &cache_path, uint64_t key, ExecutionConfig &config) {
+    std::ifstream file(cache_path.string());
+    if (!file.is_open())
+        return false;
+
+    // One result per key, older files may repeat a key and then the last line wins
+    bool found = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        uint64_t line_key;
+        ExecutionConfig line_config;
+        if (!parse_autotune_line(line, line_key, line_config) || line_key != key)
+            continue;
+        config.num_threads = line_config.num_threads;
+        config.use_xnnpack = line_config.use_xnnpack;
+        found = true;
+    }
+    return found;
+}
+
+void store_autotune_result(const boost::filesystem::path &cache_path, uint64_t key, const ExecutionConfig &config) {
+    boost::system::error_code error;
+    if (cache_path.has_parent_path())
+        boost::filesystem::create_directories(cache_path.parent_path(), error);
+
+    // Keep every other key's result, in the order they were stored
+    std::vector<std::string> lines;
+    {
+        std::ifstream existing(cache_path.string());
+        std::string line;
+        while (std::getline(existing, line)) {
+            uint64_t line_key;
+            ExecutionConfig line_config;
+            if (parse_autotune_line(line, line_key, line_config) && line_key != key)
+                lines.push_back(line);
+        }
+    }
+    std::ostringstream result;
+    result << std::hex << key << std::dec << ' ' << config.num_threads << ' ' << (config.use_xnnpack ? 1 : 0);
+    lines.push_back(result.str());
+
+    // Another process tuning at the same time writes its own temporary file, the last rename wins
+    boost::filesystem::path temporary = cache_path;
+    temporary += "." + boost::filesystem::unique_path().string() + ".tmp";
+    {
+        std::ofstream file(temporary.string(), std::ios::trunc);
+        for (const std::string &line : lines)
+            file << line << '\n';
+        if (error || !file) {
+            LOG(WARNING) << "Warning: Couldn't write the autotune cache " << cache_path << '\n';
+            boost::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    boost::filesystem::rename(temporary, cache_path, error);
+    if (error) {
+        LOG(WARNING) << "Warning: Couldn't write the autotune cache " << cache_path << '\n';
+        boost::filesystem::remove(temporary, error);
+    }
+}
+
+std::string host_cpu_isa() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return "x86-avx512";
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return "x86-avx2";
+    if (__builtin_cpu_supports("avx"))
+        return "x86-avx";
+    return "x86-sse";
+#elif defined(__aarch64__) && defined(__linux__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    if (hwcap & HWCAP_ASIMDDP)
+        return "arm64-dot";
+    if (hwcap & HWCAP_ASIMDHP)
+        return "arm64-fp16";
+    return "arm64";
+#elif defined(__aarch64__)
+    return "arm64";
+#elif defined(__arm__)
+    return "arm";
+#else
+    return "generic";
+#endif
+}
+
+boost::filesystem::path xnnpack_weight_cache_path(const ExecutionConfig &config, uint64_t fingerprint) {
+    boost::system::error_code error;
+    boost::filesystem::create_directories(config.xnnpack_weight_cache, error);
+    if (error)
+        LOG(WARNING) << "Warning: Couldn't create the XNNPACK weight cache directory " << config.xnnpack_weight_cache
+                     << '\n';
+    std::ostringstream name;
+    name << std::hex << fingerprint << '-' << host_cpu_isa() << "-tflite-" << TFLITE_VERSION_STRING
+         << ".xnnpack_cache";
+    return config.xnnpack_weight_cache / name.str();
+}
+
+FileLock::FileLock(const boost::filesystem::path &path) {
+    fd = ::open(path.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG(WARNING) << "Warning: Couldn't open the lock file " << path << '\n';
+        return;
+    }
+    while (::flock(fd, LOCK_EX) != 0 && errno == EINTR);
+}
+
+FileLock::~FileLock() {
+    if (fd >= 0)
+        ::close(fd);
+}
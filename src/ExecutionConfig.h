@@ -0,0 +1,116 @@
+#ifndef EASYTFLITE_EXECUTIONCONFIG_H
+#define EASYTFLITE_EXECUTIONCONFIG_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem/path.hpp>
+#include <tensorflow/lite/model.h>
+
+//! How a TFLite interpreter executes the model
+struct ExecutionConfig {
+    //! Threads the kernels may use, -1 lets Tensorflow Lite decide
+    int num_threads = -1;
+    //! Run the ops XNNPACK supports on its delegate, needs a build with WITH_XNNPACK
+    bool use_xnnpack = false;
+    //! Let float ops compute in half precision where the kernels support it
+    bool allow_fp16 = false;
+    //! Time the candidate thread counts, with and without XNNPACK, at startup and keep the fastest
+    bool autotune = false;
+    //! Thread counts tried by autotune, empty tries powers of two up to the hardware's concurrency
+    std::vector<int> autotune_threads;
+    //! Timed invokes per candidate, after a warm-up invoke
+    int autotune_invokes = 5;
+    //! Where autotune results are cached, keyed by model and host, empty for ~/.cache/easytflite/autotune.txt
+    boost::filesystem::path autotune_cache;
+    //! Invokes on synthetic inputs run at the end of construction, so the first real frame runs at steady state speed
+    int warmup_invokes = 0;
+    //! Directory XNNPACK's packed weights are cached in, one file per model, CPU and Tensorflow Lite version, empty
+    //! to disable. Needs a build with WITH_XNNPACK_WEIGHT_CACHE, which needs Tensorflow Lite 2.17 or later
+    boost::filesystem::path xnnpack_weight_cache;
+};
+
+/*!
+ * Fingerprints a model's flatbuffer, the same bytes give the same value in every process and on every host
+ * @param model The model
+ * @return 64 bit FNV-1a hash of the flatbuffer
+ */
+uint64_t model_fingerprint(const tflite::FlatBufferModel &model);
+
+/*!
+ * Fingerprints a shared model once per process, every instance built from the same model gets the remembered value
+ * instead of hashing the flatbuffer again
+ * @param model The shared model
+ * @return 64 bit FNV-1a hash of the flatbuffer, see model_fingerprint
+ */
+uint64_t shared_model_fingerprint(const std::shared_ptr<const tflite::FlatBufferModel> &model);
+
+/*!
+ * Gets the file autotune results are cached in
+ * @param config The execution config
+ * @return The config's cache path, or the default one
+ */
+boost::filesystem::path autotune_cache_path(const ExecutionConfig &config);
+
+/*!
+ * Looks up a cached autotune result
+ * @param cache_path The cache file
+ * @param key The model fingerprint combined with the host's concurrency
+ * @param config Its num_threads and use_xnnpack are set when the key is found
+ * @return Whether the key was found
+ */
+bool load_autotune_result(const boost::filesystem::path &cache_path, uint64_t key, ExecutionConfig &config);
+
+/*!
+ * Stores an autotune result in the cache, replacing the key's previous result. The file is rewritten to a temporary
+ * file renamed over it, so concurrent readers see either version whole. Failures to write are only logged.
+ * @param cache_path The cache file
+ * @param key The model fingerprint combined with the host's concurrency
+ * @param config The chosen num_threads and use_xnnpack
+ */
+void store_autotune_result(const boost::filesystem::path &cache_path, uint64_t key, const ExecutionConfig &config);
+
+/*!
+ * Gets the instruction set XNNPACK picks its kernels for on this host, the weights it packs depend on it
+ * @return A short name, x86-avx512 or arm64-dot for instance
+ */
+std::string host_cpu_isa();
+
+/*!
+ * Gets the file XNNPACK's packed weights of a model are cached in, creating the cache directory if needed. Packed
+ * weights depend on the model, the kernels XNNPACK picks for the host's CPU and the XNNPACK version, so the name holds
+ * the fingerprint, host_cpu_isa and the Tensorflow Lite version, which pins XNNPACK's.
+ * @param config The execution config, its xnnpack_weight_cache must not be empty
+ * @param fingerprint The model's fingerprint
+ * @return The cache file
+ */
+boost::filesystem::path xnnpack_weight_cache_path(const ExecutionConfig &config, uint64_t fingerprint);
+
+//! An exclusive advisory lock on a file, so only one thread or process at a time creates what the file guards
+/*!
+ * The lock is taken on a separate open of the file, so it excludes other threads of the same process as well as other
+ * processes. The file is created if needed and left in place.
+ */
+class FileLock {
+    //! The locked file's descriptor, -1 when it couldn't be opened
+    int fd = -1;
+
+public:
+    /*!
+     * Blocks until the lock is taken, failures to open the file are only logged and leave it unlocked
+     * @param path The lock file
+     */
+    explicit FileLock(const boost::filesystem::path &path);
+
+    /*!
+     * Releases the lock
+     */
+    ~FileLock();
+
+    FileLock(const FileLock &) = delete;
+
+    FileLock &operator=(const FileLock &) = delete;
+};
+
+#endif //EASYTFLITE_EXECUTIONCONFIG_H
@@ -0,0 +1,41 @@
+#include "GatedDetector.h"
+
+#include <algorithm>
+
+GatedDetector::GatedDetector(const boost::filesystem::path &model_path, const ChangeGateOptions &gate_options,
+                             const ExecutionConfig &config)
+        : GatedDetector(TFLite::load_model(model_path), gate_options, config) {}
+
+GatedDetector::GatedDetector(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                             const ChangeGateOptions &gate_options, const ExecutionConfig &config)
+        : detector(std::move(shared_model), config), gate(gate_options) {}
+
+void GatedDetector::detect(const cv::Mat &frame, std::vector<Detection> &detections, float threshold,
+                           const std::vector<int> &classes) {
+    cv::Rect region;
+    decision = gate.evaluate(frame, region);
+    if (decision == GateDecision::Full) {
+        detector.detect(frame, cached, threshold, classes);
+        gate.accepted(decision);
+    } else if (decision == GateDecision::Region) {
+        detector.detect(frame(region), region_detections, threshold, classes);
+        gate.accepted(decision);
+
+        // Cached detections mostly inside the region are replaced by the region's
+        cv::Rect2f region_box(region);
+        cached.erase(std::remove_if(cached.begin(), cached.end(), [&region_box](const Detection &detection) {
+            return box_overlap(detection.box, region_box, OverlapMetric::IoMin) > 0.5f;
+        }), cached.end());
+        for (Detection &detection : region_detections) {
+            detection.box.x += static_cast<float>(region.x);
+            detection.box.y += static_cast<float>(region.y);
+            cached.push_back(detection);
+        }
+    }
+    detections.assign(cached.begin(), cached.end());
+}
+
+void GatedDetector::reset() {
+    gate.reset();
+    cached.clear();
+}
@@ -0,0 +1,70 @@
+#ifndef EASYTFLITE_GATEDDETECTOR_H
+#define EASYTFLITE_GATEDDETECTOR_H
+
+#include "SSD_EasyTFLite.h"
+#include "ChangeGate.h"
+#include "Detection.h"
+
+//! The GatedDetector class only runs a detector on the parts of a stream that changed
+/*!
+ * Every frame goes through a ChangeGate first. Static frames return the cached detections without inference, frames
+ * where only a region changed run the detector on a crop of that region and replace the cached detections inside it,
+ * and everything else, including every max_stale_frames-th frame, runs on the whole frame.
+ */
+class GatedDetector {
+    //! The detector
+    SSD_EasyTFLite detector;
+    //! Decides what runs on each frame
+    ChangeGate gate;
+    //! The detections of the last inference, boxes in pixels of the frame
+    std::vector<Detection> cached;
+    //! The detections of the changed region, reused between frames
+    std::vector<Detection> region_detections;
+    //! The last frame's decision
+    GateDecision decision = GateDecision::Full;
+
+public:
+    /*!
+     * Loads the detector
+     * @param model_path The path to a Single Shot MultiBox Detector Tensorflow Lite Flatbuffer Model
+     * @param gate_options The change gate options
+     * @param config How the detector executes, see ExecutionConfig
+     */
+    explicit GatedDetector(const boost::filesystem::path &model_path,
+                           const ChangeGateOptions &gate_options = ChangeGateOptions(),
+                           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Builds the detector from an already loaded model
+     * @param shared_model A Single Shot MultiBox Detector model loaded with TFLite::load_model
+     * @param gate_options The change gate options
+     * @param config How the detector executes, see ExecutionConfig
+     */
+    explicit GatedDetector(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                           const ChangeGateOptions &gate_options = ChangeGateOptions(),
+                           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Detects objects in a frame, inference only runs on what changed since the last inferred frame. The threshold and
+     * classes should stay the same from frame to frame since skipped frames return the cached detections.
+     * @param frame The frame
+     * @param detections Cleared, then filled with the detections, boxes are in pixels of frame
+     * @param threshold Lowest score kept
+     * @param classes Class indexes kept, every class is kept when empty
+     */
+    void detect(const cv::Mat &frame, std::vector<Detection> &detections, float threshold = 0.5f,
+                const std::vector<int> &classes = std::vector<int>());
+
+    /*!
+     * Gets what the last frame went through
+     * @return The gate's decision for the last frame
+     */
+    GateDecision last_decision() const {
+        return decision;
+    }
+
+    //! Forgets the cached detections, the next frame is inferred whole
+    void reset();
+};
+
+#endif //EASYTFLITE_GATEDDETECTOR_H
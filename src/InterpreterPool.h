@@ -0,0 +1,252 @@
+#ifndef EASYTFLITE_INTERPRETERPOOL_H
+#define EASYTFLITE_INTERPRETERPOOL_H
+
+#include "TFLite.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <condition_variable>
+
+//! What InterpreterPool::checkout does when every interpreter is leased
+enum class PoolExhaustion {
+    //! Wait until an interpreter is checked in
+    Block,
+    //! Wait up to InterpreterPoolOptions::timeout, then return an empty lease
+    Timeout,
+    //! Build another interpreter from the shared model, up to InterpreterPoolOptions::max_size
+    Grow
+};
+
+//! Options for InterpreterPool
+struct InterpreterPoolOptions {
+    //! Number of interpreters built up front, 0 uses one per hardware thread
+    size_t size = 0;
+    //! Threads each interpreter's kernels may use, -1 lets Tensorflow Lite decide
+    int threads_per_interpreter = 1;
+    //! What checkout does when every interpreter is leased
+    PoolExhaustion exhaustion = PoolExhaustion::Block;
+    //! How long checkout waits with PoolExhaustion::Timeout
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(100);
+    //! Largest the pool may grow to with PoolExhaustion::Grow, 0 for no limit
+    size_t max_size = 0;
+    //! Delegate, precision, autotuning and warm-up of every instance, for models constructible with one. Its
+    //! num_threads is replaced by threads_per_interpreter, unless autotune picks it.
+    ExecutionConfig config;
+};
+
+//! The InterpreterPool class builds several interpreters from one shared model for multi-threaded inference
+/*!
+ * A TFLite instance isn't safe to use from several threads, but the FlatBufferModel it is built from is immutable. The
+ * pool loads the model once and builds a number of instances of Model from it, which threads lease with checkout().
+ * A lease returns its instance to the pool when it is destroyed.
+ * @tparam Model TFLite or a class deriving from it, must be constructible from a
+ * std::shared_ptr<const tflite::FlatBufferModel> and an ExecutionConfig, or from the model alone and have
+ * set_num_threads(int)
+ */
+template<typename Model = TFLite>
+class InterpreterPool {
+    //! The shared, immutable model every instance is built from
+    std::shared_ptr<const tflite::FlatBufferModel> model;
+    //! The pool options
+    InterpreterPoolOptions options;
+    //! Guards idle and total
+    std::mutex mutex;
+    //! Signaled when an instance is checked in
+    std::condition_variable checked_in;
+    //! Instances that aren't leased
+    std::vector<std::unique_ptr<Model>> idle;
+    //! Number of instances the pool owns, leased or not
+    size_t total = 0;
+
+    /*!
+     * Builds a new instance from the shared model
+     * @return The new instance
+     */
+    std::unique_ptr<Model> build() {
+        if constexpr (std::is_constructible<Model, std::shared_ptr<const tflite::FlatBufferModel>,
+                                            const ExecutionConfig &>::value) {
+            ExecutionConfig config = options.config;
+            config.num_threads = options.threads_per_interpreter;
+            return std::make_unique<Model>(model, config);
+        } else {
+            auto instance = std::make_unique<Model>(model);
+            instance->set_num_threads(options.threads_per_interpreter);
+            return instance;
+        }
+    }
+
+    /*!
+     * Returns an instance to the pool and wakes a waiting checkout
+     * @param instance The instance to return
+     */
+    void checkin(std::unique_ptr<Model> instance) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(std::move(instance));
+        }
+        checked_in.notify_one();
+    }
+
+public:
+    //! A leased instance, returned to the pool when the lease is destroyed
+    /*!
+     * A lease must not outlive the pool it came from, the instance is handed back to the pool on release.
+     */
+    class Lease {
+        //! The pool the instance is returned to
+        InterpreterPool *pool = nullptr;
+        //! The leased instance, null for an empty lease
+        std::unique_ptr<Model> instance;
+
+        friend class InterpreterPool;
+
+        Lease(InterpreterPool *pool, std::unique_ptr<Model> instance) : pool(pool), instance(std::move(instance)) {}
+
+    public:
+        Lease() = default;
+
+        Lease(Lease &&other) noexcept = default;
+
+        Lease &operator=(Lease &&other) noexcept {
+            release();
+            pool = other.pool;
+            instance = std::move(other.instance);
+            return *this;
+        }
+
+        Lease(const Lease &) = delete;
+
+        Lease &operator=(const Lease &) = delete;
+
+        ~Lease() {
+            release();
+        }
+
+        /*!
+         * Returns the instance to the pool early, the lease is empty afterwards
+         */
+        void release() {
+            if (instance)
+                pool->checkin(std::move(instance));
+        }
+
+        //! Whether the lease holds an instance, false when a timed out checkout returned
+        explicit operator bool() const {
+            return instance != nullptr;
+        }
+
+        Model &operator*() const {
+            return *instance;
+        }
+
+        Model *operator->() const {
+            return instance.get();
+        }
+    };
+
+    /*!
+     * Loads the model once and builds the pool's instances from it
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param pool_options The pool options
+     */
+    explicit InterpreterPool(const boost::filesystem::path &model_path,
+                             const InterpreterPoolOptions &pool_options = InterpreterPoolOptions())
+            : InterpreterPool(TFLite::load_model(model_path), pool_options) {}
+
+    /*!
+     * Builds the pool's instances from an already loaded model
+     * @param shared_model A model loaded with TFLite::load_model
+     * @param pool_options The pool options
+     */
+    explicit InterpreterPool(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                             const InterpreterPoolOptions &pool_options = InterpreterPoolOptions())
+            : model(std::move(shared_model)), options(pool_options) {
+        if (options.size == 0)
+            options.size = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < options.size; i++)
+            idle.push_back(build());
+        total = options.size;
+    }
+
+    InterpreterPool(const InterpreterPool &) = delete;
+
+    InterpreterPool &operator=(const InterpreterPool &) = delete;
+
+    /*!
+     * Leases an instance, what happens when all are leased depends on InterpreterPoolOptions::exhaustion. The lease
+     * must be released or destroyed before the pool is.
+     * @return The lease, empty only if the exhaustion policy is PoolExhaustion::Timeout and it timed out
+     */
+    Lease checkout() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (idle.empty() && options.exhaustion == PoolExhaustion::Grow &&
+            (options.max_size == 0 || total < options.max_size)) {
+            // Build outside the lock, other threads can keep checking in and out meanwhile
+            total++;
+            lock.unlock();
+            try {
+                return Lease(this, build());
+            } catch (...) {
+                // The instance was never added
+                lock.lock();
+                total--;
+                throw;
+            }
+        }
+
+        auto has_idle = [this]() { return !idle.empty(); };
+        if (options.exhaustion == PoolExhaustion::Timeout) {
+            if (!checked_in.wait_for(lock, options.timeout, has_idle))
+                return Lease();
+        } else
+            checked_in.wait(lock, has_idle);
+
+        std::unique_ptr<Model> instance = std::move(idle.back());
+        idle.pop_back();
+        return Lease(this, std::move(instance));
+    }
+
+    /*!
+     * Leases an instance only if one is idle, never waits or grows
+     * @return The lease, empty if every instance is leased
+     */
+    Lease try_checkout() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.empty())
+            return Lease();
+        std::unique_ptr<Model> instance = std::move(idle.back());
+        idle.pop_back();
+        return Lease(this, std::move(instance));
+    }
+
+    /*!
+     * Gets the number of instances the pool owns, leased or not
+     * @return The pool size
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return total;
+    }
+
+    /*!
+     * Gets the number of instances that aren't leased
+     * @return The number of idle instances
+     */
+    size_t idle_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return idle.size();
+    }
+
+    /*!
+     * Gets the shared model the instances are built from
+     * @return The shared model
+     */
+    const std::shared_ptr<const tflite::FlatBufferModel> &shared_model() const {
+        return model;
+    }
+};
+
+
+#endif //EASYTFLITE_INTERPRETERPOOL_H
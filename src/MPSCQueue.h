@@ -0,0 +1,74 @@
+#ifndef EASYTFLITE_MPSCQUEUE_H
+#define EASYTFLITE_MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+//! The MPSCQueue class is an unbounded, lock-free, multiple producer single consumer queue
+/*!
+ * An intrusive linked list queue (Dmitry Vyukov's design): a push is one atomic exchange and never waits on other
+ * producers or the consumer. try_pop may only be called from one thread at a time. A pop can briefly miss an item
+ * whose push is still in progress, callers that know an item was pushed should retry.
+ * @tparam T The element type, must be default constructible and movable
+ */
+template<typename T>
+class MPSCQueue {
+    //! A list node
+    struct Node {
+        //! The next node, written by the producer that pushes it
+        std::atomic<Node *> next{nullptr};
+        //! The element
+        T value;
+    };
+
+    //! The most recently pushed node, shared by the producers
+    std::atomic<Node *> head;
+    //! The node before the oldest element, only touched by the consumer
+    Node *tail;
+
+public:
+    MPSCQueue() {
+        Node *stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    ~MPSCQueue() {
+        T value;
+        while (try_pop(value));
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    /*!
+     * Pushes an element, safe to call from any number of threads
+     * @param value The element
+     */
+    void push(T value) {
+        Node *node = new Node();
+        node->value = std::move(value);
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /*!
+     * Pops the oldest element, must only be called by the consumer
+     * @param value Where the element is moved to
+     * @return Whether an element was popped
+     */
+    bool try_pop(T &value) {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+};
+
+
+#endif //EASYTFLITE_MPSCQUEUE_H
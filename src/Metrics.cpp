@@ -0,0 +1,331 @@
+#include "Metrics.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <glog/logging.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace {
+    /*!
+     * Escapes a label value for the Prometheus text format
+     * @param text The value
+     * @return The escaped value
+     */
+    std::string escape_label(const std::string &text) {
+        std::string output;
+        for (char c : text) {
+            if (c == '\n') {
+                output += "\\n";
+                continue;
+            }
+            if (c == '"' || c == '\\')
+                output += '\\';
+            output += c;
+        }
+        return output;
+    }
+
+    /*!
+     * Formats labels as they appear between the braces, name="value" pairs separated by commas
+     * @param labels The labels
+     * @return The formatted labels
+     */
+    std::string format_labels(const MetricLabels &labels) {
+        std::string output;
+        for (const auto &label : labels) {
+            if (!output.empty())
+                output += ',';
+            output += label.first + "=\"" + escape_label(label.second) + '"';
+        }
+        return output;
+    }
+
+    /*!
+     * Writes a sample line
+     * @param stream Where the line is written
+     * @param name Metric name
+     * @param labels Formatted labels, may be empty
+     * @param extra_label An extra formatted label, may be empty
+     * @param value The value
+     */
+    template<typename T>
+    void write_sample(std::ostream &stream, const std::string &name, const std::string &labels,
+                      const std::string &extra_label, T value) {
+        stream << name;
+        if (!labels.empty() || !extra_label.empty()) {
+            stream << '{' << labels;
+            if (!labels.empty() && !extra_label.empty())
+                stream << ',';
+            stream << extra_label << '}';
+        }
+        stream << ' ' << value << '\n';
+    }
+
+    /*!
+     * Sends a whole buffer over a socket
+     * @param socket The socket
+     * @param data The buffer
+     * @param size Size of the buffer in bytes
+     */
+    void send_all(int socket, const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = ::send(socket, data, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return;
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+}
+
+double HistogramSnapshot::quantile(double q) const {
+    if (count == 0)
+        return 0;
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(count - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            // The middle of the bucket, exact for the first sub_buckets microseconds
+            auto index = static_cast<int>(i);
+            uint64_t lower = LatencyHistogram::bucket_lower_bound(index);
+            uint64_t width = index + 1 < LatencyHistogram::bucket_count ?
+                             LatencyHistogram::bucket_lower_bound(index + 1) - lower : 1;
+            return static_cast<double>(lower) + static_cast<double>(width - 1) / 2.0;
+        }
+    }
+    return static_cast<double>(LatencyHistogram::bucket_lower_bound(LatencyHistogram::bucket_count - 1));
+}
+
+int LatencyHistogram::bucket_index(uint64_t us) {
+    if (us < sub_buckets)
+        return static_cast<int>(us);
+    int magnitude = 63 - __builtin_clzll(us) - sub_bucket_bits;
+    if (magnitude >= magnitudes)
+        return bucket_count - 1;
+    // The bits right under the leading one pick the linear bucket
+    auto sub = static_cast<int>(us >> magnitude) - sub_buckets;
+    return sub_buckets + magnitude * sub_buckets + sub;
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(int index) {
+    if (index < sub_buckets)
+        return static_cast<uint64_t>(index);
+    int magnitude = (index - sub_buckets) / sub_buckets;
+    int sub = (index - sub_buckets) % sub_buckets;
+    return static_cast<uint64_t>(sub_buckets + sub) << magnitude;
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.resize(bucket_count);
+    for (int i = 0; i < bucket_count; i++) {
+        snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sum_us = sum_us.load(std::memory_order_relaxed);
+    snapshot.exported_buckets.resize(exported_buckets.size());
+    for (size_t i = 0; i < exported_buckets.size(); i++)
+        snapshot.exported_buckets[i] = exported_buckets[i].load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+MetricsRegistry &MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Family &MetricsRegistry::family(const std::string &name, const std::string &help, Type type) {
+    auto it = families.find(name);
+    if (it == families.end()) {
+        Family &created = families[name];
+        created.help = help;
+        created.type = type;
+        return created;
+    }
+    if (it->second.type != type)
+        LOG(FATAL) << "Error: metric " << name << " is already registered with another type\n";
+    return it->second;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Counter> &metric = family(name, help, Type::Counter).counters[format_labels(labels)];
+    if (metric == nullptr)
+        metric = std::make_unique<Counter>();
+    return *metric;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Gauge> &metric = family(name, help, Type::Gauge).gauges[format_labels(labels)];
+    if (metric == nullptr)
+        metric = std::make_unique<Gauge>();
+    return *metric;
+}
+
+LatencyHistogram &MetricsRegistry::histogram(const std::string &name, const std::string &help,
+                                             const MetricLabels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<LatencyHistogram> &metric = family(name, help, Type::Histogram).histograms[format_labels(labels)];
+    if (metric == nullptr)
+        metric = std::make_unique<LatencyHistogram>();
+    return *metric;
+}
+
+std::string MetricsRegistry::prometheus_text() const {
+    std::ostringstream stream;
+    stream.precision(9);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &entry : families) {
+        const std::string &name = entry.first;
+        const Family &family = entry.second;
+        const char *type = family.type == Type::Counter ? "counter" :
+                           family.type == Type::Gauge ? "gauge" : "histogram";
+        stream << "# HELP " << name << ' ' << family.help << '\n';
+        stream << "# TYPE " << name << ' ' << type << '\n';
+        for (const auto &counter : family.counters)
+            write_sample(stream, name, counter.first, "", counter.second->get());
+        for (const auto &gauge : family.gauges)
+            write_sample(stream, name, gauge.first, "", gauge.second->get());
+        for (const auto &histogram : family.histograms) {
+            HistogramSnapshot snapshot = histogram.second->snapshot();
+            // Buckets are cumulative, the +Inf one is the count of the exported buckets so both always agree
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < LatencyHistogram::exported_bounds_us.size(); i++) {
+                cumulative += snapshot.exported_buckets[i];
+                std::ostringstream bound_label;
+                bound_label << "le=\"" << static_cast<double>(LatencyHistogram::exported_bounds_us[i]) / 1e6 << '"';
+                write_sample(stream, name + "_bucket", histogram.first, bound_label.str(), cumulative);
+            }
+            cumulative += snapshot.exported_buckets.back();
+            write_sample(stream, name + "_bucket", histogram.first, "le=\"+Inf\"", cumulative);
+            write_sample(stream, name + "_sum", histogram.first, "", static_cast<double>(snapshot.sum_us) / 1e6);
+            write_sample(stream, name + "_count", histogram.first, "", cumulative);
+        }
+    }
+    return stream.str();
+}
+
+bool MetricsRegistry::write_prometheus(const boost::filesystem::path &path) const {
+    boost::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary.string(), std::ios::trunc);
+        if (!file)
+            return false;
+        file << prometheus_text();
+        if (!file)
+            return false;
+    }
+    boost::system::error_code error;
+    boost::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+ModelMetrics::ModelMetrics(MetricsRegistry &registry, std::string model)
+        : registry(registry), model(std::move(model)),
+          invokes(registry.counter("easytflite_invocations_total", "Number of interpreter invokes",
+                                   {{"model", this->model}})),
+          invoke_failures(registry.counter("easytflite_invoke_failures_total", "Number of failed interpreter invokes",
+                                           {{"model", this->model}})) {}
+
+LatencyHistogram &ModelMetrics::stage(const char *name) {
+    for (const auto &entry : stages)
+        if (entry.first == name || std::strcmp(entry.first, name) == 0)
+            return *entry.second;
+    LatencyHistogram &histogram = registry.histogram("easytflite_stage_latency_seconds",
+                                                     "Latency of the library's stages",
+                                                     {{"model", model}, {"stage", name}});
+    stages.emplace_back(name, &histogram);
+    return histogram;
+}
+
+LatencyHistogram &ModelMetrics::entry_point(const char *name) {
+    for (const auto &entry : entry_points)
+        if (entry.first == name || std::strcmp(entry.first, name) == 0)
+            return *entry.second;
+    LatencyHistogram &histogram = registry.histogram("easytflite_inference_latency_seconds",
+                                                     "Latency of whole inference calls",
+                                                     {{"model", model}, {"entry_point", name}});
+    entry_points.emplace_back(name, &histogram);
+    return histogram;
+}
+
+MetricsExporter::MetricsExporter(const MetricsRegistry &registry, const MetricsExportOptions &export_options)
+        : registry(registry), options(export_options) {
+    if (options.port > 0) {
+        server_socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (server_socket < 0)
+            LOG(FATAL) << "Error: couldn't create the metrics server's socket\n";
+        int reuse = 1;
+        ::setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (::inet_pton(AF_INET, options.bind_address.c_str(), &address.sin_addr) != 1)
+            LOG(FATAL) << "Error: invalid metrics bind address " << options.bind_address << '\n';
+        if (::bind(server_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(server_socket, 8) != 0)
+            LOG(FATAL) << "Error: couldn't serve metrics on " << options.bind_address << ':' << options.port << '\n';
+        server_thread = std::thread(&MetricsExporter::serve, this);
+    }
+    if (!options.file.empty())
+        file_thread = std::thread(&MetricsExporter::write_file, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopped.notify_all();
+    if (file_thread.joinable())
+        file_thread.join();
+    if (server_thread.joinable())
+        server_thread.join();
+    if (server_socket >= 0)
+        ::close(server_socket);
+}
+
+void MetricsExporter::write_file() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        bool stop = stopped.wait_for(lock, options.interval, [this]() { return stopping.load(); });
+        if (!registry.write_prometheus(options.file))
+            LOG(ERROR) << "Error: couldn't write metrics to " << options.file << '\n';
+        if (stop)
+            break;
+    }
+}
+
+void MetricsExporter::serve() {
+    while (!stopping.load()) {
+        // Wake up regularly to notice stopping
+        pollfd listening{server_socket, POLLIN, 0};
+        if (::poll(&listening, 1, 200) <= 0)
+            continue;
+        int client = ::accept(server_socket, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        // Every path gets the metrics, the request only has to be read
+        char request[4096];
+        pollfd readable{client, POLLIN, 0};
+        if (::poll(&readable, 1, 1000) > 0)
+            ::recv(client, request, sizeof(request), 0);
+
+        std::string body = registry.prometheus_text();
+        std::string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                             std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        send_all(client, header.data(), header.size());
+        send_all(client, body.data(), body.size());
+        ::close(client);
+    }
+}
@@ -0,0 +1,386 @@
+#ifndef EASYTFLITE_METRICS_H
+#define EASYTFLITE_METRICS_H
+
+#include <map>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <condition_variable>
+#include <boost/filesystem.hpp>
+
+//! Label names and values of one metric, in the order they are written
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+//! A monotonically increasing count, updated with relaxed atomics
+class Counter {
+    //! The count
+    std::atomic<uint64_t> value{0};
+
+public:
+    /*!
+     * Adds to the count
+     * @param n Amount added
+     */
+    void increment(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /*!
+     * Gets the count
+     * @return The count
+     */
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+//! A value that goes up and down, updated with relaxed atomics
+class Gauge {
+    //! The value
+    std::atomic<int64_t> value{0};
+
+public:
+    /*!
+     * Sets the value
+     * @param v The new value
+     */
+    void set(int64_t v) {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    /*!
+     * Adds to the value
+     * @param n Amount added, negative to subtract
+     */
+    void add(int64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /*!
+     * Gets the value
+     * @return The value
+     */
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+//! A point in time copy of a LatencyHistogram
+struct HistogramSnapshot {
+    //! Count of every bucket
+    std::vector<uint64_t> buckets;
+    //! Number of samples
+    uint64_t count = 0;
+    //! Sum of all samples in microseconds
+    uint64_t sum_us = 0;
+    //! Count of every exported bucket, not cumulative, see LatencyHistogram::exported_bounds_us
+    std::vector<uint64_t> exported_buckets;
+
+    /*!
+     * Estimates a quantile, within the bucket resolution of the histogram
+     * @param q The quantile, between 0 and 1
+     * @return The estimate in microseconds, 0 without samples
+     */
+    double quantile(double q) const;
+};
+
+//! The LatencyHistogram class records microsecond latencies in log-linear buckets, HDR histogram style
+/*!
+ * Each power of two is split in sub_buckets linear buckets, so every sample is kept with a relative error under
+ * 1 / sub_buckets whatever its magnitude, up to about 19 hours. Samples are also counted exactly against the fixed
+ * bounds exported to Prometheus, which don't fall on the log-linear buckets' edges. Recording is a few relaxed atomic
+ * increments and never blocks, any number of threads can record while another one takes a snapshot.
+ */
+class LatencyHistogram {
+public:
+    //! Linear buckets per power of two
+    static constexpr int sub_buckets = 16;
+    //! log2 of sub_buckets
+    static constexpr int sub_bucket_bits = 4;
+    //! Powers of two covered above the first sub_buckets microseconds
+    static constexpr int magnitudes = 32;
+    //! Number of buckets
+    static constexpr int bucket_count = sub_buckets * (magnitudes + 1);
+    //! Upper bounds, inclusive, of the buckets exported to Prometheus in microseconds, a last one holds larger samples
+    static constexpr std::array<uint64_t, 16> exported_bounds_us = {100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+                                                                    50000, 100000, 250000, 500000, 1000000, 2500000,
+                                                                    5000000, 10000000};
+
+private:
+    //! Samples per bucket
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    //! Samples per exported bucket
+    std::array<std::atomic<uint64_t>, exported_bounds_us.size() + 1> exported_buckets{};
+    //! Sum of all samples in microseconds
+    std::atomic<uint64_t> sum_us{0};
+
+public:
+    /*!
+     * Gets the bucket a sample falls in
+     * @param us The sample in microseconds
+     * @return The bucket index
+     */
+    static int bucket_index(uint64_t us);
+
+    /*!
+     * Gets the smallest sample of a bucket
+     * @param index The bucket index
+     * @return The bucket's lower bound in microseconds
+     */
+    static uint64_t bucket_lower_bound(int index);
+
+    /*!
+     * Records a sample
+     * @param us The sample in microseconds
+     */
+    void record(uint64_t us) {
+        buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+        auto bound = std::lower_bound(exported_bounds_us.begin(), exported_bounds_us.end(), us);
+        exported_buckets[bound - exported_bounds_us.begin()].fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    /*!
+     * Copies the histogram, samples recorded during the copy may or may not be included
+     * @return The copy
+     */
+    HistogramSnapshot snapshot() const;
+};
+
+//! The MetricsRegistry class owns named metrics and formats them in the Prometheus text exposition format
+/*!
+ * Metrics are created, or found if they already exist, by name and labels. Registering takes a lock, so callers keep
+ * the returned reference and only update it on the hot path. Metrics live as long as the registry. Histograms are
+ * exposed as Prometheus histograms in seconds, cumulative _bucket series over LatencyHistogram::exported_bounds_us plus
+ * _sum and _count, so quantiles over any window are computed server side with histogram_quantile.
+ */
+class MetricsRegistry {
+    //! The kinds of metric
+    enum class Type {
+        Counter, Gauge, Histogram
+    };
+
+    //! Every metric sharing a name
+    struct Family {
+        //! Help text
+        std::string help;
+        //! What kind of metric the family holds
+        Type type;
+        //! Counters by formatted labels
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        //! Gauges by formatted labels
+        std::map<std::string, std::unique_ptr<Gauge>> gauges;
+        //! Histograms by formatted labels
+        std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+    };
+
+    //! Guards families
+    mutable std::mutex mutex;
+    //! Families by metric name
+    std::map<std::string, Family> families;
+
+    /*!
+     * Finds or creates a family, checking its type
+     * @param name Metric name
+     * @param help Help text, only used when the family is created
+     * @param type The kind of metric
+     * @return The family
+     */
+    Family &family(const std::string &name, const std::string &help, Type type);
+
+public:
+    /*!
+     * Gets the process wide registry
+     * @return The registry
+     */
+    static MetricsRegistry &global();
+
+    /*!
+     * Finds or creates a counter
+     * @param name Metric name, should end in _total
+     * @param help Help text
+     * @param labels The counter's labels
+     * @return The counter, valid as long as the registry
+     */
+    Counter &counter(const std::string &name, const std::string &help, const MetricLabels &labels = MetricLabels());
+
+    /*!
+     * Finds or creates a gauge
+     * @param name Metric name
+     * @param help Help text
+     * @param labels The gauge's labels
+     * @return The gauge, valid as long as the registry
+     */
+    Gauge &gauge(const std::string &name, const std::string &help, const MetricLabels &labels = MetricLabels());
+
+    /*!
+     * Finds or creates a latency histogram
+     * @param name Metric name, should end in _seconds
+     * @param help Help text
+     * @param labels The histogram's labels
+     * @return The histogram, valid as long as the registry
+     */
+    LatencyHistogram &histogram(const std::string &name, const std::string &help,
+                                const MetricLabels &labels = MetricLabels());
+
+    /*!
+     * Formats every metric in the Prometheus text exposition format
+     * @return The text
+     */
+    std::string prometheus_text() const;
+
+    /*!
+     * Writes prometheus_text to a file, through a temporary file renamed over it so readers never see half of it
+     * @param path Where the metrics are written
+     * @return Whether the file was written
+     */
+    bool write_prometheus(const boost::filesystem::path &path) const;
+};
+
+//! The metrics of one model, labeled with the model's name
+/*!
+ * Stage and entry point histograms are looked up by name the first time they are used and kept, so recording doesn't
+ * allocate afterwards. Like the TFLite object it belongs to, it must only be used by one thread at a time.
+ */
+class ModelMetrics {
+    //! The registry the metrics live in
+    MetricsRegistry &registry;
+    //! The model label
+    std::string model;
+    //! Stage histograms by stage name
+    std::vector<std::pair<const char *, LatencyHistogram *>> stages;
+    //! Entry point histograms by entry point name
+    std::vector<std::pair<const char *, LatencyHistogram *>> entry_points;
+
+public:
+    //! Number of invokes
+    Counter &invokes;
+    //! Number of invokes that failed
+    Counter &invoke_failures;
+
+    /*!
+     * Registers the model's counters
+     * @param registry The registry the metrics live in
+     * @param model The model label
+     */
+    ModelMetrics(MetricsRegistry &registry, std::string model);
+
+    /*!
+     * Gets the histogram of a stage (preprocess, resize, convert, fill, invoke, output_copy)
+     * @param name Stage name
+     * @return The histogram
+     */
+    LatencyHistogram &stage(const char *name);
+
+    /*!
+     * Gets the histogram of an inference entry point, the whole call from image to outputs
+     * @param name Entry point name
+     * @return The histogram
+     */
+    LatencyHistogram &entry_point(const char *name);
+};
+
+//! Times a scope as an inference entry point, does nothing when the metrics are null
+class ScopedInference {
+    //! The histogram, null when metrics are disabled
+    LatencyHistogram *histogram = nullptr;
+    //! When the scope was entered
+    std::chrono::steady_clock::time_point begin;
+
+public:
+    /*!
+     * Starts timing the call
+     * @param metrics The model's metrics, null when metrics are disabled
+     * @param name Entry point name, must be a string literal or otherwise outlive the metrics
+     */
+    ScopedInference(ModelMetrics *metrics, const char *name) {
+        if (metrics != nullptr) {
+            histogram = &metrics->entry_point(name);
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedInference() {
+        if (histogram != nullptr)
+            histogram->record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+    }
+
+    ScopedInference(const ScopedInference &) = delete;
+
+    ScopedInference &operator=(const ScopedInference &) = delete;
+};
+
+//! Options for MetricsExporter
+struct MetricsExportOptions {
+    //! File the metrics are written to, for the node exporter's textfile collector for instance, empty to disable
+    boost::filesystem::path file;
+    //! How often the file is written
+    std::chrono::milliseconds interval = std::chrono::milliseconds(10000);
+    //! Port the metrics are served on over HTTP, 0 to disable
+    int port = 0;
+    //! Address the HTTP server binds to
+    std::string bind_address = "127.0.0.1";
+};
+
+//! The MetricsExporter class publishes a registry's metrics from background threads
+/*!
+ * The metrics are written to a file every interval, served over plain HTTP to any path on the port, or both. The
+ * threads stop when the exporter is destroyed, the file is written one last time.
+ */
+class MetricsExporter {
+    //! The registry exported
+    const MetricsRegistry &registry;
+    //! The export options
+    MetricsExportOptions options;
+    //! Guards stopping for the file thread's wait
+    std::mutex mutex;
+    //! Wakes the file thread when stopping
+    std::condition_variable stopped;
+    //! Set to stop the threads
+    std::atomic<bool> stopping{false};
+    //! The listening socket, -1 without a server
+    int server_socket = -1;
+    //! Writes the file
+    std::thread file_thread;
+    //! Serves HTTP
+    std::thread server_thread;
+
+    /*!
+     * The file thread's loop
+     */
+    void write_file();
+
+    /*!
+     * The server thread's loop
+     */
+    void serve();
+
+public:
+    /*!
+     * Starts exporting
+     * @param registry The registry exported, must outlive the exporter
+     * @param export_options Where and how often the metrics are exported
+     */
+    MetricsExporter(const MetricsRegistry &registry, const MetricsExportOptions &export_options);
+
+    /*!
+     * Stops the threads
+     */
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter &) = delete;
+
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+};
+
+
+#endif //EASYTFLITE_METRICS_H
@@ -0,0 +1,230 @@
+#include "ModelCache.h"
+
+#include <vector>
+#include <fstream>
+#include <exception>
+#include <glog/logging.h>
+#include <boost/filesystem.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define EASYTFLITE_HAS_MMAP 1
+#endif
+
+namespace {
+    //! A model and the memory its FlatBuffer lives in, the model is declared last so it is destroyed first
+    struct MappedModel {
+        //! Start of the mapping, nullptr when the file was read into buffer
+        void *mapping = nullptr;
+        //! Size of the mapping
+        size_t mapping_size = 0;
+        //! The file's contents when it isn't mapped
+        std::vector<char> buffer;
+        //! The model built over the mapping or buffer
+        std::unique_ptr<tflite::FlatBufferModel> model;
+
+        MappedModel() = default;
+
+        MappedModel(const MappedModel &) = delete;
+
+        MappedModel &operator=(const MappedModel &) = delete;
+
+        ~MappedModel() {
+            model.reset();
+#ifdef EASYTFLITE_HAS_MMAP
+            if (mapping != nullptr)
+                munmap(mapping, mapping_size);
+#endif
+        }
+    };
+
+    /*!
+     * Maps a file read-only into memory
+     * @param model_path Path to the file
+     * @param options The mapping options
+     * @param mapped Receives the mapping
+     * @return Whether the file was mapped
+     */
+    bool map_file(const boost::filesystem::path &model_path, const ModelLoadOptions &options, MappedModel &mapped) {
+#ifdef EASYTFLITE_HAS_MMAP
+        int fd = open(model_path.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (options.populate)
+            flags |= MAP_POPULATE;
+#endif
+        size_t size = static_cast<size_t>(file_stat.st_size);
+        void *mapping = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+
+#ifdef MADV_HUGEPAGE
+        if (options.hugepages)
+            madvise(mapping, size, MADV_HUGEPAGE);
+#endif
+#ifndef MAP_POPULATE
+        if (options.populate)
+            madvise(mapping, size, MADV_WILLNEED);
+#endif
+        mapped.mapping = mapping;
+        mapped.mapping_size = size;
+        return true;
+#else
+        return false;
+#endif
+    }
+}
+
+namespace {
+    /*!
+     * Loads a model file, memory mapped or read into the heap as the options say
+     * @param model_path Path to the file
+     * @param options How the file is mapped
+     * @param verify Whether the FlatBuffer is verified before the model is built over it
+     * @param fatal Whether a failure stops the process, or is logged as an error and returns null
+     * @return The model, it owns its mapping
+     */
+    std::shared_ptr<const tflite::FlatBufferModel> load_mapped(const boost::filesystem::path &model_path,
+                                                               const ModelLoadOptions &options, bool verify,
+                                                               bool fatal) {
+        auto mapped = std::make_shared<MappedModel>();
+        const char *data;
+        size_t size;
+        if (options.use_mmap && map_file(model_path, options, *mapped)) {
+            data = static_cast<const char *>(mapped->mapping);
+            size = mapped->mapping_size;
+        } else {
+            // Fall back to reading the file into the heap
+            std::ifstream file(model_path.string(), std::ios::binary);
+            if (!file.is_open()) {
+                if (fatal)
+                    LOG(FATAL) << "Error: Couldn't open model - " << model_path << '\n';
+                LOG(ERROR) << "Error: Couldn't open model - " << model_path << '\n';
+                return nullptr;
+            }
+            mapped->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data = mapped->buffer.data();
+            size = mapped->buffer.size();
+        }
+
+        if (verify)
+            mapped->model = tflite::FlatBufferModel::VerifyAndBuildFromBuffer(data, size, nullptr,
+                                                                              tflite::DefaultErrorReporter());
+        else
+            mapped->model = tflite::FlatBufferModel::BuildFromBuffer(data, size, tflite::DefaultErrorReporter());
+        if (mapped->model == nullptr) {
+            if (fatal)
+                LOG(FATAL) << "Error: Couldn't Build FlatBufferModel from " << model_path << '\n';
+            LOG(ERROR) << "Error: Couldn't Build FlatBufferModel from " << model_path << '\n';
+            return nullptr;
+        }
+
+        // The returned pointer keeps the mapping alive for as long as the model is used
+        return std::shared_ptr<const tflite::FlatBufferModel>(mapped, mapped->model.get());
+    }
+}
+
+namespace {
+    /*!
+     * Identifies the version of a file on disk, so a replaced file gets a new cache entry
+     * @param model_path Canonical path to the file
+     * @return Inode, size and modification time in nanoseconds where available, else the modification time in seconds
+     */
+    std::string file_version(const boost::filesystem::path &model_path) {
+#ifdef EASYTFLITE_HAS_MMAP
+        struct stat file_stat{};
+        if (stat(model_path.string().c_str(), &file_stat) == 0) {
+#ifdef __APPLE__
+            const struct timespec &modified = file_stat.st_mtimespec;
+#else
+            const struct timespec &modified = file_stat.st_mtim;
+#endif
+            return std::to_string(file_stat.st_ino) + ':' + std::to_string(file_stat.st_size) + ':' +
+                   std::to_string(modified.tv_sec) + '.' + std::to_string(modified.tv_nsec);
+        }
+#endif
+        return std::to_string(boost::filesystem::last_write_time(model_path));
+    }
+}
+
+std::shared_ptr<const tflite::FlatBufferModel> load_model_file(const boost::filesystem::path &model_path,
+                                                               const ModelLoadOptions &options) {
+    return load_mapped(model_path, options, false, true);
+}
+
+std::shared_ptr<const tflite::FlatBufferModel> try_load_model_file(const boost::filesystem::path &model_path,
+                                                                   const ModelLoadOptions &options) {
+    return load_mapped(model_path, options, true, false);
+}
+
+ModelCache &ModelCache::instance() {
+    static ModelCache cache;
+    return cache;
+}
+
+std::shared_ptr<const tflite::FlatBufferModel> ModelCache::get(const boost::filesystem::path &model_path,
+                                                               const ModelLoadOptions &options) {
+    boost::filesystem::path canonical_path = boost::filesystem::canonical(model_path);
+    std::string key = canonical_path.string() + '@' + file_version(canonical_path);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    Entry &entry = entries[key];
+    std::shared_ptr<const tflite::FlatBufferModel> model = entry.model.lock();
+    if (model != nullptr)
+        return model;
+    if (entry.loading.valid()) {
+        // Another thread is loading the file, wait for it without holding the lock
+        auto loading = entry.loading;
+        lock.unlock();
+        return loading.get();
+    }
+
+    std::promise<std::shared_ptr<const tflite::FlatBufferModel>> loaded;
+    entry.loading = loaded.get_future().share();
+    lock.unlock();
+    try {
+        LOG(INFO) << "Mapping model " << canonical_path << '\n';
+        model = load_model_file(canonical_path, options);
+    } catch (...) {
+        lock.lock();
+        entries.erase(key);
+        lock.unlock();
+        loaded.set_exception(std::current_exception());
+        throw;
+    }
+
+    lock.lock();
+    entry.model = model;
+    entry.loading = decltype(entry.loading)();
+    // Forget models nobody uses anymore, loads in progress are kept
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.model.expired() && !it->second.loading.valid())
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+    lock.unlock();
+    loaded.set_value(model);
+    return model;
+}
+
+size_t ModelCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t live = 0;
+    for (const auto &entry : entries)
+        live += entry.second.model.expired() ? 0 : 1;
+    return live;
+}
@@ -0,0 +1,94 @@
+#ifndef EASYTFLITE_MODELCACHE_H
+#define EASYTFLITE_MODELCACHE_H
+
+#include <map>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <string>
+#include <boost/filesystem/path.hpp>
+#include <tensorflow/lite/model.h>
+
+//! How ModelCache maps a model file into memory
+struct ModelLoadOptions {
+    //! Memory map the file read-only instead of reading it into the heap
+    bool use_mmap = true;
+    //! Fault every page of the mapping in up front (MAP_POPULATE), so the first invokes don't page fault
+    bool populate = false;
+    //! Ask for transparent huge pages on the mapping (MADV_HUGEPAGE), where the kernel supports it
+    bool hugepages = false;
+};
+
+//! The ModelCache class shares one read-only mapping of a model file between everything that loads it
+/*!
+ * Models are keyed by canonical path, inode, size and modification time, so every TFLite, EasyTFLite or
+ * SSD_EasyTFLite instance built from the same file uses the same FlatBufferModel and the same mapping, and a file that
+ * is replaced on disk is loaded again. The cache only holds weak references: a model is unmapped once the last instance
+ * using it is gone.
+ * The options of the first load of a file apply to every instance sharing it. Files are loaded outside the cache's
+ * lock, so a large model doesn't hold up the others, and concurrent gets of the same file wait for a single load.
+ */
+class ModelCache {
+    //! A cached model, or the load other threads wait for
+    struct Entry {
+        //! The model once loaded
+        std::weak_ptr<const tflite::FlatBufferModel> model;
+        //! Set while the model is being loaded
+        std::shared_future<std::shared_ptr<const tflite::FlatBufferModel>> loading;
+    };
+
+    //! Guards entries
+    std::mutex mutex;
+    //! Models by canonical path and file version
+    std::map<std::string, Entry> entries;
+
+    ModelCache() = default;
+
+public:
+    /*!
+     * Gets the process wide cache
+     * @return The cache
+     */
+    static ModelCache &instance();
+
+    ModelCache(const ModelCache &) = delete;
+
+    ModelCache &operator=(const ModelCache &) = delete;
+
+    /*!
+     * Gets the model at model_path, loading and mapping it if no live instance uses it yet
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param options How the file is mapped when it has to be loaded
+     * @return The shared model
+     */
+    std::shared_ptr<const tflite::FlatBufferModel> get(const boost::filesystem::path &model_path,
+                                                       const ModelLoadOptions &options = ModelLoadOptions());
+
+    /*!
+     * Gets the number of models currently alive in the cache
+     * @return The number of live models
+     */
+    size_t size();
+};
+
+/*!
+ * Loads a model file without the cache, memory mapped or read into the heap as the options say
+ * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+ * @param options How the file is mapped
+ * @return The model, it owns its mapping
+ */
+std::shared_ptr<const tflite::FlatBufferModel> load_model_file(const boost::filesystem::path &model_path,
+                                                               const ModelLoadOptions &options);
+
+/*!
+ * Loads a model file without the cache like load_model_file, but verifies the FlatBuffer first and doesn't stop the
+ * process on a missing, truncated or corrupt file, for files that are replaced while the process runs
+ * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+ * @param options How the file is mapped
+ * @return The model, it owns its mapping, null if the file couldn't be loaded
+ */
+std::shared_ptr<const tflite::FlatBufferModel> try_load_model_file(const boost::filesystem::path &model_path,
+                                                                   const ModelLoadOptions &options);
+
+
+#endif //EASYTFLITE_MODELCACHE_H
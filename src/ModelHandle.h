@@ -0,0 +1,334 @@
+#ifndef EASYTFLITE_MODELHANDLE_H
+#define EASYTFLITE_MODELHANDLE_H
+
+#include "TFLite.h"
+#include "ModelCache.h"
+#include "InterpreterPool.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+#include <glog/logging.h>
+
+//! Options for ModelHandle
+struct ModelHandleOptions {
+    //! How model files are mapped
+    ModelLoadOptions load;
+    //! Execution config of every model built, for models constructible with one or InterpreterPool models
+    ExecutionConfig config;
+    //! Options of InterpreterPool models, their config is replaced by config
+    InterpreterPoolOptions pool;
+    //! Invokes on synthetic inputs run on every model before it is published, unless config.warmup_invokes is set.
+    //! Models built with a config warm up in their constructor, others need warmup(int).
+    int warmup_invokes = 3;
+    //! Longest a background reload waits for in-flight calls to release the previous model before leaving it to them
+    std::chrono::milliseconds retire_timeout = std::chrono::milliseconds(10000);
+};
+
+//! The ModelHandle class publishes a model that can be replaced while it is being used
+/*!
+ * Callers pin the current model with get() for the length of one call. A reload builds and warms the new model off
+ * the hot path, then publishes it with an atomic shared pointer swap, RCU style: calls already running finish on the
+ * model they pinned and every later get() returns the new one, nothing waits and no call is dropped. The previous model
+ * is destroyed once its last call releases it. Background reloads run one at a time on the handle's reload thread,
+ * which is woken when the previous model's last call releases it and destroys it there, so the destruction doesn't
+ * land on an inference thread either.
+ *
+ * Every reload reads the file again, and a missing, truncated or corrupt file leaves the current model published.
+ * Replace a model file by writing the new one next to it and renaming it over the path: the published model may be
+ * memory mapped from the old file, and a file overwritten in place changes it under the calls using it.
+ *
+ * The handle makes the swap safe, not the model: callers that share a handle from several threads need a model that is
+ * safe to use from several threads, an InterpreterPool for instance, or one handle per thread.
+ * @tparam Model TFLite, a class deriving from it or an InterpreterPool, anything constructible from a
+ * std::shared_ptr<const tflite::FlatBufferModel>, unless a factory is given
+ */
+template<typename Model>
+class ModelHandle {
+public:
+    //! Builds a model from a loaded flatbuffer
+    using Factory = std::function<std::shared_ptr<Model>(std::shared_ptr<const tflite::FlatBufferModel>)>;
+
+private:
+    //! Hands a published model over to whoever retires it once its last pin is released
+    struct Retirement {
+        //! Guards the other members
+        std::mutex mutex;
+        //! Signaled when the last pin is released
+        std::condition_variable released_signal;
+        //! The model, owned here while it is published or pinned
+        std::shared_ptr<Model> model;
+        //! Whether the reload thread waits for the last pin
+        bool waiting = false;
+        //! Whether the last pin was released
+        bool released = false;
+    };
+
+    //! Deleter of published pointers, runs when the last pin of a model is released
+    struct Release {
+        //! The model's retirement
+        std::shared_ptr<Retirement> retirement;
+
+        void operator()(Model *) const {
+            std::shared_ptr<Model> model;
+            {
+                std::lock_guard<std::mutex> lock(retirement->mutex);
+                retirement->released = true;
+                // Nobody waits, so the model is destroyed by the call releasing it
+                if (!retirement->waiting)
+                    model = std::move(retirement->model);
+            }
+            retirement->released_signal.notify_one();
+        }
+    };
+
+    //! A background reload and the promise its result is delivered to
+    struct ReloadRequest {
+        //! The model file
+        boost::filesystem::path model_path;
+        //! Set to whether a new model was published, once the previous one is retired
+        std::promise<bool> published;
+    };
+
+    //! The handle options
+    ModelHandleOptions options;
+    //! Builds the models
+    Factory factory;
+    //! The published model, only accessed through the std::atomic_ shared pointer functions once constructed
+    std::shared_ptr<Model> current;
+    //! Number of reloads published
+    std::atomic<uint64_t> generation{0};
+    //! Serializes reloads
+    std::mutex reload_mutex;
+    //! Guards requests, stopping and reloader
+    std::mutex requests_mutex;
+    //! Wakes the reload thread
+    std::condition_variable requests_signal;
+    //! Background reloads not started yet, oldest first
+    std::deque<ReloadRequest> requests;
+    //! Set to stop the reload thread
+    bool stopping = false;
+    //! Runs background reloads, started by the first one
+    std::thread reloader;
+
+    //! Whether T has warmup(int)
+    template<typename T, typename = void>
+    struct has_warmup : std::false_type {};
+
+    template<typename T>
+    struct has_warmup<T, std::void_t<decltype(std::declval<T &>().warmup(0))>> : std::true_type {};
+
+    /*!
+     * The factory used when none is given, constructs the model with the execution config, or the pool options for
+     * an InterpreterPool, so it warms up in its constructor. Other models are warmed up here if they can be.
+     * @param shared_model The loaded flatbuffer
+     * @return The model
+     */
+    std::shared_ptr<Model> default_build(std::shared_ptr<const tflite::FlatBufferModel> shared_model) const {
+        ExecutionConfig config = options.config;
+        if (config.warmup_invokes == 0)
+            config.warmup_invokes = options.warmup_invokes;
+        if constexpr (std::is_constructible<Model, std::shared_ptr<const tflite::FlatBufferModel>,
+                                            const ExecutionConfig &>::value) {
+            return std::make_shared<Model>(std::move(shared_model), config);
+        } else if constexpr (std::is_constructible<Model, std::shared_ptr<const tflite::FlatBufferModel>,
+                                                   const InterpreterPoolOptions &>::value) {
+            InterpreterPoolOptions pool_options = options.pool;
+            pool_options.config = config;
+            return std::make_shared<Model>(std::move(shared_model), pool_options);
+        } else {
+            auto model = std::make_shared<Model>(std::move(shared_model));
+            if constexpr (has_warmup<Model>::value) {
+                if (config.warmup_invokes > 0)
+                    model->warmup(config.warmup_invokes);
+            }
+            return model;
+        }
+    }
+
+    /*!
+     * Loads and builds a model, nothing is published. The file is loaded again even when it is the current model's,
+     * bypassing the ModelCache.
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @return The model, null if the file doesn't exist or isn't a valid model
+     */
+    std::shared_ptr<Model> build(const boost::filesystem::path &model_path) const {
+        // A missing or corrupt file keeps the current model instead of stopping the process
+        if (!boost::filesystem::exists(model_path)) {
+            LOG(ERROR) << "Error: Couldn't find model - " << model_path << ", keeping the current one\n";
+            return nullptr;
+        }
+        auto shared_model = try_load_model_file(model_path, options.load);
+        if (shared_model == nullptr) {
+            LOG(ERROR) << "Error: Couldn't load model - " << model_path << ", keeping the current one\n";
+            return nullptr;
+        }
+        return factory ? factory(std::move(shared_model)) : default_build(std::move(shared_model));
+    }
+
+    /*!
+     * Waits for the in-flight calls to release a model so it is destroyed on this thread, up to retire_timeout
+     * @param previous The model, this must be the handle's last reference to it
+     */
+    void retire(std::shared_ptr<Model> previous) const {
+        std::shared_ptr<Retirement> retirement = std::get_deleter<Release>(previous)->retirement;
+        std::shared_ptr<Model> model;
+        {
+            std::unique_lock<std::mutex> lock(retirement->mutex);
+            retirement->waiting = true;
+            // Unpublished, so nobody can pin it again and the release is final
+            lock.unlock();
+            previous.reset();
+            lock.lock();
+            if (retirement->released_signal.wait_for(lock, options.retire_timeout,
+                                                     [&retirement]() { return retirement->released; }))
+                model = std::move(retirement->model);
+            else
+                retirement->waiting = false;
+        }
+    }
+
+    /*!
+     * The reload thread's loop, runs background reloads in the order they were asked for
+     */
+    void run_reloads() {
+        std::unique_lock<std::mutex> lock(requests_mutex);
+        while (true) {
+            requests_signal.wait(lock, [this]() { return stopping || !requests.empty(); });
+            if (requests.empty())
+                return;
+            ReloadRequest request = std::move(requests.front());
+            requests.pop_front();
+
+            // Requests keep coming in while this one loads
+            lock.unlock();
+            std::shared_ptr<Model> previous;
+            {
+                std::lock_guard<std::mutex> reload_lock(reload_mutex);
+                std::shared_ptr<Model> model = build(request.model_path);
+                if (model != nullptr)
+                    previous = publish(std::move(model));
+            }
+            bool success = previous != nullptr;
+            if (success)
+                retire(std::move(previous));
+            request.published.set_value(success);
+            lock.lock();
+        }
+    }
+
+public:
+    /*!
+     * Loads, builds and publishes the first model
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param handle_options The handle options
+     * @param model_factory Builds the models, empty to construct Model from the flatbuffer
+     */
+    explicit ModelHandle(const boost::filesystem::path &model_path,
+                         const ModelHandleOptions &handle_options = ModelHandleOptions(),
+                         Factory model_factory = Factory())
+            : options(handle_options), factory(std::move(model_factory)) {
+        std::shared_ptr<Model> model = build(model_path);
+        if (model == nullptr)
+            LOG(FATAL) << "Error: Couldn't load the initial model\n";
+        publish(std::move(model));
+        generation = 0;
+    }
+
+    /*!
+     * Finishes the background reloads already asked for and stops the reload thread
+     */
+    ~ModelHandle() {
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            stopping = true;
+        }
+        requests_signal.notify_one();
+        if (reloader.joinable())
+            reloader.join();
+    }
+
+    ModelHandle(const ModelHandle &) = delete;
+
+    ModelHandle &operator=(const ModelHandle &) = delete;
+
+    /*!
+     * Pins the current model, it stays alive as long as the returned pointer does. Pin it for one call and get it
+     * again for the next, so reloads take effect. Never blocks.
+     * @return The current model
+     */
+    std::shared_ptr<Model> get() const {
+        return std::atomic_load(&current);
+    }
+
+    /*!
+     * Publishes an already built model, calls in flight keep the previous one
+     * @param model The new model
+     * @return A pin of the previous model, null for the first one
+     */
+    std::shared_ptr<Model> publish(std::shared_ptr<Model> model) {
+        // Published pointers share the model, their deleter tells the retirement when the last pin is gone
+        auto retirement = std::make_shared<Retirement>();
+        Model *raw = model.get();
+        retirement->model = std::move(model);
+        std::shared_ptr<Model> published(raw, Release{std::move(retirement)});
+        std::shared_ptr<Model> previous = std::atomic_exchange(&current, std::move(published));
+        generation.fetch_add(1);
+        return previous;
+    }
+
+    /*!
+     * Loads, builds and warms a model on the calling thread, then publishes it. The previous model is destroyed by
+     * whichever call releases it last.
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model, it may be
+     * the current model's path after the file was replaced
+     * @return Whether a new model was published
+     */
+    bool reload(const boost::filesystem::path &model_path) {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        std::shared_ptr<Model> model = build(model_path);
+        if (model == nullptr)
+            return false;
+        publish(std::move(model));
+        return true;
+    }
+
+    /*!
+     * Queues a reload on the handle's reload thread, which loads, builds, warms and publishes the model, then waits for
+     * the previous model's in-flight calls and destroys it. Never blocks: calls to get() and the caller carry on
+     * meanwhile, and reloads asked for while one runs are queued behind it.
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @return A future set to whether a new model was published, once the previous one is retired
+     */
+    std::future<bool> reload_async(const boost::filesystem::path &model_path) {
+        ReloadRequest request{model_path, std::promise<bool>()};
+        std::future<bool> result = request.published.get_future();
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            requests.push_back(std::move(request));
+            if (!reloader.joinable())
+                reloader = std::thread(&ModelHandle::run_reloads, this);
+        }
+        requests_signal.notify_one();
+        return result;
+    }
+
+    /*!
+     * Gets the number of models published after the first one
+     * @return The number of reloads
+     */
+    uint64_t reloads() const {
+        return generation.load();
+    }
+};
+
+
+#endif //EASYTFLITE_MODELHANDLE_H
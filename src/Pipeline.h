@@ -0,0 +1,438 @@
+#ifndef EASYTFLITE_PIPELINE_H
+#define EASYTFLITE_PIPELINE_H
+
+#include "SPSCQueue.h"
+#include "Metrics.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+//! What a pipeline stage does when frames arrive faster than it processes them
+enum class OverflowPolicy {
+    //! Frames wait in the queues and upstream stages block when a queue is full, nothing is lost
+    Block,
+    //! The source never waits, it replaces a frame the first stage hasn't taken yet, and every stage skips to the
+    //! newest waiting frame. Skipped frames are recycled. For live sources.
+    DropOldest
+};
+
+//! Options for Pipeline
+struct PipelineOptions {
+    //! Most frames waiting between two stages
+    size_t queue_capacity = 2;
+    //! What stages do when frames arrive faster than they are processed
+    OverflowPolicy overflow = OverflowPolicy::Block;
+    //! Registry the queue depths and frame counts are exported to, null to disable
+    MetricsRegistry *metrics = nullptr;
+    //! Value of the pipeline label of the metrics
+    std::string name = "pipeline";
+};
+
+//! The Pipeline class runs a source, a chain of stages and a sink each on its own thread
+/*!
+ * Frames flow from the source through every stage to the sink over bounded lock-free single producer single consumer
+ * queues, so throughput is limited by the slowest stage instead of the sum of all of them. A thread waiting on a queue
+ * spins briefly, then parks until the other end pushes or pops, so stages idle on a slow source don't burn cores.
+ * Items are allocated once and recycled after the sink, so buffers held by an Item (a cv::Mat for instance) are reused
+ * from frame to frame.
+ * Frames are delivered to the sink in the order the source produced them. With OverflowPolicy::DropOldest the source
+ * never blocks: it hands frames to the first stage through a single frame mailbox, replacing a frame the stage hasn't
+ * taken yet, and every later stage skips frames that piled up at its input. Stages still wait while the queue to the
+ * next one is full, for as long as that stage takes to finish its frame. The sink receives every frame that made it
+ * through the stages.
+ * @tparam Item The per frame state, default constructible. It is passed by reference to every function.
+ */
+template<typename Item>
+class Pipeline {
+public:
+    //! Fills the next frame, returns false at the end of the stream
+    using Source = std::function<bool(Item &)>;
+    //! Processes a frame
+    using Stage = std::function<void(Item &)>;
+    //! Consumes a processed frame, along with its sequence number from the source
+    using Sink = std::function<void(Item &, uint64_t)>;
+
+private:
+    //! A recycled item and its sequence number
+    struct Slot {
+        //! The frame's state
+        Item item;
+        //! Position of the frame in the source's stream
+        uint64_t sequence = 0;
+    };
+
+    //! A queue between two threads and what its idle end parks on
+    struct Link {
+        //! The frames in flight, nullptr marks the end of the stream
+        SPSCQueue<Slot *> queue;
+        //! Whether frames go through latest instead of queue, so the producer never waits
+        bool mailbox = false;
+        //! The newest frame of a mailbox, nullptr when it is empty
+        std::atomic<Slot *> latest{nullptr};
+        //! Set once a mailbox's producer has handed over its last frame
+        std::atomic<bool> ended{false};
+        //! Guards the parking
+        std::mutex mutex;
+        //! Signaled when a parked thread may be able to push or pop
+        std::condition_variable changed;
+        //! Number of threads parked on changed
+        std::atomic<int> parked{0};
+
+        explicit Link(size_t capacity) : queue(capacity) {}
+    };
+
+    //! Produces frames
+    Source source;
+    //! The stages, in order
+    std::vector<Stage> stages;
+    //! Consumes frames
+    Sink sink;
+    //! The pipeline options
+    PipelineOptions options;
+    //! Every slot the pipeline owns
+    std::vector<std::unique_ptr<Slot>> slots;
+    //! links[i] connects thread i to thread i + 1, the source is thread 0 and the sink the last thread
+    std::vector<std::unique_ptr<Link>> links;
+    //! Guards free_slots
+    std::mutex free_mutex;
+    //! Signaled when a slot is recycled
+    std::condition_variable slot_recycled;
+    //! Slots ready to be filled by the source
+    std::vector<Slot *> free_slots;
+    //! One thread per source, stage and sink
+    std::vector<std::thread> threads;
+    //! Set to end the stream early
+    std::atomic<bool> stopping{false};
+    //! Frames the sink consumed
+    std::atomic<uint64_t> delivered{0};
+    //! Frames skipped by DropOldest
+    std::atomic<uint64_t> dropped{0};
+    //! Depth of every queue, empty when metrics are disabled
+    std::vector<Gauge *> queue_depths;
+    //! Frames the sink consumed, null when metrics are disabled
+    Counter *delivered_counter = nullptr;
+    //! Frames skipped by DropOldest, null when metrics are disabled
+    Counter *dropped_counter = nullptr;
+
+    //! Failed attempts spent spinning and yielding before a thread parks
+    static constexpr int spin_attempts = 128;
+
+    /*!
+     * Retries an operation on a link until it succeeds, spinning first, then yielding, then parked on the link until
+     * the other end wakes it, so idle threads don't burn a core
+     * @param link The link
+     * @param attempt Tries the operation once, returns whether it succeeded
+     */
+    template<typename Attempt>
+    static void retry(Link &link, Attempt attempt) {
+        for (int i = 0; i < spin_attempts; i++) {
+            if (attempt())
+                return;
+            if (i >= spin_attempts / 2)
+                std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(link.mutex);
+        link.parked.fetch_add(1);
+        // Pairs with the fence in wake, either this attempt sees the other end's change or wake sees the parked thread
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        link.changed.wait(lock, attempt);
+        link.parked.fetch_sub(1);
+    }
+
+    /*!
+     * Wakes the threads parked on a link after a push or a pop, a fence and a load when none are
+     * @param link The link
+     */
+    static void wake(Link &link) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (link.parked.load(std::memory_order_relaxed) > 0) {
+            // Taking the lock makes sure a thread that saw nothing has started waiting before it is notified
+            {
+                std::lock_guard<std::mutex> lock(link.mutex);
+            }
+            link.changed.notify_all();
+        }
+    }
+
+    /*!
+     * Gets the number of frames waiting on a link
+     * @param link The link
+     * @return The number of frames
+     */
+    static size_t depth(const Link &link) {
+        if (link.mailbox)
+            return link.latest.load() != nullptr ? 1 : 0;
+        return link.queue.size();
+    }
+
+    /*!
+     * Pushes a slot, waiting while the queue is full
+     * @param link The link
+     * @param slot The slot, nullptr marks the end of the stream
+     */
+    static void push(Link &link, Slot *slot) {
+        retry(link, [&link, &slot]() { return link.queue.try_push(slot); });
+        wake(link);
+    }
+
+    /*!
+     * Pops a slot, waiting while the queue or mailbox is empty
+     * @param link The link
+     * @return The slot, nullptr marks the end of the stream
+     */
+    static Slot *pop(Link &link) {
+        Slot *slot;
+        if (link.mailbox) {
+            // The producer only ends the mailbox once it is empty, so an empty ended mailbox has nothing left
+            retry(link, [&link, &slot]() {
+                slot = link.latest.exchange(nullptr);
+                return slot != nullptr || link.ended.load();
+            });
+        } else {
+            retry(link, [&link, &slot]() { return link.queue.try_pop(slot); });
+        }
+        wake(link);
+        return slot;
+    }
+
+    /*!
+     * Puts a slot in a mailbox without waiting, the frame it replaces is dropped
+     * @param link The link, a mailbox
+     * @param slot The slot
+     */
+    void offer(Link &link, Slot *slot) {
+        Slot *replaced = link.latest.exchange(slot);
+        wake(link);
+        if (replaced != nullptr)
+            drop(replaced);
+    }
+
+    /*!
+     * Marks the end of the stream on a link, after the frames already handed over
+     * @param link The link
+     */
+    static void close(Link &link) {
+        if (!link.mailbox) {
+            push(link, nullptr);
+            return;
+        }
+        // The last frame isn't replaced by the end of the stream
+        retry(link, [&link]() { return link.latest.load() == nullptr; });
+        link.ended = true;
+        wake(link);
+    }
+
+    /*!
+     * Returns a slot so the source can fill it again
+     * @param slot The slot
+     */
+    void recycle(Slot *slot) {
+        {
+            std::lock_guard<std::mutex> lock(free_mutex);
+            free_slots.push_back(slot);
+        }
+        slot_recycled.notify_one();
+    }
+
+    /*!
+     * Recycles a frame skipped by DropOldest
+     * @param slot The frame's slot
+     */
+    void drop(Slot *slot) {
+        recycle(slot);
+        dropped++;
+        if (dropped_counter != nullptr)
+            dropped_counter->increment();
+    }
+
+    /*!
+     * Takes a free slot, waiting until one is recycled
+     * @return The slot, nullptr if the pipeline is stopping
+     */
+    Slot *acquire() {
+        std::unique_lock<std::mutex> lock(free_mutex);
+        slot_recycled.wait(lock, [this]() { return !free_slots.empty() || stopping.load(); });
+        if (stopping.load())
+            return nullptr;
+        Slot *slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+
+    /*!
+     * The source thread's loop
+     */
+    void run_source() {
+        Link &output = *links.front();
+        uint64_t sequence = 0;
+        while (Slot *slot = acquire()) {
+            if (!source(slot->item)) {
+                recycle(slot);
+                break;
+            }
+            slot->sequence = sequence++;
+            if (output.mailbox)
+                offer(output, slot);
+            else
+                push(output, slot);
+        }
+        close(output);
+    }
+
+    /*!
+     * A stage thread's loop
+     * @param index Index of the stage
+     */
+    void run_stage(size_t index) {
+        Link &input = *links[index];
+        Link &output = *links[index + 1];
+        bool end = false;
+        while (!end) {
+            Slot *slot = pop(input);
+            end = slot == nullptr;
+
+            // Skip to the newest frame that is waiting, the end marker is never skipped. A mailbox holds one frame.
+            Slot *newer;
+            while (!end && !input.mailbox && options.overflow == OverflowPolicy::DropOldest &&
+                   input.queue.try_pop(newer)) {
+                if (newer == nullptr) {
+                    end = true;
+                    break;
+                }
+                drop(slot);
+                slot = newer;
+                wake(input);
+            }
+            if (!queue_depths.empty())
+                queue_depths[index]->set(static_cast<int64_t>(depth(input)));
+
+            if (slot != nullptr) {
+                stages[index](slot->item);
+                push(output, slot);
+            }
+        }
+        push(output, nullptr);
+    }
+
+    /*!
+     * The sink thread's loop
+     */
+    void run_sink() {
+        while (Slot *slot = pop(*links.back())) {
+            if (!queue_depths.empty())
+                queue_depths.back()->set(static_cast<int64_t>(depth(*links.back())));
+            sink(slot->item, slot->sequence);
+            delivered++;
+            if (delivered_counter != nullptr)
+                delivered_counter->increment();
+            recycle(slot);
+        }
+    }
+
+public:
+    /*!
+     * Creates the pipeline, it doesn't run until start is called
+     * @param source Fills the next frame, returns false at the end of the stream
+     * @param stages The stages each frame goes through, in order
+     * @param sink Consumes the processed frames
+     * @param pipeline_options The pipeline options
+     */
+    Pipeline(Source source, std::vector<Stage> stages, Sink sink,
+             const PipelineOptions &pipeline_options = PipelineOptions())
+            : source(std::move(source)), stages(std::move(stages)), sink(std::move(sink)),
+              options(pipeline_options) {
+        for (size_t i = 0; i < this->stages.size() + 1; i++)
+            links.push_back(std::make_unique<Link>(options.queue_capacity));
+        // The source never waits for the first stage under DropOldest
+        links.front()->mailbox = options.overflow == OverflowPolicy::DropOldest;
+
+        // Enough slots for every queue to be full while every thread holds one
+        size_t n_slots = links.size() * options.queue_capacity + this->stages.size() + 2;
+        for (size_t i = 0; i < n_slots; i++) {
+            slots.push_back(std::make_unique<Slot>());
+            free_slots.push_back(slots.back().get());
+        }
+
+        if (options.metrics != nullptr) {
+            for (size_t i = 0; i < links.size(); i++)
+                queue_depths.push_back(&options.metrics->gauge(
+                        "easytflite_pipeline_queue_depth", "Frames waiting between two pipeline threads",
+                        {{"pipeline", options.name}, {"queue", std::to_string(i)}}));
+            delivered_counter = &options.metrics->counter("easytflite_pipeline_frames_delivered_total",
+                                                          "Frames the pipeline's sink consumed",
+                                                          {{"pipeline", options.name}});
+            dropped_counter = &options.metrics->counter("easytflite_pipeline_frames_dropped_total",
+                                                        "Frames skipped because of OverflowPolicy::DropOldest",
+                                                        {{"pipeline", options.name}});
+        }
+    }
+
+    /*!
+     * Stops the pipeline and waits for its threads
+     */
+    ~Pipeline() {
+        stop();
+        wait();
+    }
+
+    Pipeline(const Pipeline &) = delete;
+
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    /*!
+     * Starts the source, stage and sink threads
+     */
+    void start() {
+        threads.emplace_back(&Pipeline::run_source, this);
+        for (size_t i = 0; i < stages.size(); i++)
+            threads.emplace_back(&Pipeline::run_stage, this, i);
+        threads.emplace_back(&Pipeline::run_sink, this);
+    }
+
+    /*!
+     * Ends the stream early, frames already in the pipeline are still delivered
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(free_mutex);
+            stopping = true;
+        }
+        slot_recycled.notify_all();
+    }
+
+    /*!
+     * Waits until the end of the stream has reached the sink
+     */
+    void wait() {
+        for (auto &thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    /*!
+     * Gets the number of frames the sink consumed
+     * @return The number of delivered frames
+     */
+    uint64_t frames_delivered() const {
+        return delivered.load();
+    }
+
+    /*!
+     * Gets the number of frames skipped because of OverflowPolicy::DropOldest
+     * @return The number of dropped frames
+     */
+    uint64_t frames_dropped() const {
+        return dropped.load();
+    }
+};
+
+
+#endif //EASYTFLITE_PIPELINE_H
@@ -0,0 +1,175 @@
+#include "Preprocess.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <glog/logging.h>
+#include <eigen3/Eigen/Core>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+PreprocessOptions PreprocessOptions::minus_one_to_one() {
+    PreprocessOptions options;
+    options.mean = {127.5f, 127.5f, 127.5f, 127.5f};
+    options.stddev = {127.5f, 127.5f, 127.5f, 127.5f};
+    return options;
+}
+
+PreprocessOptions PreprocessOptions::zero_to_one() {
+    PreprocessOptions options;
+    options.stddev = {255.0f, 255.0f, 255.0f, 255.0f};
+    return options;
+}
+
+void FusedPreprocessor::prepare(const cv::Rect &source_region, int width, int channels,
+                                const PreprocessOptions &options, float quant_scale, int quant_zero_point) {
+    int n_elements = width * channels;
+    x_offsets = arena.get<int>(XOffsets, n_elements);
+    x_weights = arena.get<float>(XWeights, n_elements);
+    alphas = arena.get<float>(Alphas, n_elements);
+    betas = arena.get<float>(Betas, n_elements);
+    sampled_row = arena.get<float>(SampledRow, n_elements);
+    // One extra pixel so the right sample of the last column is always readable
+    blended_row = arena.get<float>(BlendedRow, (source_region.width + 1) * channels);
+
+    // Output channel to source channel
+    std::array<int, 4> channel_map = {0, 1, 2, 3};
+    if (options.swap_rb && channels >= 3)
+        std::swap(channel_map[0], channel_map[2]);
+
+    // Same pixel center mapping as cv::resize with INTER_LINEAR
+    float scale_x = static_cast<float>(source_region.width) / static_cast<float>(width);
+    for (int x = 0; x < width; x++) {
+        float fx = (static_cast<float>(x) + 0.5f) * scale_x - 0.5f;
+        int sx = static_cast<int>(std::floor(fx));
+        float wx = fx - static_cast<float>(sx);
+        if (sx < 0) {
+            sx = 0;
+            wx = 0.0f;
+        }
+        if (sx >= source_region.width - 1) {
+            sx = source_region.width - 1;
+            wx = 0.0f;
+        }
+        for (int c = 0; c < channels; c++) {
+            int i = x * channels + c;
+            x_offsets[i] = sx * channels + channel_map[c];
+            x_weights[i] = wx;
+        }
+    }
+
+    // Fold (x - mean) / std and x / quant_scale + quant_zero_point into a single multiply-add
+    for (int i = 0; i < n_elements; i++) {
+        int c = i % channels;
+        float alpha = 1.0f / (options.stddev[c] * quant_scale);
+        alphas[i] = alpha;
+        betas[i] = -options.mean[c] * alpha + static_cast<float>(quant_zero_point);
+    }
+}
+
+template<typename T>
+void FusedPreprocessor::run(const cv::Mat &image, const PreprocessOptions &options, T *output, int height, int width,
+                            int channels, float quant_scale, int quant_zero_point) {
+    static_assert(std::is_same<T, float>::value || std::is_same<T, Eigen::half>::value ||
+                  std::is_same<T, uint8_t>::value || std::is_same<T, int8_t>::value || std::is_same<T, int16_t>::value,
+                  "FusedPreprocessor only writes float, Eigen::half, uint8_t, int8_t or int16_t");
+    if (image.depth() != CV_8U)
+        LOG(FATAL) << "Error: preprocessing requires an 8 bit image\n";
+    if (image.channels() != channels || channels > 4)
+        LOG(FATAL) << "Error: image has " << image.channels() << " channels but the model expects " << channels
+                   << '\n';
+
+    // Choose the source region, the whole image or the centered crop with the output's aspect ratio
+    cv::Rect region(0, 0, image.cols, image.rows);
+    if (options.center_crop) {
+        if (static_cast<long>(image.cols) * height > static_cast<long>(image.rows) * width) {
+            region.width = static_cast<int>(static_cast<long>(image.rows) * width / height);
+            region.x = (image.cols - region.width) / 2;
+        } else {
+            region.height = static_cast<int>(static_cast<long>(image.cols) * height / width);
+            region.y = (image.rows - region.height) / 2;
+        }
+    }
+
+    prepare(region, width, channels, options, quant_scale, quant_zero_point);
+
+    int source_elements = region.width * channels;
+    int n_elements = width * channels;
+    Eigen::Map<Eigen::ArrayXf> blended(blended_row, source_elements);
+    Eigen::Map<Eigen::ArrayXf> sampled(sampled_row, n_elements);
+    Eigen::Map<const Eigen::ArrayXf> alpha(alphas, n_elements);
+    Eigen::Map<const Eigen::ArrayXf> beta(betas, n_elements);
+
+    float scale_y = static_cast<float>(region.height) / static_cast<float>(height);
+    for (int y = 0; y < height; y++) {
+        float fy = (static_cast<float>(y) + 0.5f) * scale_y - 0.5f;
+        int sy = static_cast<int>(std::floor(fy));
+        float wy = fy - static_cast<float>(sy);
+        if (sy < 0) {
+            sy = 0;
+            wy = 0.0f;
+        }
+        if (sy >= region.height - 1) {
+            sy = region.height - 1;
+            wy = 0.0f;
+        }
+
+        // Vertical blend of the two source rows
+        Eigen::Map<const Eigen::Array<uint8_t, Eigen::Dynamic, 1>> top(
+                image.ptr<uint8_t>(region.y + sy) + region.x * channels, source_elements);
+        if (wy == 0.0f) {
+            blended = top.cast<float>();
+        } else {
+            Eigen::Map<const Eigen::Array<uint8_t, Eigen::Dynamic, 1>> bottom(
+                    image.ptr<uint8_t>(region.y + sy + 1) + region.x * channels, source_elements);
+            blended = top.cast<float>() + (bottom.cast<float>() - top.cast<float>()) * wy;
+        }
+        std::copy_n(blended_row + source_elements - channels, channels, blended_row + source_elements);
+
+        // Horizontal sampling with the channel swap folded into the offsets, eight samples per gather with AVX2
+        const float *row = blended_row;
+        int i = 0;
+#if defined(__AVX2__)
+        __m256i right_step = _mm256_set1_epi32(channels);
+        for (; i + 8 <= n_elements; i += 8) {
+            __m256i offsets = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_offsets + i));
+            __m256 left = _mm256_i32gather_ps(row, offsets, 4);
+            __m256 right = _mm256_i32gather_ps(row, _mm256_add_epi32(offsets, right_step), 4);
+            __m256 weights = _mm256_loadu_ps(x_weights + i);
+            _mm256_storeu_ps(sampled_row + i, _mm256_add_ps(left, _mm256_mul_ps(_mm256_sub_ps(right, left), weights)));
+        }
+#endif
+        for (; i < n_elements; i++) {
+            float left = row[x_offsets[i]];
+            float right = row[x_offsets[i] + channels];
+            sampled_row[i] = left + (right - left) * x_weights[i];
+        }
+
+        // Normalize, quantize and write straight to the output
+        Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> out(output + static_cast<long>(y) * n_elements, n_elements);
+        if constexpr (!std::is_integral<T>::value) {
+            out = (sampled * alpha + beta).template cast<T>();
+        } else {
+            auto lowest = static_cast<float>(std::numeric_limits<T>::lowest());
+            auto highest = static_cast<float>(std::numeric_limits<T>::max());
+            out = (sampled * alpha + beta).round().max(lowest).min(highest).template cast<T>();
+        }
+    }
+}
+
+template void FusedPreprocessor::run<float>(const cv::Mat &, const PreprocessOptions &, float *, int, int, int, float,
+                                            int);
+
+template void FusedPreprocessor::run<uint8_t>(const cv::Mat &, const PreprocessOptions &, uint8_t *, int, int, int,
+                                              float, int);
+
+template void FusedPreprocessor::run<int8_t>(const cv::Mat &, const PreprocessOptions &, int8_t *, int, int, int,
+                                             float, int);
+
+template void FusedPreprocessor::run<int16_t>(const cv::Mat &, const PreprocessOptions &, int16_t *, int, int, int,
+                                              float, int);
+
+template void FusedPreprocessor::run<Eigen::half>(const cv::Mat &, const PreprocessOptions &, Eigen::half *, int, int,
+                                                  int, float, int);
@@ -0,0 +1,110 @@
+#ifndef EASYTFLITE_PREPROCESS_H
+#define EASYTFLITE_PREPROCESS_H
+
+#include "ScratchArena.h"
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+
+//! Options for the fused resize, channel swap, normalize and quantize preprocessing pass
+/*!
+ * Every output element is computed as (pixel - mean[c]) / stddev[c], where c is the output channel, and then quantized
+ * with the input tensor's scale and zero point when the tensor is an integer tensor. Integer tensors without
+ * quantization parameters take the normalized values rounded, so the default options feed them the raw pixels.
+ */
+struct PreprocessOptions {
+    //! Swap the first and third channels, turning OpenCV's BGR order into RGB
+    bool swap_rb = false;
+    //! Crop the largest centered region with the model's aspect ratio instead of stretching the image
+    bool center_crop = false;
+    //! Per channel mean subtracted from every pixel, indexed by output channel
+    std::array<float, 4> mean = {0.0f, 0.0f, 0.0f, 0.0f};
+    //! Per channel standard deviation every pixel is divided by, indexed by output channel
+    std::array<float, 4> stddev = {1.0f, 1.0f, 1.0f, 1.0f};
+
+    /*!
+     * Options that scale pixels to between -1 and 1, x / 127.5 - 1
+     * @return The preprocess options
+     */
+    static PreprocessOptions minus_one_to_one();
+
+    /*!
+     * Options that scale pixels to between 0 and 1, x / 255
+     * @return The preprocess options
+     */
+    static PreprocessOptions zero_to_one();
+};
+
+//! The FusedPreprocessor class resizes, normalizes and quantizes an image into a tensor in a single pass
+/*!
+ * The image is bilinearly resized (the same sampling as cv::resize with INTER_LINEAR) one output row at a time: two
+ * source rows are blended into a float row, the row is sampled horizontally with the channel swap folded into the
+ * sampling table, and the per channel affine transform and quantization are applied while writing to the output.
+ * No intermediate image is created. The vertical blend and the affine transform are Eigen array expressions, vectorized
+ * with SSE/AVX2/NEON when the compiler targets them, and the horizontal sampling gathers eight samples at a time with
+ * AVX2. Both fall back to scalar code otherwise. The sampling tables and row buffers live in a ScratchArena kept
+ * between calls, so an instance does not allocate once it has seen its largest image.
+ */
+class FusedPreprocessor {
+    //! Arena slots of the tables and row buffers
+    enum Slot : size_t {
+        XOffsets, XWeights, Alphas, Betas, BlendedRow, SampledRow
+    };
+
+    //! Owns the tables and row buffers, 64 byte aligned
+    ScratchArena arena;
+    //! Offset, in elements, of the left source sample of each output element
+    int *x_offsets = nullptr;
+    //! Weight of the right source sample of each output element
+    float *x_weights = nullptr;
+    //! Per output element scale, the affine transform and quantization folded together
+    float *alphas = nullptr;
+    //! Per output element bias, the affine transform and quantization folded together
+    float *betas = nullptr;
+    //! Vertically blended source row
+    float *blended_row = nullptr;
+    //! Horizontally sampled output row before the affine transform
+    float *sampled_row = nullptr;
+
+    /*!
+     * Prepares the sampling tables and per element transform for an output row
+     * @param source_region Region of the image being sampled
+     * @param width Output width
+     * @param channels Number of channels
+     * @param options The preprocess options
+     * @param quant_scale Quantization scale of the output, 1 for float outputs
+     * @param quant_zero_point Quantization zero point of the output, 0 for float outputs
+     */
+    void prepare(const cv::Rect &source_region, int width, int channels, const PreprocessOptions &options,
+                 float quant_scale, int quant_zero_point);
+
+public:
+    /*!
+     * Runs the fused pass, writing a [height, width, channels] row-major block to output
+     * @tparam T The output type, must be float, Eigen::half, uint8_t, int8_t or int16_t
+     * @param image An 8 bit OpenCV image with the same number of channels as the output
+     * @param options The preprocess options
+     * @param output Pointer to the output, usually the interpreter's input tensor
+     * @param height Output height
+     * @param width Output width
+     * @param channels Output channels
+     * @param quant_scale Quantization scale used for integer outputs, 1 for float outputs
+     * @param quant_zero_point Quantization zero point used for integer outputs, 0 for float outputs
+     */
+    template<typename T>
+    void run(const cv::Mat &image, const PreprocessOptions &options, T *output, int height, int width, int channels,
+             float quant_scale = 1.0f, int quant_zero_point = 0);
+
+    /*!
+     * Gets the allocation counters of the tables and row buffers
+     * @return The counters
+     */
+    const ArenaStats &arena_stats() const {
+        return arena.stats();
+    }
+};
+
+
+#endif //EASYTFLITE_PREPROCESS_H
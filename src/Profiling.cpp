@@ -0,0 +1,177 @@
+#include "Profiling.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <tensorflow/lite/profiling/time.h>
+
+namespace {
+    /*!
+     * Computes the statistics of a set of samples
+     * @param name Name of the stat
+     * @param samples The samples
+     * @return The statistics
+     */
+    ProfileStat make_stat(const std::string &name, const std::deque<double> &recorded) {
+        std::vector<double> samples(recorded.begin(), recorded.end());
+        ProfileStat stat;
+        stat.name = name;
+        stat.count = samples.size();
+        if (samples.empty())
+            return stat;
+        for (double sample : samples)
+            stat.total_us += sample;
+        stat.mean_us = stat.total_us / static_cast<double>(samples.size());
+        auto percentile = [&samples](double p) {
+            auto nth = samples.begin() + static_cast<long>(p * static_cast<double>(samples.size() - 1));
+            std::nth_element(samples.begin(), nth, samples.end());
+            return *nth;
+        };
+        stat.p50_us = percentile(0.5);
+        stat.p90_us = percentile(0.9);
+        stat.p99_us = percentile(0.99);
+        return stat;
+    }
+
+    /*!
+     * Computes the statistics of every name and sorts them by total time
+     * @param samples Samples by name
+     * @param top_n Most stats returned, 0 for all
+     * @return The statistics
+     */
+    std::vector<ProfileStat> make_stats(const std::map<std::string, std::deque<double>> &samples, size_t top_n) {
+        std::vector<ProfileStat> stats;
+        for (const auto &entry : samples)
+            stats.push_back(make_stat(entry.first, entry.second));
+        std::sort(stats.begin(), stats.end(), [](const ProfileStat &a, const ProfileStat &b) {
+            return a.total_us > b.total_us;
+        });
+        if (top_n != 0 && stats.size() > top_n)
+            stats.resize(top_n);
+        return stats;
+    }
+
+    /*!
+     * Escapes a string for a JSON string literal
+     * @param text The string
+     * @return The escaped string
+     */
+    std::string json_escape(const std::string &text) {
+        std::string output;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                output += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                output += c;
+        }
+        return output;
+    }
+
+    /*!
+     * Writes a table of statistics
+     * @param stream Where the table is written
+     * @param title Table title
+     * @param stats The statistics
+     */
+    void write_table(std::ostream &stream, const char *title, const std::vector<ProfileStat> &stats) {
+        stream << title << '\n';
+        stream << std::left << std::setw(40) << "name" << std::right << std::setw(8) << "count" << std::setw(14)
+               << "total (us)" << std::setw(12) << "mean (us)" << std::setw(12) << "p50 (us)" << std::setw(12)
+               << "p90 (us)" << std::setw(12) << "p99 (us)" << '\n';
+        stream << std::fixed << std::setprecision(1);
+        for (const ProfileStat &stat : stats)
+            stream << std::left << std::setw(40) << stat.name << std::right << std::setw(8) << stat.count
+                   << std::setw(14) << stat.total_us << std::setw(12) << stat.mean_us << std::setw(12) << stat.p50_us
+                   << std::setw(12) << stat.p90_us << std::setw(12) << stat.p99_us << '\n';
+    }
+}
+
+std::string ProfileSummary::to_string() const {
+    std::ostringstream stream;
+    write_table(stream, "Stages", stages);
+    stream << '\n';
+    write_table(stream, "Operators", ops);
+    stream << '\n';
+    write_table(stream, "Operator types", op_types);
+    return stream.str();
+}
+
+InferenceProfiler::InferenceProfiler(size_t max_events)
+        : op_profiler(static_cast<uint32_t>(std::max<size_t>(max_events, 1024))), max_events(max_events) {
+    op_profiler.StartProfiling();
+}
+
+tflite::Profiler *InferenceProfiler::interpreter_profiler() {
+    return &op_profiler;
+}
+
+uint64_t InferenceProfiler::now_us() {
+    return tflite::profiling::time::NowMicros();
+}
+
+void InferenceProfiler::record(std::deque<double> &samples, const std::string &name, const char *category,
+                               uint64_t begin_us, uint64_t end_us) {
+    // Samples and events are bounded, the oldest ones are dropped first
+    if (samples.size() >= max_events)
+        samples.pop_front();
+    samples.push_back(static_cast<double>(end_us - begin_us));
+    if (trace.size() >= max_events)
+        trace.pop_front();
+    trace.push_back({name, category, begin_us, end_us});
+}
+
+void InferenceProfiler::record_stage(const char *name, uint64_t begin_us, uint64_t end_us) {
+    record(stage_samples[name], name, "stage", begin_us, end_us);
+}
+
+void InferenceProfiler::collect_op_events() {
+    for (const tflite::profiling::ProfileEvent *event : op_profiler.GetProfileEvents()) {
+        if (event->event_type != tflite::profiling::ProfileEvent::EventType::OPERATOR_INVOKE_EVENT)
+            continue;
+        // The tag is the operator type and the metadata the node index
+        std::string op_type(event->tag);
+        std::string op_name = op_type + ":" + std::to_string(event->event_metadata);
+        record(op_samples[op_name], op_name, "op", event->begin_timestamp_us, event->end_timestamp_us);
+        op_type_samples[op_type].push_back(
+                static_cast<double>(event->end_timestamp_us - event->begin_timestamp_us));
+        if (op_type_samples[op_type].size() > max_events)
+            op_type_samples[op_type].pop_front();
+    }
+    // Clear the buffer so it never fills up, profiling continues
+    op_profiler.Reset();
+    op_profiler.StartProfiling();
+}
+
+ProfileSummary InferenceProfiler::summary(size_t top_n) const {
+    ProfileSummary output;
+    output.stages = make_stats(stage_samples, 0);
+    output.ops = make_stats(op_samples, top_n);
+    output.op_types = make_stats(op_type_samples, top_n);
+    return output;
+}
+
+std::string InferenceProfiler::chrome_trace_json() const {
+    std::ostringstream stream;
+    stream << "{\"traceEvents\":[";
+    bool first = true;
+    for (const TraceEvent &event : trace) {
+        if (!first)
+            stream << ',';
+        first = false;
+        // Stages and operators on separate rows of the same process
+        stream << "{\"name\":\"" << json_escape(event.name) << "\",\"cat\":\"" << event.category
+               << "\",\"ph\":\"X\",\"ts\":" << event.begin_us << ",\"dur\":" << event.end_us - event.begin_us
+               << ",\"pid\":0,\"tid\":" << (event.category[0] == 's' ? 0 : 1) << '}';
+    }
+    stream << "],\"displayTimeUnit\":\"ms\"}";
+    return stream.str();
+}
+
+void InferenceProfiler::reset() {
+    trace.clear();
+    stage_samples.clear();
+    op_samples.clear();
+    op_type_samples.clear();
+    op_profiler.Reset();
+    op_profiler.StartProfiling();
+}
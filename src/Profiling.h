@@ -0,0 +1,181 @@
+#ifndef EASYTFLITE_PROFILING_H
+#define EASYTFLITE_PROFILING_H
+
+#include "Metrics.h"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <tensorflow/lite/profiling/buffered_profiler.h>
+
+//! Latency statistics of one stage, operator or operator type, in microseconds
+struct ProfileStat {
+    //! Stage name, operator name with its node index, or operator type
+    std::string name;
+    //! Number of samples
+    size_t count = 0;
+    //! Sum of all samples
+    double total_us = 0;
+    //! Mean of all samples
+    double mean_us = 0;
+    //! Median
+    double p50_us = 0;
+    //! 90th percentile
+    double p90_us = 0;
+    //! 99th percentile
+    double p99_us = 0;
+};
+
+//! A summary of everything recorded while profiling was enabled
+struct ProfileSummary {
+    //! The library's own stages (preprocess, resize, convert, fill, invoke, output_copy), by total time
+    std::vector<ProfileStat> stages;
+    //! The most expensive operators (graph nodes), by total time
+    std::vector<ProfileStat> ops;
+    //! The most expensive operator types, every node of a type together, by total time
+    std::vector<ProfileStat> op_types;
+
+    /*!
+     * Formats the summary as a human readable table
+     * @return The table
+     */
+    std::string to_string() const;
+};
+
+//! The InferenceProfiler class records per operator latencies from Tensorflow Lite and the library's stage timings
+/*!
+ * A tflite::profiling::BufferedProfiler is attached to the interpreter to time every operator, its events are
+ * collected after each invoke so its buffer never fills up. The library's stages are timed with ScopedStage on the
+ * same clock, so both can be shown together in a Chrome trace (chrome://tracing or https://ui.perfetto.dev).
+ */
+class InferenceProfiler {
+    //! A timed span, kept for the Chrome trace
+    struct TraceEvent {
+        //! Stage or operator name
+        std::string name;
+        //! "stage" or "op"
+        const char *category;
+        //! Start timestamp
+        uint64_t begin_us;
+        //! End timestamp
+        uint64_t end_us;
+    };
+
+    //! Records the interpreter's operator events
+    tflite::profiling::BufferedProfiler op_profiler;
+    //! The most recent events, for the Chrome trace
+    std::deque<TraceEvent> trace;
+    //! Most events kept in trace and samples kept per name
+    size_t max_events;
+    //! Stage durations by stage name
+    std::map<std::string, std::deque<double>> stage_samples;
+    //! Operator durations by operator name and node index
+    std::map<std::string, std::deque<double>> op_samples;
+    //! Operator durations by operator type
+    std::map<std::string, std::deque<double>> op_type_samples;
+
+    /*!
+     * Records a span in the trace and in the samples
+     * @param samples The samples the duration is added to
+     * @param name Name of the span
+     * @param category Category of the span
+     * @param begin_us Start timestamp
+     * @param end_us End timestamp
+     */
+    void record(std::deque<double> &samples, const std::string &name, const char *category, uint64_t begin_us,
+                uint64_t end_us);
+
+public:
+    /*!
+     * Creates the profiler
+     * @param max_events Most events kept for the Chrome trace and samples kept per stage or operator
+     */
+    explicit InferenceProfiler(size_t max_events);
+
+    /*!
+     * Gets the profiler to attach to the interpreter with SetProfiler
+     * @return The operator profiler
+     */
+    tflite::Profiler *interpreter_profiler();
+
+    /*!
+     * Records a library stage
+     * @param name Stage name
+     * @param begin_us Start timestamp from now_us
+     * @param end_us End timestamp from now_us
+     */
+    void record_stage(const char *name, uint64_t begin_us, uint64_t end_us);
+
+    /*!
+     * Moves the operator events of the last invoke into the samples, run after every invoke
+     */
+    void collect_op_events();
+
+    /*!
+     * Summarizes the recorded samples
+     * @param top_n Most operators and operator types listed
+     * @return The summary
+     */
+    ProfileSummary summary(size_t top_n) const;
+
+    /*!
+     * Formats the recorded events as a Chrome trace
+     * @return The trace as JSON
+     */
+    std::string chrome_trace_json() const;
+
+    /*!
+     * Forgets everything recorded so far
+     */
+    void reset();
+
+    /*!
+     * Gets the current time on the profiler's clock, the one Tensorflow Lite timestamps its events with
+     * @return The time in microseconds
+     */
+    static uint64_t now_us();
+};
+
+//! Times a scope as a library stage, does nothing when both the profiler and the metrics are null
+class ScopedStage {
+    //! The profiler, null when profiling is disabled
+    InferenceProfiler *profiler;
+    //! The model's metrics, null when metrics are disabled
+    ModelMetrics *metrics;
+    //! Stage name
+    const char *name;
+    //! When the scope was entered
+    uint64_t begin_us = 0;
+
+public:
+    /*!
+     * Starts timing the stage
+     * @param profiler The profiler, null when profiling is disabled
+     * @param name Stage name, must be a string literal or otherwise outlive the scope
+     * @param metrics The model's metrics, null when metrics are disabled
+     */
+    ScopedStage(InferenceProfiler *profiler, const char *name, ModelMetrics *metrics = nullptr)
+            : profiler(profiler), metrics(metrics), name(name) {
+        if (profiler != nullptr || metrics != nullptr)
+            begin_us = InferenceProfiler::now_us();
+    }
+
+    ~ScopedStage() {
+        if (profiler == nullptr && metrics == nullptr)
+            return;
+        uint64_t end_us = InferenceProfiler::now_us();
+        if (profiler != nullptr)
+            profiler->record_stage(name, begin_us, end_us);
+        if (metrics != nullptr)
+            metrics->stage(name).record(end_us - begin_us);
+    }
+
+    ScopedStage(const ScopedStage &) = delete;
+
+    ScopedStage &operator=(const ScopedStage &) = delete;
+};
+
+
+#endif //EASYTFLITE_PROFILING_H
@@ -0,0 +1,38 @@
+#include "Quantization.h"
+
+QuantizationParams QuantizationParams::from_tensor(const TfLiteTensor &tensor) {
+    QuantizationParams params;
+    if (tensor.quantization.type == kTfLiteAffineQuantization && tensor.quantization.params != nullptr) {
+        const auto *affine = static_cast<const TfLiteAffineQuantization *>(tensor.quantization.params);
+        if (affine->scale != nullptr && affine->scale->size > 0) {
+            params.scales.assign(affine->scale->data, affine->scale->data + affine->scale->size);
+            params.zero_points.assign(params.scales.size(), 0);
+            if (affine->zero_point != nullptr && affine->zero_point->size == affine->scale->size)
+                params.zero_points.assign(affine->zero_point->data, affine->zero_point->data + affine->zero_point->size);
+            params.quantized_dimension = affine->quantized_dimension;
+            return params;
+        }
+    }
+    // Older converters only fill the per-tensor parameters
+    if (tensor.params.scale != 0.0f) {
+        params.scales.push_back(tensor.params.scale);
+        params.zero_points.push_back(tensor.params.zero_point);
+    }
+    return params;
+}
+
+// TfLiteFloat16 and Eigen::half are both a single IEEE half precision value, Eigen converts them in packets
+void to_half(const float *input, TfLiteFloat16 *output, size_t n) {
+    auto n_elements = static_cast<Eigen::Index>(n);
+    Eigen::Map<const Eigen::ArrayXf> in(input, n_elements);
+    Eigen::Map<Eigen::Array<Eigen::half, Eigen::Dynamic, 1>> out(reinterpret_cast<Eigen::half *>(output), n_elements);
+    out = in.cast<Eigen::half>();
+}
+
+void from_half(const TfLiteFloat16 *input, float *output, size_t n) {
+    auto n_elements = static_cast<Eigen::Index>(n);
+    Eigen::Map<const Eigen::Array<Eigen::half, Eigen::Dynamic, 1>> in(reinterpret_cast<const Eigen::half *>(input),
+                                                                      n_elements);
+    Eigen::Map<Eigen::ArrayXf> out(output, n_elements);
+    out = in.cast<float>();
+}
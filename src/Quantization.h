@@ -0,0 +1,159 @@
+#ifndef EASYTFLITE_QUANTIZATION_H
+#define EASYTFLITE_QUANTIZATION_H
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <tensorflow/lite/c/common.h>
+#include <eigen3/Eigen/Core>
+
+//! A tensor's affine quantization, real_value = scale * (quantized_value - zero_point)
+/*!
+ * Per-tensor quantization has one scale and one zero point. Per-channel quantization has one of each per index of
+ * quantized_dimension, every other index shares them.
+ */
+struct QuantizationParams {
+    //! One scale per channel, or a single one for the whole tensor, empty when the tensor isn't quantized
+    std::vector<float> scales;
+    //! One zero point per scale
+    std::vector<int32_t> zero_points;
+    //! The dimension the channels are along, only used with more than one scale
+    int quantized_dimension = 0;
+
+    /*!
+     * Reads a tensor's quantization, the per-channel parameters if there are any, the per-tensor ones otherwise
+     * @param tensor The tensor
+     * @return The quantization parameters
+     */
+    static QuantizationParams from_tensor(const TfLiteTensor &tensor);
+
+    //! Whether the tensor has quantization parameters
+    bool quantized() const {
+        return !scales.empty();
+    }
+
+    //! Whether there is one scale per channel
+    bool per_channel() const {
+        return scales.size() > 1;
+    }
+};
+
+/*!
+ * Quantizes values with a single scale and zero point, rounding to nearest and saturating
+ * @tparam T The quantized type, int8_t, uint8_t or int16_t
+ * @param input The real values
+ * @param output Where the n quantized values are written
+ * @param n Number of values
+ * @param scale The quantization scale
+ * @param zero_point The quantization zero point
+ */
+template<typename T>
+void quantize(const float *input, T *output, size_t n, float scale, int32_t zero_point) {
+    static_assert(std::is_integral<T>::value, "quantize writes an integer type");
+    auto n_elements = static_cast<Eigen::Index>(n);
+    Eigen::Map<const Eigen::ArrayXf> in(input, n_elements);
+    Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> out(output, n_elements);
+    auto lowest = static_cast<float>(std::numeric_limits<T>::lowest());
+    auto highest = static_cast<float>(std::numeric_limits<T>::max());
+    out = (in * (1.0f / scale) + static_cast<float>(zero_point)).round().max(lowest).min(highest)
+            .template cast<T>();
+}
+
+/*!
+ * Dequantizes values with a single scale and zero point
+ * @tparam T The quantized type, int8_t, uint8_t or int16_t
+ * @param input The quantized values
+ * @param output Where the n real values are written
+ * @param n Number of values
+ * @param scale The quantization scale
+ * @param zero_point The quantization zero point
+ */
+template<typename T>
+void dequantize(const T *input, float *output, size_t n, float scale, int32_t zero_point) {
+    static_assert(std::is_integral<T>::value, "dequantize reads an integer type");
+    auto n_elements = static_cast<Eigen::Index>(n);
+    Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>> in(input, n_elements);
+    Eigen::Map<Eigen::ArrayXf> out(output, n_elements);
+    out = (in.template cast<float>() - static_cast<float>(zero_point)) * scale;
+}
+
+/*!
+ * Quantizes a row-major tensor with per-channel parameters. The tensor is seen as [outer, channels, inner], where
+ * channels is dims[quantized_dimension], and each [inner, channels] slice is quantized as one array expression.
+ * @tparam T The quantized type, int8_t, uint8_t or int16_t
+ * @param input The real values
+ * @param output Where the quantized values are written
+ * @param dims The tensor's dimensions
+ * @param params The per-channel quantization parameters
+ */
+template<typename T>
+void quantize(const float *input, T *output, const std::vector<int> &dims, const QuantizationParams &params) {
+    long outer = 1, inner = 1;
+    for (int i = 0; i < params.quantized_dimension; i++)
+        outer *= dims[i];
+    for (size_t i = params.quantized_dimension + 1; i < dims.size(); i++)
+        inner *= dims[i];
+    auto channels = static_cast<Eigen::Index>(params.scales.size());
+
+    Eigen::RowVectorXf inverse_scales = Eigen::Map<const Eigen::RowVectorXf>(params.scales.data(), channels)
+            .cwiseInverse();
+    Eigen::RowVectorXf zero_points = Eigen::Map<const Eigen::Matrix<int32_t, 1, Eigen::Dynamic>>(
+            params.zero_points.data(), channels).cast<float>();
+    auto lowest = static_cast<float>(std::numeric_limits<T>::lowest());
+    auto highest = static_cast<float>(std::numeric_limits<T>::max());
+    for (long o = 0; o < outer; o++) {
+        long offset = o * channels * inner;
+        Eigen::Map<const Eigen::ArrayXXf> in(input + offset, inner, channels);
+        Eigen::Map<Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>> out(output + offset, inner, channels);
+        out = ((in.rowwise() * inverse_scales.array()).rowwise() + zero_points.array()).round().max(lowest)
+                .min(highest).template cast<T>();
+    }
+}
+
+/*!
+ * Dequantizes a row-major tensor with per-channel parameters, see the per-channel quantize
+ * @tparam T The quantized type, int8_t, uint8_t or int16_t
+ * @param input The quantized values
+ * @param output Where the real values are written
+ * @param dims The tensor's dimensions
+ * @param params The per-channel quantization parameters
+ */
+template<typename T>
+void dequantize(const T *input, float *output, const std::vector<int> &dims, const QuantizationParams &params) {
+    long outer = 1, inner = 1;
+    for (int i = 0; i < params.quantized_dimension; i++)
+        outer *= dims[i];
+    for (size_t i = params.quantized_dimension + 1; i < dims.size(); i++)
+        inner *= dims[i];
+    auto channels = static_cast<Eigen::Index>(params.scales.size());
+
+    Eigen::Map<const Eigen::RowVectorXf> scales(params.scales.data(), channels);
+    Eigen::RowVectorXf zero_points = Eigen::Map<const Eigen::Matrix<int32_t, 1, Eigen::Dynamic>>(
+            params.zero_points.data(), channels).cast<float>();
+    for (long o = 0; o < outer; o++) {
+        long offset = o * channels * inner;
+        Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>> in(input + offset, inner, channels);
+        Eigen::Map<Eigen::ArrayXXf> out(output + offset, inner, channels);
+        out = (in.template cast<float>().rowwise() - zero_points.array()).rowwise() * scales.array();
+    }
+}
+
+/*!
+ * Converts float values to half precision
+ * @param input The float values
+ * @param output Where the n half precision values are written
+ * @param n Number of values
+ */
+void to_half(const float *input, TfLiteFloat16 *output, size_t n);
+
+/*!
+ * Converts half precision values to float
+ * @param input The half precision values
+ * @param output Where the n float values are written
+ * @param n Number of values
+ */
+void from_half(const TfLiteFloat16 *input, float *output, size_t n);
+
+#endif //EASYTFLITE_QUANTIZATION_H
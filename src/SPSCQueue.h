@@ -0,0 +1,83 @@
+#ifndef EASYTFLITE_SPSCQUEUE_H
+#define EASYTFLITE_SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+//! The SPSCQueue class is a bounded, lock-free, single producer single consumer ring buffer
+/*!
+ * One thread pushes and one thread pops, neither ever takes a lock. The read and write positions live on separate
+ * cache lines so the two threads don't invalidate each other's line on every operation.
+ * @tparam T The element type, must be default constructible and movable
+ */
+template<typename T>
+class SPSCQueue {
+    //! The ring, one slot larger than the capacity so a full ring can be told apart from an empty one
+    std::vector<T> slots;
+    //! Position of the next element to pop, written by the consumer
+    alignas(64) std::atomic<size_t> read_position{0};
+    //! Position of the next element to push, written by the producer
+    alignas(64) std::atomic<size_t> write_position{0};
+
+public:
+    /*!
+     * Creates the queue
+     * @param capacity Most elements the queue holds at once
+     */
+    explicit SPSCQueue(size_t capacity) : slots(capacity + 1) {}
+
+    SPSCQueue(const SPSCQueue &) = delete;
+
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    /*!
+     * Pushes an element, must only be called by the producer
+     * @param value The element
+     * @return False if the queue is full, value is left untouched then
+     */
+    bool try_push(T &value) {
+        size_t write = write_position.load(std::memory_order_relaxed);
+        size_t next = write + 1 == slots.size() ? 0 : write + 1;
+        if (next == read_position.load(std::memory_order_acquire))
+            return false;
+        slots[write] = std::move(value);
+        write_position.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * Pops the oldest element, must only be called by the consumer
+     * @param value Where the element is moved to
+     * @return False if the queue is empty
+     */
+    bool try_pop(T &value) {
+        size_t read = read_position.load(std::memory_order_relaxed);
+        if (read == write_position.load(std::memory_order_acquire))
+            return false;
+        value = std::move(slots[read]);
+        read_position.store(read + 1 == slots.size() ? 0 : read + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * Gets the number of elements in the queue, only exact when neither thread is using the queue
+     * @return The number of elements
+     */
+    size_t size() const {
+        size_t read = read_position.load(std::memory_order_acquire);
+        size_t write = write_position.load(std::memory_order_acquire);
+        return write >= read ? write - read : write + slots.size() - read;
+    }
+
+    /*!
+     * Gets the most elements the queue holds at once
+     * @return The capacity
+     */
+    size_t capacity() const {
+        return slots.size() - 1;
+    }
+};
+
+
+#endif //EASYTFLITE_SPSCQUEUE_H
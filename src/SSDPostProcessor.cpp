@@ -0,0 +1,194 @@
+#include "SSDPostProcessor.h"
+
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <glog/logging.h>
+
+/*!
+ * Linearly interpolates a layer's anchor scale between the smallest and largest scales
+ * @param min_scale The first layer's scale
+ * @param max_scale The last layer's scale
+ * @param layer The layer
+ * @param n_layers The number of layers
+ * @return The layer's scale
+ */
+static float anchor_scale(float min_scale, float max_scale, size_t layer, size_t n_layers) {
+    if (n_layers == 1)
+        return (min_scale + max_scale) / 2.0f;
+    return min_scale + (max_scale - min_scale) * static_cast<float>(layer) / static_cast<float>(n_layers - 1);
+}
+
+SSDPostProcessor::SSDPostProcessor(Anchors anchor_set, const SSDPostProcessOptions &post_process_options)
+        : anchors(std::make_shared<const Anchors>(std::move(anchor_set))), options(post_process_options) {
+    if (anchors->rows() == 0)
+        LOG(FATAL) << "Error: the SSD post-processor needs at least one anchor\n";
+}
+
+SSDPostProcessor::SSDPostProcessor(const boost::filesystem::path &anchors_path,
+                                   const SSDPostProcessOptions &post_process_options)
+        : SSDPostProcessor(load_anchors(anchors_path), post_process_options) {}
+
+SSDPostProcessor::SSDPostProcessor(const AnchorOptions &anchor_options,
+                                   const SSDPostProcessOptions &post_process_options)
+        : SSDPostProcessor(generate_anchors(anchor_options), post_process_options) {}
+
+SSDPostProcessor::Anchors SSDPostProcessor::load_anchors(const boost::filesystem::path &anchors_path) {
+    std::ifstream file(anchors_path.string());
+    if (!file.is_open())
+        LOG(FATAL) << "Error: Couldn't open anchor file " << anchors_path << '\n';
+
+    std::vector<float> values;
+    float value;
+    while (file >> value)
+        values.push_back(value);
+    if (values.empty() || values.size() % 4 != 0)
+        LOG(FATAL) << "Error: the anchor file " << anchors_path << " must have 4 values per anchor\n";
+
+    auto n_anchors = static_cast<Eigen::Index>(values.size() / 4);
+    return Eigen::Map<const Eigen::Array<float, Eigen::Dynamic, 4, Eigen::RowMajor>>(values.data(), n_anchors, 4);
+}
+
+SSDPostProcessor::Anchors SSDPostProcessor::generate_anchors(const AnchorOptions &anchor_options) {
+    const std::vector<int> &strides = anchor_options.strides;
+    std::vector<float> values;
+    std::vector<float> anchor_heights, anchor_widths;
+
+    size_t layer = 0;
+    while (layer < strides.size()) {
+        anchor_heights.clear();
+        anchor_widths.clear();
+
+        // Consecutive layers with the same stride share a grid, their anchors are gathered together
+        size_t last_layer = layer;
+        for (; last_layer < strides.size() && strides[last_layer] == strides[layer]; last_layer++) {
+            float scale = anchor_scale(anchor_options.min_scale, anchor_options.max_scale, last_layer,
+                                       strides.size());
+            auto add_anchor = [&](float anchor_scale_value, float aspect_ratio) {
+                float ratio_sqrt = std::sqrt(aspect_ratio);
+                anchor_heights.push_back(anchor_scale_value / ratio_sqrt);
+                anchor_widths.push_back(anchor_scale_value * ratio_sqrt);
+            };
+            if (last_layer == 0 && anchor_options.reduce_boxes_in_lowest_layer) {
+                add_anchor(0.1f, 1.0f);
+                add_anchor(scale, 2.0f);
+                add_anchor(scale, 0.5f);
+                continue;
+            }
+            for (float aspect_ratio : anchor_options.aspect_ratios)
+                add_anchor(scale, aspect_ratio);
+            if (anchor_options.interpolated_scale_aspect_ratio > 0.0f) {
+                float next_scale = last_layer + 1 == strides.size() ? 1.0f :
+                                   anchor_scale(anchor_options.min_scale, anchor_options.max_scale, last_layer + 1,
+                                                strides.size());
+                add_anchor(std::sqrt(scale * next_scale), anchor_options.interpolated_scale_aspect_ratio);
+            }
+        }
+
+        // One anchor of every shape per grid cell, row by row
+        int stride = strides[layer];
+        int grid_height = (anchor_options.input_height + stride - 1) / stride;
+        int grid_width = (anchor_options.input_width + stride - 1) / stride;
+        for (int y = 0; y < grid_height; y++)
+            for (int x = 0; x < grid_width; x++)
+                for (size_t i = 0; i < anchor_heights.size(); i++) {
+                    values.push_back((static_cast<float>(y) + anchor_options.anchor_offset) /
+                                     static_cast<float>(grid_height));
+                    values.push_back((static_cast<float>(x) + anchor_options.anchor_offset) /
+                                     static_cast<float>(grid_width));
+                    values.push_back(anchor_heights[i]);
+                    values.push_back(anchor_widths[i]);
+                }
+        layer = last_layer;
+    }
+
+    auto n_anchors = static_cast<Eigen::Index>(values.size() / 4);
+    return Eigen::Map<const Eigen::Array<float, Eigen::Dynamic, 4, Eigen::RowMajor>>(values.data(), n_anchors, 4);
+}
+
+void SSDPostProcessor::process(const float *box_encodings, const float *class_scores, int num_classes,
+                               cv::Size image_size, float threshold, const std::vector<int> &classes,
+                               std::vector<Detection> &detections) {
+    detections.clear();
+    const Anchors &anchor_set = *anchors;
+    Eigen::Index n_anchors = anchor_set.rows();
+    int first_class = options.background_class ? 1 : 0;
+    Eigen::Index n_classes = num_classes - first_class;
+    if (n_classes < 1)
+        LOG(FATAL) << "Error: the SSD post-processor needs at least one class besides the background\n";
+
+    // Decodes every box column by column, from [y, x, height, width] encodings to [top, left, bottom, right]
+    boxes = Eigen::Map<const Eigen::Array<float, Eigen::Dynamic, 4, Eigen::RowMajor>>(box_encodings, n_anchors, 4);
+    boxes.col(0) = boxes.col(0) * (1.0f / options.y_scale) * anchor_set.col(2) + anchor_set.col(0);
+    boxes.col(1) = boxes.col(1) * (1.0f / options.x_scale) * anchor_set.col(3) + anchor_set.col(1);
+    boxes.col(2) = (boxes.col(2) * (1.0f / options.h_scale)).exp() * anchor_set.col(2);
+    boxes.col(3) = (boxes.col(3) * (1.0f / options.w_scale)).exp() * anchor_set.col(3);
+    boxes.col(0) -= 0.5f * boxes.col(2);
+    boxes.col(1) -= 0.5f * boxes.col(3);
+    boxes.col(2) += boxes.col(0);
+    boxes.col(3) += boxes.col(1);
+    boxes = boxes.max(0.0f).min(1.0f);
+
+    // The sigmoid is monotonic, so scores are thresholded raw and only the kept ones are activated
+    const float *scores = class_scores;
+    float raw_threshold = threshold;
+    if (options.activation == ScoreActivation::Softmax) {
+        probabilities = Eigen::Map<const Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+                class_scores, n_anchors, num_classes);
+        row_values = probabilities.rowwise().maxCoeff();
+        probabilities.colwise() -= row_values;
+        probabilities = probabilities.exp();
+        row_values = probabilities.rowwise().sum();
+        probabilities.colwise() /= row_values;
+        scores = probabilities.data();
+    } else if (options.activation == ScoreActivation::Sigmoid) {
+        if (threshold <= 0.0f)
+            raw_threshold = -std::numeric_limits<float>::infinity();
+        else if (threshold >= 1.0f)
+            raw_threshold = std::numeric_limits<float>::infinity();
+        else
+            raw_threshold = std::log(threshold / (1.0f - threshold));
+    }
+    auto activate = [this](float score) {
+        return options.activation == ScoreActivation::Sigmoid ? 1.0f / (1.0f + std::exp(-score)) : score;
+    };
+    auto add_detection = [&](Eigen::Index anchor, Eigen::Index class_index, float score) {
+        auto class_id = static_cast<int>(class_index);
+        if (!classes.empty() && std::find(classes.begin(), classes.end(), class_id) == classes.end())
+            return;
+        Detection &detection = detections.emplace_back();
+        auto width = static_cast<float>(image_size.width);
+        auto height = static_cast<float>(image_size.height);
+        detection.box = cv::Rect2f(boxes(anchor, 1) * width, boxes(anchor, 0) * height,
+                                   (boxes(anchor, 3) - boxes(anchor, 1)) * width,
+                                   (boxes(anchor, 2) - boxes(anchor, 0)) * height);
+        detection.class_id = class_id;
+        detection.score = activate(score);
+    };
+
+    for (Eigen::Index anchor = 0; anchor < n_anchors; anchor++) {
+        // Most anchors have no class over the threshold and are skipped after one vectorized maximum
+        Eigen::Map<const Eigen::ArrayXf> row(scores + anchor * num_classes + first_class, n_classes);
+        Eigen::Index best_class;
+        float best = row.maxCoeff(&best_class);
+        if (best < raw_threshold)
+            continue;
+        if (!options.class_aware) {
+            add_detection(anchor, best_class, best);
+            continue;
+        }
+        for (Eigen::Index c = 0; c < n_classes; c++)
+            if (row(c) >= raw_threshold)
+                add_detection(anchor, c, row(c));
+    }
+
+    // Only the highest scoring candidates go into the quadratic suppression
+    if (options.max_candidates > 0 && detections.size() > options.max_candidates) {
+        std::nth_element(detections.begin(), detections.begin() + options.max_candidates, detections.end(),
+                         [](const Detection &a, const Detection &b) { return a.score > b.score; });
+        detections.resize(options.max_candidates);
+    }
+    non_max_suppression(detections, options.nms_threshold, OverlapMetric::IoU, options.class_aware,
+                        options.max_detections);
+}
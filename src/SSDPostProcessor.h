@@ -0,0 +1,151 @@
+#ifndef EASYTFLITE_SSDPOSTPROCESSOR_H
+#define EASYTFLITE_SSDPOSTPROCESSOR_H
+
+#include <memory>
+#include <vector>
+#include <eigen3/Eigen/Core>
+#include <boost/filesystem.hpp>
+#include "Detection.h"
+
+//! How raw class scores are turned into probabilities
+enum class ScoreActivation {
+    //! Independent per-class probabilities, the usual export of the Tensorflow Object Detection API
+    Sigmoid,
+    //! Probabilities summing to one over the classes of an anchor
+    Softmax,
+    //! The scores already are probabilities
+    None
+};
+
+//! Options generating SSD anchors, the defaults are the ones of ssd_mobilenet_v2 at 300x300
+struct AnchorOptions {
+    //! Width of the model's input in pixels
+    int input_width = 300;
+    //! Height of the model's input in pixels
+    int input_height = 300;
+    //! Scale of the first layer's anchors, relative to the input
+    float min_scale = 0.2f;
+    //! Scale of the last layer's anchors, relative to the input
+    float max_scale = 0.95f;
+    //! Stride of every feature map layer in pixels, consecutive layers with the same stride share a grid
+    std::vector<int> strides = {16, 32, 64, 128, 256, 512};
+    //! Aspect ratios, width over height, of every layer's anchors
+    std::vector<float> aspect_ratios = {1.0f, 2.0f, 0.5f, 3.0f, 1.0f / 3.0f};
+    //! Aspect ratio of an extra anchor between a layer's scale and the next one's, 0 for none
+    float interpolated_scale_aspect_ratio = 1.0f;
+    //! The first layer only has three anchors, a small one and two of its scale with aspect ratios 2 and 0.5
+    bool reduce_boxes_in_lowest_layer = true;
+    //! Offset of the anchors' centers in their grid cell
+    float anchor_offset = 0.5f;
+};
+
+//! Options for SSDPostProcessor, the defaults match the Tensorflow Object Detection API's SSD exports
+struct SSDPostProcessOptions {
+    //! Scale of the center y encoding
+    float y_scale = 10.0f;
+    //! Scale of the center x encoding
+    float x_scale = 10.0f;
+    //! Scale of the height encoding
+    float h_scale = 5.0f;
+    //! Scale of the width encoding
+    float w_scale = 5.0f;
+    //! How raw class scores are turned into probabilities
+    ScoreActivation activation = ScoreActivation::Sigmoid;
+    //! Whether the first class is the background, it is then dropped and the other class indexes shifted down by one
+    bool background_class = true;
+    //! Largest intersection over union two kept detections may have
+    float nms_threshold = 0.6f;
+    //! Suppress per class, otherwise every anchor only keeps its best class and suppression is across classes
+    bool class_aware = true;
+    //! Most detections going into suppression, the highest scoring ones are kept, 0 for no limit
+    size_t max_candidates = 100;
+    //! Most detections kept after suppression, 0 for no limit
+    size_t max_detections = 10;
+};
+
+//! The SSDPostProcessor class turns raw SSD box encodings and class scores into detections
+/*!
+ * It does what the TFLite_Detection_PostProcess custom op does, for models exported without it. Every anchor's box is
+ * decoded as whole columns of Eigen arrays, scores are activated, thresholded and, after keeping the highest scoring
+ * candidates, suppressed with non_max_suppression. Buffers are reused, nothing is allocated once they have grown.
+ */
+class SSDPostProcessor {
+public:
+    //! Anchors, one per row, the columns are the center y, center x, height and width, relative to the input
+    using Anchors = Eigen::Array<float, Eigen::Dynamic, 4>;
+
+private:
+    //! The anchors, shared between copies
+    std::shared_ptr<const Anchors> anchors;
+    //! The post-processing options
+    SSDPostProcessOptions options;
+    //! Decoded boxes, the columns are top, left, bottom and right, relative to the input
+    Anchors boxes;
+    //! Activated scores, one row per anchor
+    Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> probabilities;
+    //! One value per anchor, the row maxima and sums of the softmax
+    Eigen::ArrayXf row_values;
+
+public:
+    /*!
+     * Creates a post-processor from anchors
+     * @param anchor_set The anchors
+     * @param post_process_options The post-processing options
+     */
+    explicit SSDPostProcessor(Anchors anchor_set,
+                              const SSDPostProcessOptions &post_process_options = SSDPostProcessOptions());
+
+    /*!
+     * Creates a post-processor with anchors loaded from a file, see load_anchors
+     * @param anchors_path The path to the anchors
+     * @param post_process_options The post-processing options
+     */
+    explicit SSDPostProcessor(const boost::filesystem::path &anchors_path,
+                              const SSDPostProcessOptions &post_process_options = SSDPostProcessOptions());
+
+    /*!
+     * Creates a post-processor with generated anchors, see generate_anchors
+     * @param anchor_options The anchor generation options
+     * @param post_process_options The post-processing options
+     */
+    explicit SSDPostProcessor(const AnchorOptions &anchor_options,
+                              const SSDPostProcessOptions &post_process_options = SSDPostProcessOptions());
+
+    /*!
+     * Loads anchors from a text file with one anchor per line, its center y, center x, height and width relative to
+     * the input separated by spaces
+     * @param anchors_path The path to the anchors
+     * @return The anchors
+     */
+    static Anchors load_anchors(const boost::filesystem::path &anchors_path);
+
+    /*!
+     * Generates anchors the way the Tensorflow Object Detection API's multiple grid anchor generator does
+     * @param anchor_options The anchor generation options
+     * @return The anchors
+     */
+    static Anchors generate_anchors(const AnchorOptions &anchor_options);
+
+    /*!
+     * Gets the number of anchors
+     * @return The number of anchors
+     */
+    int anchor_count() const {
+        return static_cast<int>(anchors->rows());
+    }
+
+    /*!
+     * Decodes the boxes, thresholds the scores and suppresses overlapping detections
+     * @param box_encodings The anchor count by 4 row-major box encodings, [y, x, height, width]
+     * @param class_scores The anchor count by num_classes row-major raw class scores
+     * @param num_classes The number of classes, background included
+     * @param image_size Size of the image the boxes are scaled to
+     * @param threshold Lowest probability kept
+     * @param classes Class indexes kept, every class is kept when empty
+     * @param detections Cleared, then filled with the detections, boxes are in pixels of the image
+     */
+    void process(const float *box_encodings, const float *class_scores, int num_classes, cv::Size image_size,
+                 float threshold, const std::vector<int> &classes, std::vector<Detection> &detections);
+};
+
+#endif //EASYTFLITE_SSDPOSTPROCESSOR_H
@@ -4,66 +4,194 @@
 
 #include "SSD_EasyTFLite.h"
 
-SSD_EasyTFLite::SSD_EasyTFLite(const boost::filesystem::path &model_path) : EasyTFLite(model_path) {
+#include <array>
+#include <cctype>
+#include <string>
+#include <algorithm>
+#include <initializer_list>
+
+SSD_EasyTFLite::SSD_EasyTFLite(const boost::filesystem::path &model_path, const ExecutionConfig &config)
+        : EasyTFLite(model_path, config) {
+    check_input_type();
+    check_output_tensors();
+}
+
+SSD_EasyTFLite::SSD_EasyTFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                               const ExecutionConfig &config) : EasyTFLite(std::move(shared_model), config) {
+    check_input_type();
+    check_output_tensors();
+}
+
+SSD_EasyTFLite::SSD_EasyTFLite(const boost::filesystem::path &model_path, const SSDPostProcessor &ssd_post_processor,
+                               const ExecutionConfig &config)
+        : SSD_EasyTFLite(TFLite::load_model(model_path), ssd_post_processor, config) {}
+
+SSD_EasyTFLite::SSD_EasyTFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                               const SSDPostProcessor &ssd_post_processor, const ExecutionConfig &config)
+        : EasyTFLite(std::move(shared_model), config), post_processor(std::make_unique<SSDPostProcessor>(ssd_post_processor)) {
+    check_input_type();
+    check_output_tensors();
+}
+
+void SSD_EasyTFLite::check_input_type() {
     int input_index = input_tensors()[0];
     TfLiteType type = interpreter->tensor(input_index)->type;
     if (type == kTfLiteFloat32)
         quant_model = false;
-    else if (type == kTfLiteUInt8)
+    else if (type == kTfLiteUInt8 || type == kTfLiteInt8)
         quant_model = true;
     else
         LOG(FATAL) << "Error: cannot handle input type " << type << " yet\n";
 }
 
+void SSD_EasyTFLite::check_output_tensors() {
+    const std::vector<int> &ot = interpreter->outputs();
+    if (post_processor) {
+        if (ot.size() != 2)
+            LOG(FATAL) << "Error: a raw Single Shot MultiBox Detector model must have 2 outputs, not " << ot.size()
+                       << '\n';
+        // The box encodings are the output with 4 values per anchor, with 4 classes both are and the names decide
+        int n_anchors = post_processor->anchor_count();
+        auto box_shaped = [&](int index) {
+            const TfLiteIntArray *dims = interpreter->tensor(index)->dims;
+            return dims->size > 0 && dims->data[dims->size - 1] == 4 &&
+                   get_tensor_element_count(index) == n_anchors * 4;
+        };
+        auto name_has = [&](int index, std::initializer_list<const char *> words) {
+            const char *name = interpreter->tensor(index)->name;
+            std::string lower_name = name == nullptr ? "" : name;
+            std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return std::any_of(words.begin(), words.end(), [&lower_name](const char *word) {
+                return lower_name.find(word) != std::string::npos;
+            });
+        };
+        int boxes = box_shaped(ot[0]) ? 0 : 1;
+        if (box_shaped(ot[0]) && box_shaped(ot[1])) {
+            // A class name rules an output out first, BoxPredictor/ClassPredictor names contain both words
+            std::array<bool, 2> class_named{}, box_named{};
+            for (int i = 0; i < 2; i++) {
+                class_named[i] = name_has(ot[i], {"class", "score"});
+                box_named[i] = name_has(ot[i], {"box", "regress", "location"});
+            }
+            if (class_named[0] != class_named[1])
+                boxes = class_named[0] ? 1 : 0;
+            else if (box_named[0] != box_named[1])
+                boxes = box_named[0] ? 0 : 1;
+            else
+                LOG(FATAL) << "Error: both outputs could be the box encodings and their names don't tell them apart\n";
+        }
+        output_indexes = {ot[boxes], ot[1 - boxes], -1, -1};
+        if (get_tensor_element_count(output_indexes[0]) != n_anchors * 4)
+            LOG(FATAL) << "Error: the model's box encodings don't match the post-processor's " << n_anchors
+                       << " anchors\n";
+        num_classes = get_tensor_element_count(output_indexes[1]) / n_anchors;
+        if (num_classes * n_anchors != get_tensor_element_count(output_indexes[1]))
+            LOG(FATAL) << "Error: the model's class scores don't match the post-processor's " << n_anchors
+                       << " anchors\n";
+        return;
+    }
+    if (ot.size() != 4)
+        LOG(FATAL) << "Error: a Single Shot MultiBox Detector model must have 4 outputs, not " << ot.size() << '\n';
+    for (int i = 0; i < 4; i++) {
+        if (interpreter->tensor(ot[i])->type != kTfLiteFloat32)
+            LOG(FATAL) << "Error: the Single Shot MultiBox Detector's outputs must be float\n";
+        output_indexes[i] = ot[i];
+    }
+}
+
+void SSD_EasyTFLite::detect(const cv::Mat &input_image, std::vector<Detection> &detections, float threshold,
+                            const std::vector<int> &classes) {
+    ScopedInference inference(metrics.get(), "detect");
+    detections.clear();
+
+    // Run inference, the image is resized and scaled (or quantized for quantized models) straight into the input
+    preprocess(input_image, PreprocessOptions::minus_one_to_one());
+    invoke();
+
+    ScopedStage stage(profiler.get(), "output_copy", metrics.get());
+    if (post_processor) {
+        post_processor->process(raw_output(output_indexes[0], box_encodings),
+                                raw_output(output_indexes[1], class_scores), num_classes, input_image.size(),
+                                threshold, classes, detections);
+        return;
+    }
+    const float *locations = interpreter->typed_tensor<float>(output_indexes[0]);
+    const float *class_ids = interpreter->typed_tensor<float>(output_indexes[1]);
+    const float *scores = interpreter->typed_tensor<float>(output_indexes[2]);
+    int max_detections = get_tensor_element_count(output_indexes[2]);
+    int n_detections = std::min(static_cast<int>(interpreter->typed_tensor<float>(output_indexes[3])[0]),
+                                max_detections);
+
+    auto width = static_cast<float>(input_image.cols);
+    auto height = static_cast<float>(input_image.rows);
+    const int block_size = 16;
+    for (int start = 0; start < n_detections; start += block_size) {
+        int length = std::min(block_size, n_detections - start);
+        // Most scores are under the threshold, whole blocks of them are skipped with one vectorized comparison
+        if (!(Eigen::Map<const Eigen::ArrayXf>(scores + start, length) >= threshold).any())
+            continue;
+
+        for (int i = start; i < start + length; i++) {
+            if (scores[i] < threshold)
+                continue;
+            auto class_id = static_cast<int>(class_ids[i]);
+            if (!classes.empty() && std::find(classes.begin(), classes.end(), class_id) == classes.end())
+                continue;
+
+            // Locations are [top, left, bottom, right] between 0 and 1
+            const float *location = locations + i * 4;
+            float top = std::clamp(location[0], 0.0f, 1.0f) * height;
+            float left = std::clamp(location[1], 0.0f, 1.0f) * width;
+            float bottom = std::clamp(location[2], 0.0f, 1.0f) * height;
+            float right = std::clamp(location[3], 0.0f, 1.0f) * width;
+
+            Detection &detection = detections.emplace_back();
+            detection.box = cv::Rect2f(left, top, right - left, bottom - top);
+            detection.class_id = class_id;
+            detection.score = scores[i];
+        }
+    }
+}
+
+const float *SSD_EasyTFLite::raw_output(int index, std::vector<float> &buffer) {
+    if (interpreter->tensor(index)->type == kTfLiteFloat32)
+        return interpreter->typed_tensor<float>(index);
+    get_tensor_dequantized(index, buffer);
+    return buffer.data();
+}
+
 std::array<Eigen::Tensor<float, 2>, 4> SSD_EasyTFLite::run_inference(const cv::Mat &input_image) {
+    if (post_processor)
+        LOG(FATAL) << "Error: run_inference needs the post-process op's outputs, use detect for raw output models\n";
+    ScopedInference inference(metrics.get(), "run_inference");
     // Get size of input image
     cv::Size input_image_size = input_image.size();
 
-    int input_index = input_tensors()[0];
+    // Run inference, the image is resized and scaled (or quantized for quantized models) straight into the input
+    preprocess(input_image, PreprocessOptions::minus_one_to_one());
+    invoke();
+
+    const float *location_data = interpreter->typed_tensor<float>(output_indexes[0]);
+    const float *class_data = interpreter->typed_tensor<float>(output_indexes[1]);
+    const float *score_data = interpreter->typed_tensor<float>(output_indexes[2]);
+    int location_size = get_tensor_element_count(output_indexes[0]) / 4;
+    int classes_score_size = get_tensor_element_count(output_indexes[1]);
 
-    // Resize image
-    cv::Mat resized_image;
-    std::vector<int> dims = get_tensor_dims(input_index);
-    cv::Size target_size(dims[1], dims[2]);
-    cv::resize(input_image, resized_image, target_size);
-
-    // Run inference
-    std::vector<float *> output_tensors;
-    if (quant_model) {
-        std::vector<uint8_t *> itp(1);
-        itp[0] = resized_image.data;;
-        output_tensors = run_inference_ptrs<uint8_t, float>(itp);
-    } else
-        output_tensors = run_inference_ptrs(resized_image);
-
-    auto output_tensor_indexes = input_tensors();
-
-    int location_size = get_tensor_element_count(output_tensor_indexes[0]) / 4;
-    int classes_score_size = get_tensor_element_count(output_tensor_indexes[1]);
-
-    // Allocate output tensors
-    Eigen::Tensor<float, 2> locations(location_size, 4);
-    Eigen::Tensor<float, 2> classes(1, classes_score_size);
-    Eigen::Tensor<float, 2> scores(1, classes_score_size);
-    Eigen::Tensor<float, 2> n_detections(1, 1);
-
-    // Copy data from model
+    std::array<Eigen::Tensor<float, 2>, 4> output;
+    Eigen::Tensor<float, 2> &locations = output[0];
+    locations.resize(location_size, 4);
+    // Scale location data from between 0 and 1 to between 0 and the dimensions of the input image
     for (int i = 0; i < location_size; i++) {
-        // Scale location data from between 0 and 1 to between 0 and the dimensions of the input image
         int j = i * 4;
-        locations(i, 0) = output_tensors[0][j] * input_image_size.height;
-        locations(i, 1) = output_tensors[0][j + 1] * input_image_size.width;
-        locations(i, 2) = output_tensors[0][j + 2] * input_image_size.height;
-        locations(i, 3) = output_tensors[0][j + 3] * input_image_size.width;
+        locations(i, 0) = location_data[j] * input_image_size.height;
+        locations(i, 1) = location_data[j + 1] * input_image_size.width;
+        locations(i, 2) = location_data[j + 2] * input_image_size.height;
+        locations(i, 3) = location_data[j + 3] * input_image_size.width;
     }
-    for (int i = 0; i < classes_score_size; i++) {
-        classes(1, i) = output_tensors[1][i];
-        scores(1, i) = output_tensors[0][i];
-    }
-    n_detections(0, 0) = output_tensors[3][0];
-
-
-    // create and return output arrays of tensors
-    std::array<Eigen::Tensor<float, 2>, 4> output = {locations, classes, scores, n_detections};
+    output[1] = Eigen::TensorMap<const Eigen::Tensor<float, 2>>(class_data, 1, classes_score_size);
+    output[2] = Eigen::TensorMap<const Eigen::Tensor<float, 2>>(score_data, 1, classes_score_size);
+    output[3].resize(1, 1);
+    output[3](0, 0) = interpreter->typed_tensor<float>(output_indexes[3])[0];
     return output;
 }
@@ -6,29 +6,119 @@
 #define EASYTFLITE_SSD_EASYTFLITE_H
 
 #include "EasyTFLite.h"
+#include "Detection.h"
+#include "SSDPostProcessor.h"
 
 //! The SSD_EasyTFLite class inherits EasyTFLite whose objective is to have single function inference for SSD Object Detection
 /*!
  * SSD_EasyTFLite, with this class you can run inferencing using the Single Shot MultiBox Detector Tensorflow Lite models.
  * To use this, it is recommended to use a Tensorflow provided model and retain for your purposes. You can, however,
  * mimic the input and output tensors of those model, and that would work. This class assumes input range of -1 and 1.
+ * Models exported without the TFLite_Detection_PostProcess op, whose two outputs are the raw box encodings and class
+ * scores, are post-processed in C++ by an SSDPostProcessor given to the constructor.
  */
 class SSD_EasyTFLite : private EasyTFLite {
     //! Whether the model is quantized or not
     bool quant_model;
 
+    /*!
+     * Checks the model's input type and sets quant_model
+     */
+    void check_input_type();
+
+    //! Indexes of the locations, classes, scores and number of detections output tensors, or of the box encodings and
+    //! class scores for raw output models
+    std::array<int, 4> output_indexes;
+
+    //! Decodes the raw outputs, only set for models without the post-process op
+    std::unique_ptr<SSDPostProcessor> post_processor;
+    //! Number of classes of the raw class scores, background included
+    int num_classes = 0;
+    //! Dequantized raw box encodings, only used by quantized raw output models
+    std::vector<float> box_encodings;
+    //! Dequantized raw class scores, only used by quantized raw output models
+    std::vector<float> class_scores;
+
+    /*!
+     * Checks the model has the four detection outputs, or the two raw outputs when there is a post-processor, and
+     * stores their indexes
+     */
+    void check_output_tensors();
+
+    /*!
+     * Gets a raw output as floats, dequantizing it if needed
+     * @param index The output's index
+     * @param buffer Where a quantized output is dequantized
+     * @return Pointer to the floats
+     */
+    const float *raw_output(int index, std::vector<float> &buffer);
+
 public:
+    using EasyTFLite::set_num_threads;
+    using EasyTFLite::set_execution_config;
+    using EasyTFLite::get_execution_config;
+    using EasyTFLite::warmup;
+    using EasyTFLite::get_model_fingerprint;
+    using EasyTFLite::enable_profiling;
+    using EasyTFLite::disable_profiling;
+    using EasyTFLite::reset_profiling;
+    using EasyTFLite::profiling_summary;
+    using EasyTFLite::profiling_chrome_trace;
+    using EasyTFLite::enable_metrics;
+    using EasyTFLite::disable_metrics;
+
     /*!
     * Initializes SSD_EasyTFLite
     * @param model_path The path to a Single Shot MultiBox Detector Tensorflow Lite Flatbuffer Model
+    * @param config How the interpreter executes, see ExecutionConfig
     */
-    explicit SSD_EasyTFLite(const boost::filesystem::path &model_path);
+    explicit SSD_EasyTFLite(const boost::filesystem::path &model_path,
+                            const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Initializes SSD_EasyTFLite from an already loaded model, so several detectors can share one model
+     * @param shared_model A Single Shot MultiBox Detector model loaded with TFLite::load_model
+     * @param config How the interpreter executes, see ExecutionConfig
+     */
+    explicit SSD_EasyTFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                            const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Initializes SSD_EasyTFLite for a model without the post-process op
+     * @param model_path The path to a Single Shot MultiBox Detector Tensorflow Lite Flatbuffer Model whose outputs are
+     * the box encodings and the class scores. When both have 4 values per anchor, their names must tell them apart.
+     * @param ssd_post_processor Decodes the outputs, its anchors must match the model's
+     * @param config How the interpreter executes, see ExecutionConfig
+     */
+    SSD_EasyTFLite(const boost::filesystem::path &model_path, const SSDPostProcessor &ssd_post_processor,
+                   const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Initializes SSD_EasyTFLite for an already loaded model without the post-process op
+     * @param shared_model A Single Shot MultiBox Detector model loaded with TFLite::load_model whose outputs are the
+     * box encodings and the class scores. When both have 4 values per anchor, their names must tell them apart.
+     * @param ssd_post_processor Decodes the outputs, its anchors must match the model's
+     * @param config How the interpreter executes, see ExecutionConfig
+     */
+    SSD_EasyTFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                   const SSDPostProcessor &ssd_post_processor, const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Runs inferencing and writes the detections above a threshold into a vector the caller reuses from frame to frame.
+     * Nothing is allocated once the vector's capacity has grown to the largest number of detections.
+     * @param input_image OpenCV's Mat image to run inference on
+     * @param detections Cleared, then filled with the detections, boxes are in pixels of input_image
+     * @param threshold Lowest score kept
+     * @param classes Class indexes kept, every class is kept when empty
+     */
+    void detect(const cv::Mat &input_image, std::vector<Detection> &detections, float threshold = 0.5f,
+                const std::vector<int> &classes = std::vector<int>());
 
     /*!
-     * Runs inferencing, output results in four Rank 4 tensors, the first float of the first tensor contains the
+     * Runs inferencing, output results in four Rank 2 tensors, the first float of the first tensor contains the
      * locations of the detected objects in [10][4], the second contains the classes, the third contains the scores for
      * the classes, and, finally, the last and fourth tensors contains the number of detection in the first float and
-     * only float of the tensor.
+     * only float of the tensor. Only available for models with the post-process op.
      * @param input_image OpenCV's Mat image to run inference on
      * @return A array of 4 eigen tensors
      */
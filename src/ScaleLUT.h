@@ -0,0 +1,116 @@
+#ifndef EASYTFLITE_SCALELUT_H
+#define EASYTFLITE_SCALELUT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+//! The ScaleLUT class evaluates a uint8 to T scale function once into a 256 entry lookup table
+/*!
+ * Any unsigned char to T function can be turned into a table, after that applying it to an image costs a table
+ * lookup per byte instead of a function call. apply() uses an AVX2 gather for 4 byte types and NEON table lookups for
+ * 1 byte types when available, otherwise an unrolled scalar loop.
+ * @tparam T The value type the function produces, usually the model's input type
+ */
+template<typename T>
+class ScaleLUT {
+    //! The function evaluated at every possible byte
+    alignas(64) std::array<T, 256> table;
+
+public:
+    /*!
+     * Builds the table by evaluating scale_func on every value from 0 to 255
+     * @tparam ScaleFunc Any callable taking an unsigned char and returning something convertible to T, not a ScaleLUT
+     * so copies still use the copy constructor
+     * @param scale_func The scale function
+     */
+    template<typename ScaleFunc,
+            typename = std::enable_if_t<!std::is_same<std::decay_t<ScaleFunc>, ScaleLUT>::value>>
+    explicit ScaleLUT(ScaleFunc &&scale_func) {
+        for (int i = 0; i < 256; i++)
+            table[i] = static_cast<T>(scale_func(static_cast<unsigned char>(i)));
+    }
+
+    /*!
+     * Looks up a single value
+     * @param x The byte to scale
+     * @return The scaled value
+     */
+    T operator()(unsigned char x) const {
+        return table[x];
+    }
+
+    /*!
+     * Applies the table to n bytes
+     * @param input Pointer to the bytes to scale
+     * @param output Pointer to where the n scaled values are written
+     * @param n Number of bytes
+     */
+    void apply(const unsigned char *input, T *output, size_t n) const {
+        size_t i = 0;
+#if defined(__AVX2__)
+        if (sizeof(T) == 4) {
+            for (; i + 8 <= n; i += 8) {
+                __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(input + i));
+                __m256i indexes = _mm256_cvtepu8_epi32(bytes);
+                __m256i values = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table.data()), indexes, 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), values);
+            }
+        }
+#elif defined(__aarch64__)
+        if (sizeof(T) == 1) {
+            uint8x16x4_t quarters[4];
+            for (int q = 0; q < 4; q++)
+                quarters[q] = vld1q_u8_x4(reinterpret_cast<const uint8_t *>(table.data()) + q * 64);
+            uint8x16_t quarter_size = vdupq_n_u8(64);
+            for (; i + 16 <= n; i += 16) {
+                // Out of range indexes yield 0, so the four 64 byte lookups can be or'ed together
+                uint8x16_t indexes = vld1q_u8(input + i);
+                uint8x16_t values = vqtbl4q_u8(quarters[0], indexes);
+                for (int q = 1; q < 4; q++) {
+                    indexes = vsubq_u8(indexes, quarter_size);
+                    values = vorrq_u8(values, vqtbl4q_u8(quarters[q], indexes));
+                }
+                vst1q_u8(reinterpret_cast<uint8_t *>(output + i), values);
+            }
+        }
+#endif
+        for (; i + 4 <= n; i += 4) {
+            output[i] = table[input[i]];
+            output[i + 1] = table[input[i + 1]];
+            output[i + 2] = table[input[i + 2]];
+            output[i + 3] = table[input[i + 3]];
+        }
+        for (; i < n; i++)
+            output[i] = table[input[i]];
+    }
+};
+
+//! True when T is a ScaleLUT
+template<typename T>
+struct is_scale_lut : std::false_type {
+};
+
+template<typename T>
+struct is_scale_lut<ScaleLUT<T>> : std::true_type {
+};
+
+//! True when T is a std::function, whose calls the compiler can't inline
+template<typename T>
+struct is_std_function : std::false_type {
+};
+
+template<typename Signature>
+struct is_std_function<std::function<Signature>> : std::true_type {
+};
+
+#endif //EASYTFLITE_SCALELUT_H
@@ -0,0 +1,153 @@
+#ifndef EASYTFLITE_SCRATCHARENA_H
+#define EASYTFLITE_SCRATCHARENA_H
+
+#include <new>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+//! Counters kept by a ScratchArena
+struct ArenaStats {
+    //! Number of heap allocations made, flat once every slot has seen its largest request
+    size_t allocations = 0;
+    //! Total bytes currently held by the arena
+    size_t reserved_bytes = 0;
+    //! Number of buffers handed out
+    size_t requests = 0;
+
+    ArenaStats &operator+=(const ArenaStats &other) {
+        allocations += other.allocations;
+        reserved_bytes += other.reserved_bytes;
+        requests += other.requests;
+        return *this;
+    }
+};
+
+//! The ScratchArena class owns the intermediate buffers of a single pipeline instance
+/*!
+ * Every buffer lives in a numbered slot. Asking for a slot hands back its memory, growing it only when the request is
+ * larger than anything the slot has held, so a pipeline running on same sized frames stops allocating after the first
+ * one. Buffers are 64 byte aligned so vectorized loops never straddle cache lines. The contents of a slot are not kept
+ * when it grows. It is not thread safe, every thread needs its own arena.
+ */
+class ScratchArena {
+    //! An aligned allocation and its size
+    struct Block {
+        //! The allocation
+        void *data = nullptr;
+        //! Size of the allocation in bytes
+        size_t capacity = 0;
+    };
+
+    //! Alignment of every buffer in bytes
+    static constexpr size_t alignment = 64;
+    //! One block per slot
+    std::vector<Block> blocks;
+    //! Allocation counters
+    ArenaStats counters;
+
+    /*!
+     * Makes sure a slot holds at least bytes
+     * @param slot The slot
+     * @param bytes Size needed in bytes
+     * @return The slot's block
+     */
+    Block &ensure(size_t slot, size_t bytes) {
+        if (slot >= blocks.size())
+            blocks.resize(slot + 1);
+        Block &block = blocks[slot];
+        if (block.capacity < bytes) {
+            if (block.data != nullptr)
+                ::operator delete(block.data, std::align_val_t(alignment));
+            counters.reserved_bytes -= block.capacity;
+            block.data = ::operator new(bytes, std::align_val_t(alignment));
+            block.capacity = bytes;
+            counters.reserved_bytes += bytes;
+            counters.allocations++;
+        }
+        return block;
+    }
+
+public:
+    ScratchArena() = default;
+
+    ~ScratchArena() {
+        release();
+    }
+
+    // Copies would share the blocks, a copied pipeline starts with an empty arena instead
+    ScratchArena(const ScratchArena &) : ScratchArena() {}
+
+    ScratchArena &operator=(const ScratchArena &other) {
+        if (this != &other)
+            release();
+        return *this;
+    }
+
+    ScratchArena(ScratchArena &&other) noexcept
+            : blocks(std::move(other.blocks)), counters(other.counters) {
+        other.blocks.clear();
+        other.counters = ArenaStats();
+    }
+
+    ScratchArena &operator=(ScratchArena &&other) noexcept {
+        if (this != &other) {
+            release();
+            blocks = std::move(other.blocks);
+            counters = other.counters;
+            other.blocks.clear();
+            other.counters = ArenaStats();
+        }
+        return *this;
+    }
+
+    /*!
+     * Grows a slot ahead of time, so the first frame doesn't allocate either
+     * @param slot The slot
+     * @param bytes Size reserved in bytes
+     */
+    void reserve(size_t slot, size_t bytes) {
+        ensure(slot, bytes);
+    }
+
+    /*!
+     * Gets a slot's buffer, valid until the slot is asked for a larger one or the arena is released
+     * @tparam T The element type
+     * @param slot The slot
+     * @param count Number of elements needed
+     * @return Pointer to at least count uninitialized elements, 64 byte aligned
+     */
+    template<typename T>
+    T *get(size_t slot, size_t count) {
+        counters.requests++;
+        return static_cast<T *>(ensure(slot, count == 0 ? 1 : count * sizeof(T)).data);
+    }
+
+    /*!
+     * Gets the capacity of a slot
+     * @param slot The slot
+     * @return The slot's size in bytes, 0 if it was never used
+     */
+    size_t capacity(size_t slot) const {
+        return slot < blocks.size() ? blocks[slot].capacity : 0;
+    }
+
+    //! Frees every slot, the counters other than reserved_bytes are kept
+    void release() {
+        for (Block &block : blocks)
+            if (block.data != nullptr)
+                ::operator delete(block.data, std::align_val_t(alignment));
+        blocks.clear();
+        counters.reserved_bytes = 0;
+    }
+
+    /*!
+     * Gets the allocation counters
+     * @return The counters
+     */
+    const ArenaStats &stats() const {
+        return counters;
+    }
+};
+
+#endif //EASYTFLITE_SCRATCHARENA_H
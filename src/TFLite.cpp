@@ -4,120 +4,739 @@
 
 #include "TFLite.h"
 
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <numeric>
 #include <tensorflow/lite/kernels/register.h>
+#ifdef EASYTFLITE_XNNPACK
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
+#endif
 #include <boost/filesystem.hpp>
 
 static void model_path_checker(const boost::filesystem::path &model_path) {
     if (!boost::filesystem::exists(model_path))
         LOG(FATAL) << "Error: Couldn't find model - " << model_path << '\n';
     if (model_path.extension() != ".tflite")
-        LOG(FATAL) << "Error: model doesn't have .tflite extension\n";
+        LOG(WARNING) << "Warning: model doesn't have .tflite extension\n";
 }
 
-TFLite::TFLite(const boost::filesystem::path &model_path) {
+TFLite::TFLite(const boost::filesystem::path &model_path, const ExecutionConfig &config) : execution_config(config) {
     // Build model
     build_model(model_path);
 
     // Build interpreter
-    tflite::ops::builtin::BuiltinOpResolver op_resolver;
-    build_interpreter(op_resolver);
+    owned_resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolver>();
+    build_interpreter(*owned_resolver);
 
-    // Allocate tensor buffers.
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
     allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
 }
 
-TFLite::TFLite(const boost::filesystem::path &model_path, const tflite::OpResolver &op_resolver) {
+TFLite::TFLite(const boost::filesystem::path &model_path, const tflite::OpResolver &op_resolver,
+               const ExecutionConfig &config) : execution_config(config) {
     // Build model
     build_model(model_path);
 
     // Build interpreter
     build_interpreter(op_resolver);
 
-    // Allocate tensor buffers.
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
     allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
 }
 
-TFLite::TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context) {
+TFLite::TFLite(const boost::filesystem::path &model_path, std::shared_ptr<const tflite::OpResolver> op_resolver,
+               const ExecutionConfig &config) : execution_config(config) {
     // Build model
     build_model(model_path);
 
-    // Build interpreter
-    tflite::ops::builtin::BuiltinOpResolver op_resolver;
-    build_interpreter(op_resolver);
+    // Build interpreter, the resolver is kept alive as long as this object
+    if (op_resolver == nullptr)
+        LOG(FATAL) << "Error: op resolver is null\n";
+    owned_resolver = std::move(op_resolver);
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
+               const ExecutionConfig &config) : external_context(external_context), execution_config(config) {
+    // Build model
+    build_model(model_path);
 
-    // Setting external context
-    interpreter->SetExternalContext(external_context.type, external_context.ctx);
+    // Build interpreter, the external context is set on every interpreter built
+    owned_resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolver>();
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
+               const tflite::OpResolver &op_resolver, const ExecutionConfig &config)
+        : external_context(external_context), execution_config(config) {
+    // Build model
+    build_model(model_path);
+
+    // Build interpreter, the external context is set on every interpreter built
+    build_interpreter(op_resolver);
 
-    // Allocate tensor buffers.
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
     allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
 }
 
 TFLite::TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
-               const tflite::OpResolver &op_resolver) {
+               std::shared_ptr<const tflite::OpResolver> op_resolver, const ExecutionConfig &config)
+        : external_context(external_context), execution_config(config) {
     // Build model
     build_model(model_path);
 
+    // Build interpreter, the external context is set on every interpreter built and the resolver is kept alive
+    if (op_resolver == nullptr)
+        LOG(FATAL) << "Error: op resolver is null\n";
+    owned_resolver = std::move(op_resolver);
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model, const ExecutionConfig &config)
+        : execution_config(config), model(std::move(shared_model)) {
+    if (model == nullptr)
+        LOG(FATAL) << "Error: shared model is null\n";
+
+    // Build interpreter
+    owned_resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolver>();
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model, const tflite::OpResolver &op_resolver,
+               const ExecutionConfig &config) : execution_config(config), model(std::move(shared_model)) {
+    if (model == nullptr)
+        LOG(FATAL) << "Error: shared model is null\n";
+
+    // Build interpreter
+    build_interpreter(op_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+               std::shared_ptr<const tflite::OpResolver> op_resolver, const ExecutionConfig &config)
+        : execution_config(config), model(std::move(shared_model)) {
+    if (model == nullptr)
+        LOG(FATAL) << "Error: shared model is null\n";
+
+    // Build interpreter, the resolver is kept alive as long as this object
+    if (op_resolver == nullptr)
+        LOG(FATAL) << "Error: op resolver is null\n";
+    owned_resolver = std::move(op_resolver);
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(const char *model_buffer, size_t buffer_size, const ExecutionConfig &config) : execution_config(config) {
+    // Build model
+    build_model(model_buffer, buffer_size);
+
+    // Build interpreter
+    owned_resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolver>();
+    build_interpreter(*owned_resolver);
+
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(const char *model_buffer, size_t buffer_size, const tflite::OpResolver &op_resolver,
+               const ExecutionConfig &config) : execution_config(config) {
+    // Build model
+    build_model(model_buffer, buffer_size);
+
     // Build interpreter
     build_interpreter(op_resolver);
 
-    // Setting external context
-    interpreter->SetExternalContext(external_context.type, external_context.ctx);
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
+    allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
+}
+
+TFLite::TFLite(const char *model_buffer, size_t buffer_size, std::shared_ptr<const tflite::OpResolver> op_resolver,
+               const ExecutionConfig &config) : execution_config(config) {
+    // Build model
+    build_model(model_buffer, buffer_size);
+
+    // Build interpreter, the resolver is kept alive as long as this object
+    if (op_resolver == nullptr)
+        LOG(FATAL) << "Error: op resolver is null\n";
+    owned_resolver = std::move(op_resolver);
+    build_interpreter(*owned_resolver);
 
-    // Allocate tensor buffers.
+    // Allocate tensor buffers, pick the fastest execution config for this host and warm up if asked
     allocate_tensors();
+    if (execution_config.autotune)
+        autotune();
+    if (execution_config.warmup_invokes > 0)
+        warmup(execution_config.warmup_invokes);
 }
 
-std::vector<int> TFLite::input_tensors() {
-    return interpreter->inputs();
+std::shared_ptr<const tflite::FlatBufferModel> TFLite::load_model(const boost::filesystem::path &model_path,
+                                                                  const ModelLoadOptions &options) {
+    // Check if file exists
+    model_path_checker(model_path);
+
+    // Shared models outlive any TFLite instance, the cache builds them with the process wide error reporter
+    return ModelCache::instance().get(model_path, options);
 }
 
-std::vector<int> TFLite::output_tensors() {
-    return interpreter->outputs();
+/*!
+ * Checks whether an interpreter's inputs have the given dimensions, without copying them
+ * @param interpreter The interpreter
+ * @param dims The dimensions of every input, in order
+ * @return Whether they all match
+ */
+static bool has_input_dims(const tflite::Interpreter &interpreter, const std::vector<std::vector<int>> &dims) {
+    const std::vector<int> &inputs = interpreter.inputs();
+    if (inputs.size() != dims.size())
+        return false;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const TfLiteIntArray *tensor_dims = interpreter.tensor(inputs[i])->dims;
+        if (!std::equal(tensor_dims->data, tensor_dims->data + tensor_dims->size, dims[i].begin(), dims[i].end()))
+            return false;
+    }
+    return true;
 }
 
-std::vector<int> TFLite::get_tensor_dims(int tensor_index) {
-    TfLiteIntArray *dims = interpreter->tensor(tensor_index)->dims;
-    std::vector<int> output(dims->size);
-    for (int i = 0; i < dims->size; i++)
-        output[i] = dims->data[i];
-    return output;
+void TFLite::resize_input_tensor(int tensor_index, const std::vector<int> &dims) {
+    set_input_shape(tensor_index, dims);
 }
 
-TfLiteType TFLite::get_tensor_type(int tensor_index) {
-    return interpreter->tensor(tensor_index)->type;
+void TFLite::set_input_shape(int tensor_index, const std::vector<int> &dims) {
+    const std::vector<int> &inputs = interpreter->inputs();
+    auto it = std::find(inputs.begin(), inputs.end(), tensor_index);
+    if (it == inputs.end())
+        LOG(FATAL) << "Error: tensor " << tensor_index << " is not an input tensor\n";
+
+    const TfLiteIntArray *tensor_dims = interpreter->tensor(tensor_index)->dims;
+    if (std::equal(tensor_dims->data, tensor_dims->data + tensor_dims->size, dims.begin(), dims.end()))
+        return;
+
+    std::vector<std::vector<int>> shapes;
+    for (int index : inputs)
+        shapes.push_back(get_tensor_dims(index));
+    shapes[it - inputs.begin()] = dims;
+    set_input_shapes(shapes);
 }
 
-int TFLite::get_tensor_element_count(int tensor_index) {
-    std::vector<int> dims = get_tensor_dims(tensor_index);
-    return std::accumulate(dims.begin(), dims.end(), 1, std::multiplies<>());
+void TFLite::set_input_shapes(const std::vector<std::vector<int>> &dims) {
+    if (dims.size() != interpreter->inputs().size())
+        LOG(FATAL) << "Error: got " << dims.size() << " input shapes for " << interpreter->inputs().size()
+                   << " inputs\n";
+    if (has_input_dims(*interpreter, dims))
+        return;
+
+    // Without a cache the current interpreter is reallocated in place, unless a delegate was applied for its shapes
+    if (max_cached_shapes == 0 && delegate == nullptr) {
+        for (size_t i = 0; i < dims.size(); i++)
+            if (interpreter->ResizeInputTensor(interpreter->inputs()[i], dims[i]) != kTfLiteOk)
+                LOG(FATAL) << "Error: Couldn't resize input tensor " << interpreter->inputs()[i] << '\n';
+        allocate_tensors();
+        return;
+    }
+
+    // Reuse the interpreter already allocated for these shapes, or build one
+    ShapedInterpreter next;
+    auto hit = std::find_if(shape_cache.begin(), shape_cache.end(), [&dims](const ShapedInterpreter &entry) {
+        return has_input_dims(*entry.interpreter, dims);
+    });
+    if (hit != shape_cache.end()) {
+        next = std::move(*hit);
+        shape_cache.erase(hit);
+    } else {
+        next.interpreter = make_interpreter();
+        for (size_t i = 0; i < dims.size(); i++)
+            if (next.interpreter->ResizeInputTensor(next.interpreter->inputs()[i], dims[i]) != kTfLiteOk)
+                LOG(FATAL) << "Error: Couldn't resize input tensor " << next.interpreter->inputs()[i] << '\n';
+        delegate_and_allocate(next);
+    }
+
+    // Park the current interpreter as the most recently used one, evicting the least recently used
+    shape_cache.push_front(ShapedInterpreter{std::move(delegate), std::move(interpreter), std::move(descriptors)});
+    while (shape_cache.size() > max_cached_shapes)
+        shape_cache.pop_back();
+    delegate = std::move(next.delegate);
+    interpreter = std::move(next.interpreter);
+    descriptors = std::move(next.descriptors);
+    apply_settings(*interpreter);
+}
+
+void TFLite::set_shape_cache_size(size_t max_shapes) {
+    max_cached_shapes = max_shapes;
+    while (shape_cache.size() > max_cached_shapes)
+        shape_cache.pop_back();
+}
+
+void TFLite::set_num_threads(int num_threads) {
+    if (num_threads == execution_config.num_threads)
+        return;
+    if (delegate != nullptr) {
+        ExecutionConfig config = execution_config;
+        config.num_threads = num_threads;
+        set_execution_config(config);
+        return;
+    }
+    execution_config.num_threads = num_threads;
+    interpreter->SetNumThreads(num_threads);
+}
+
+void TFLite::set_execution_config(const ExecutionConfig &config) {
+    std::vector<std::vector<int>> dims;
+    for (int index : interpreter->inputs())
+        dims.push_back(get_tensor_dims(index));
+
+    // The old interpreter goes before its delegate
+    shape_cache.clear();
+    interpreter.reset();
+    delegate.reset();
+
+    execution_config = config;
+    interpreter = make_interpreter();
+    for (size_t i = 0; i < dims.size(); i++)
+        if (interpreter->ResizeInputTensor(interpreter->inputs()[i], dims[i]) != kTfLiteOk)
+            LOG(FATAL) << "Error: Couldn't resize input tensor " << interpreter->inputs()[i] << '\n';
+    allocate_tensors();
+}
+
+const std::vector<int> &TFLite::input_tensors() const {
+    return model_inputs;
+}
+
+const std::vector<int> &TFLite::output_tensors() const {
+    return model_outputs;
+}
+
+const std::vector<int> &TFLite::get_tensor_dims(int tensor_index) const {
+    return tensor_descriptor(tensor_index).dims;
+}
+
+TfLiteType TFLite::get_tensor_type(int tensor_index) const {
+    return tensor_descriptor(tensor_index).type;
+}
+
+int TFLite::get_tensor_element_count(int tensor_index) const {
+    return tensor_descriptor(tensor_index).element_count;
+}
+
+const TensorDescriptor &TFLite::tensor_descriptor(int tensor_index) const {
+    if (tensor_index < 0 || static_cast<size_t>(tensor_index) >= descriptors.size())
+        LOG(FATAL) << "Error: tensor " << tensor_index << " doesn't exist\n";
+    return live_descriptor(tensor_index);
+}
+
+const TensorDescriptor &TFLite::tensor_descriptor(const std::string &name) const {
+    auto it = std::find_if(descriptors.begin(), descriptors.end(), [&name](const TensorDescriptor &descriptor) {
+        return descriptor.name == name;
+    });
+    if (it == descriptors.end())
+        LOG(FATAL) << "Error: the model has no tensor named " << name << '\n';
+    return live_descriptor(it->index);
+}
+
+void TFLite::bind_input_buffer(int tensor_index, void *buffer, size_t bytes) {
+    const std::vector<int> &inputs = input_tensors();
+    if (std::find(inputs.begin(), inputs.end(), tensor_index) == inputs.end())
+        LOG(FATAL) << "Error: tensor " << tensor_index << " is not an input tensor\n";
+    if (reinterpret_cast<std::uintptr_t>(buffer) % tensor_alignment != 0)
+        LOG(FATAL) << "Error: bound buffer must be aligned to " << tensor_alignment << " bytes\n";
+    if (bytes < interpreter->tensor(tensor_index)->bytes)
+        LOG(FATAL) << "Error: bound buffer is smaller than input tensor " << tensor_index << '\n';
+
+    TfLiteCustomAllocation allocation = {buffer, bytes};
+    if (interpreter->SetCustomAllocationForTensor(tensor_index, allocation) != kTfLiteOk)
+        LOG(FATAL) << "Error: Couldn't bind buffer to input tensor " << tensor_index << '\n';
+
+    // The arena plan has to be recomputed for the custom allocation to take effect
+    allocate_tensors();
+}
+
+const QuantizationParams &TFLite::get_quantization(int tensor_index) {
+    return tensor_descriptor(tensor_index).quantization;
+}
+
+void TFLite::fill_tensor_quantized(const float *data, int tensor_index) {
+    ScopedStage stage(profiler.get(), "fill", metrics.get());
+    TfLiteTensor *tensor = interpreter->tensor(tensor_index);
+    switch (tensor->type) {
+        case kTfLiteFloat32:
+            std::copy_n(data, get_tensor_element_count(tensor_index), tensor->data.f);
+            break;
+        case kTfLiteFloat16:
+            to_half(data, tensor->data.f16, get_tensor_element_count(tensor_index));
+            break;
+        case kTfLiteUInt8:
+            quantize_tensor(data, tensor->data.uint8, tensor_index);
+            break;
+        case kTfLiteInt8:
+            quantize_tensor(data, tensor->data.int8, tensor_index);
+            break;
+        case kTfLiteInt16:
+            quantize_tensor(data, tensor->data.i16, tensor_index);
+            break;
+        default:
+            LOG(FATAL) << "Error: cannot fill tensor " << tensor_index << " of type " << tensor->type
+                       << " from float data\n";
+    }
+}
+
+void TFLite::get_tensor_dequantized(int tensor_index, float *output) {
+    ScopedStage stage(profiler.get(), "output_copy", metrics.get());
+    const TfLiteTensor *tensor = interpreter->tensor(tensor_index);
+    switch (tensor->type) {
+        case kTfLiteFloat32:
+            std::copy_n(tensor->data.f, get_tensor_element_count(tensor_index), output);
+            break;
+        case kTfLiteFloat16:
+            from_half(tensor->data.f16, output, get_tensor_element_count(tensor_index));
+            break;
+        case kTfLiteUInt8:
+            dequantize_tensor(tensor->data.uint8, output, tensor_index);
+            break;
+        case kTfLiteInt8:
+            dequantize_tensor(tensor->data.int8, output, tensor_index);
+            break;
+        case kTfLiteInt16:
+            dequantize_tensor(tensor->data.i16, output, tensor_index);
+            break;
+        default:
+            LOG(FATAL) << "Error: cannot read tensor " << tensor_index << " of type " << tensor->type
+                       << " as float data\n";
+    }
+}
+
+void TFLite::get_tensor_dequantized(int tensor_index, std::vector<float> &output) {
+    output.resize(get_tensor_element_count(tensor_index));
+    get_tensor_dequantized(tensor_index, output.data());
 }
 
 void TFLite::invoke() {
-    if (interpreter->Invoke() != kTfLiteOk)
-        LOG(ERROR) << "Error: Interpreter's invocation failed";
+    {
+        ScopedStage stage(profiler.get(), "invoke", metrics.get());
+        TfLiteStatus status = interpreter->Invoke();
+        if (metrics != nullptr) {
+            metrics->invokes.increment();
+            if (status != kTfLiteOk)
+                metrics->invoke_failures.increment();
+        }
+        if (status != kTfLiteOk)
+            LOG(ERROR) << "Error: Interpreter's invocation failed";
+    }
+    if (profiler != nullptr)
+        profiler->collect_op_events();
+}
+
+void TFLite::enable_profiling(size_t max_events) {
+    profiler = std::make_unique<InferenceProfiler>(max_events);
+    interpreter->SetProfiler(profiler->interpreter_profiler());
+}
+
+void TFLite::disable_profiling() {
+    interpreter->SetProfiler(nullptr);
+    profiler.reset();
+}
+
+void TFLite::reset_profiling() {
+    if (profiler != nullptr)
+        profiler->reset();
+}
+
+ProfileSummary TFLite::profiling_summary(size_t top_n) const {
+    if (profiler == nullptr)
+        return ProfileSummary();
+    return profiler->summary(top_n);
+}
+
+std::string TFLite::profiling_chrome_trace() const {
+    if (profiler == nullptr)
+        return "{\"traceEvents\":[]}";
+    return profiler->chrome_trace_json();
+}
+
+void TFLite::enable_metrics(const std::string &model_name, MetricsRegistry &registry) {
+    metrics = std::make_unique<ModelMetrics>(registry, model_name);
+}
+
+void TFLite::disable_metrics() {
+    metrics.reset();
 }
 
 void TFLite::build_model(const boost::filesystem::path &model_path) {
     // Check if file exists
     model_path_checker(model_path);
 
-    // Build model
+    // Build model, or share the one already mapped by another instance
     LOG(INFO) << "Building model from file\n";
-    model = tflite::FlatBufferModel::BuildFromFile(model_path.string().c_str(), &error_reporter);
+    model = ModelCache::instance().get(model_path);
+}
+
+void TFLite::build_model(const char *model_buffer, size_t buffer_size) {
+    if (model_buffer == nullptr)
+        LOG(FATAL) << "Error: model buffer is null\n";
+
+    // Build model, the buffer stays owned by the caller
+    LOG(INFO) << "Building model from buffer\n";
+    model = tflite::FlatBufferModel::BuildFromBuffer(model_buffer, buffer_size, &error_reporter);
     if (model == nullptr)
-        LOG(FATAL) << "Error: Couldn't Build FlatBufferModel from file\n";
+        LOG(FATAL) << "Error: Couldn't Build FlatBufferModel from buffer\n";
 }
 
 void TFLite::build_interpreter(const tflite::OpResolver &op_resolver) {
+    resolver = &op_resolver;
+    interpreter = make_interpreter();
+}
+
+std::unique_ptr<tflite::Interpreter> TFLite::make_interpreter() {
     LOG(INFO) << "Building interpreter from model\n";
-    tflite::InterpreterBuilder builder(*model, op_resolver);
-    auto res = builder(&interpreter);
-    if (interpreter == nullptr || res != kTfLiteOk)
+    std::unique_ptr<tflite::Interpreter> new_interpreter;
+    tflite::InterpreterBuilder builder(*model, *resolver);
+    auto res = builder(&new_interpreter);
+    if (new_interpreter == nullptr || res != kTfLiteOk)
         LOG(FATAL) << "Error: Couldn't Build Interpreter from FlatBufferModel\n";
+
+    if (external_context.ctx != nullptr)
+        new_interpreter->SetExternalContext(external_context.type, external_context.ctx);
+    apply_settings(*new_interpreter);
+    return new_interpreter;
+}
+
+void TFLite::apply_settings(tflite::Interpreter &target) {
+    if (execution_config.num_threads != -1)
+        target.SetNumThreads(execution_config.num_threads);
+    target.SetAllowFp16PrecisionForFp32(execution_config.allow_fp16);
+    target.SetProfiler(profiler == nullptr ? nullptr : profiler->interpreter_profiler());
+}
+
+void TFLite::DelegateDeleter::operator()([[maybe_unused]] TfLiteDelegate *delegate) const {
+#ifdef EASYTFLITE_XNNPACK
+    TfLiteXNNPackDelegateDelete(delegate);
+#endif
+}
+
+void TFLite::delegate_and_allocate(ShapedInterpreter &entry) {
+    // Held while XNNPACK packs weights into a new cache file, released once the tensors are allocated
+    std::unique_ptr<FileLock> weight_cache_lock;
+    if (execution_config.use_xnnpack && entry.delegate == nullptr) {
+#ifdef EASYTFLITE_XNNPACK
+        TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+        options.num_threads = execution_config.num_threads > 0 ? execution_config.num_threads :
+                              static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        // A restarted process maps the weights packed by the previous one instead of packing them again. Until the
+        // file exists, whoever packs holds its lock through allocation, others wait and then map what it wrote.
+        std::string weight_cache;
+        if (!execution_config.xnnpack_weight_cache.empty()) {
+#ifdef EASYTFLITE_XNNPACK_WEIGHT_CACHE
+            weight_cache = xnnpack_weight_cache_path(execution_config, get_model_fingerprint()).string();
+            if (!boost::filesystem::exists(weight_cache))
+                weight_cache_lock = std::make_unique<FileLock>(weight_cache + ".lock");
+            options.weight_cache_file_path = weight_cache.c_str();
+#else
+            LOG(WARNING) << "Warning: an XNNPACK weight cache was requested but EasyTFLite was built without "
+                            "WITH_XNNPACK_WEIGHT_CACHE\n";
+#endif
+        }
+        entry.delegate.reset(TfLiteXNNPackDelegateCreate(&options));
+        if (entry.interpreter->ModifyGraphWithDelegate(entry.delegate.get()) != kTfLiteOk)
+            LOG(FATAL) << "Error: Couldn't apply the XNNPACK delegate\n";
+#else
+        LOG(WARNING) << "Warning: XNNPACK was requested but EasyTFLite was built without WITH_XNNPACK\n";
+        execution_config.use_xnnpack = false;
+#endif
+    }
+    if (entry.interpreter->AllocateTensors() != kTfLiteOk)
+        LOG(FATAL) << "Couldn't allocate tensor buffers\n";
+    build_descriptors(entry);
+}
+
+void TFLite::build_descriptors(ShapedInterpreter &entry) {
+    const tflite::Interpreter &target = *entry.interpreter;
+    entry.descriptors.resize(target.tensors_size());
+    for (size_t i = 0; i < target.tensors_size(); i++) {
+        const TfLiteTensor *tensor = target.tensor(static_cast<int>(i));
+        TensorDescriptor &descriptor = entry.descriptors[i];
+        descriptor.index = static_cast<int>(i);
+        descriptor.name = tensor->name != nullptr ? tensor->name : "";
+        descriptor.type = tensor->type;
+        descriptor.quantization = QuantizationParams::from_tensor(*tensor);
+        descriptor.dynamic = tensor->allocation_type == kTfLiteDynamic;
+        read_allocation(*tensor, descriptor);
+    }
+}
+
+void TFLite::read_allocation(const TfLiteTensor &tensor, TensorDescriptor &descriptor) {
+    // Assigning in place keeps the vector's capacity, so reading a dynamic tensor again rarely allocates
+    descriptor.dims.clear();
+    if (tensor.dims != nullptr)
+        descriptor.dims.assign(tensor.dims->data, tensor.dims->data + tensor.dims->size);
+    descriptor.element_count = std::accumulate(descriptor.dims.begin(), descriptor.dims.end(), 1,
+                                               std::multiplies<>());
+    descriptor.bytes = tensor.bytes;
+    descriptor.data = tensor.data.raw;
 }
 
 void TFLite::allocate_tensors() {
     LOG(INFO) << "Allocating tensor buffers\n";
-    if (interpreter->AllocateTensors() != kTfLiteOk)
-        LOG(FATAL) << "Couldn't allocate tensor buffers\n";
+    ShapedInterpreter current{std::move(delegate), std::move(interpreter), std::move(descriptors)};
+    delegate_and_allocate(current);
+    delegate = std::move(current.delegate);
+    interpreter = std::move(current.interpreter);
+    descriptors = std::move(current.descriptors);
+    model_inputs = interpreter->inputs();
+    model_outputs = interpreter->outputs();
+}
+
+void TFLite::autotune() {
+    // Results depend on the model, the host's cores and the precision
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t key = get_model_fingerprint() ^ (cores * 0x9E3779B97F4A7C15ULL) ^ (execution_config.allow_fp16 ? 1 : 0);
+    boost::filesystem::path cache_path = autotune_cache_path(execution_config);
+    ExecutionConfig best = execution_config;
+    if (load_autotune_result(cache_path, key, best)) {
+        LOG(INFO) << "Using cached autotune result, " << best.num_threads << " threads"
+                  << (best.use_xnnpack ? " with XNNPACK\n" : "\n");
+        set_execution_config(best);
+        return;
+    }
+
+    std::vector<int> threads = execution_config.autotune_threads;
+    if (threads.empty()) {
+        for (unsigned int n = 1; n < cores; n *= 2)
+            threads.push_back(static_cast<int>(n));
+        threads.push_back(static_cast<int>(cores));
+    }
+    std::vector<bool> xnnpack = {false};
+#ifdef EASYTFLITE_XNNPACK
+    xnnpack.push_back(true);
+#endif
+
+    double best_time = std::numeric_limits<double>::infinity();
+    for (bool use_xnnpack : xnnpack)
+        for (int n_threads : threads) {
+            ExecutionConfig candidate = execution_config;
+            candidate.num_threads = n_threads;
+            candidate.use_xnnpack = use_xnnpack;
+            set_execution_config(candidate);
+            double time = time_invokes(execution_config.autotune_invokes);
+            LOG(INFO) << "Autotune: " << n_threads << " threads" << (use_xnnpack ? " with XNNPACK" : "") << ", "
+                      << time * 1000.0 << " ms\n";
+            if (time < best_time) {
+                best_time = time;
+                best = candidate;
+            }
+        }
+
+    set_execution_config(best);
+    store_autotune_result(cache_path, key, best);
+}
+
+double TFLite::time_invokes(int n_invokes) {
+    fill_synthetic_inputs();
+    if (interpreter->Invoke() != kTfLiteOk)
+        LOG(FATAL) << "Error: Couldn't invoke interpreter while autotuning\n";
+
+    std::vector<double> times;
+    for (int i = 0; i < std::max(1, n_invokes); i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (interpreter->Invoke() != kTfLiteOk)
+            LOG(FATAL) << "Error: Couldn't invoke interpreter while autotuning\n";
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+void TFLite::fill_synthetic_inputs() {
+    for (int index : interpreter->inputs()) {
+        TfLiteTensor *tensor = interpreter->tensor(index);
+        if (tensor->type != kTfLiteFloat32) {
+            // Integer inputs may be indices or lengths, zero is always valid
+            std::fill_n(tensor->data.raw, tensor->bytes, 0);
+            continue;
+        }
+        // A ramp between -1 and 1 instead of zeros, so kernels with data dependent paths take the usual ones
+        size_t n_elements = tensor->bytes / sizeof(float);
+        for (size_t i = 0; i < n_elements; i++)
+            tensor->data.f[i] = static_cast<float>(i % 256) / 127.5f - 1.0f;
+    }
+}
+
+void TFLite::warmup(int n_invokes) {
+    // The profiler is detached so its op events only hold real invokes
+    interpreter->SetProfiler(nullptr);
+    fill_synthetic_inputs();
+    std::vector<double> times;
+    for (int i = 0; i < n_invokes; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (interpreter->Invoke() != kTfLiteOk)
+            LOG(FATAL) << "Error: Couldn't invoke interpreter while warming up\n";
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    interpreter->SetProfiler(profiler == nullptr ? nullptr : profiler->interpreter_profiler());
+    if (!times.empty())
+        LOG(INFO) << "Warm-up: first invoke " << times.front() * 1000.0 << " ms, last " << times.back() * 1000.0
+                  << " ms\n";
+}
+
+uint64_t TFLite::get_model_fingerprint() {
+    if (fingerprint == 0)
+        fingerprint = shared_model_fingerprint(model);
+    return fingerprint;
 }
@@ -5,13 +5,22 @@
 #ifndef EASYTFLITE_TFLITE_H
 #define EASYTFLITE_TFLITE_H
 
+#include "ModelCache.h"
+#include "ExecutionConfig.h"
+#include "Profiling.h"
+#include "Quantization.h"
+#include "TensorBufferPool.h"
+#include "TensorDescriptor.h"
+
 #include <map>
+#include <list>
+#include <array>
 #include <memory>
 #include <vector>
+#include <cstdint>
+#include <algorithm>
 #include <glog/logging.h>
 #include <boost/filesystem/path.hpp>
-#include <boost/variant/variant.hpp>
-#include <boost/mpl/contains.hpp>
 #include <tensorflow/lite/model.h>
 #include <tensorflow/lite/interpreter.h>
 #include <tensorflow/lite/op_resolver.h>
@@ -25,6 +34,48 @@ struct ExternalContextPair {
     TfLiteExternalContext *ctx;
 };
 
+//! Maps a C++ element type to the TfLiteType enum used by the interpreter
+template<typename T>
+struct TensorTypeOf;
+
+template<>
+struct TensorTypeOf<float> {
+    static constexpr TfLiteType value = kTfLiteFloat32;
+};
+
+template<>
+struct TensorTypeOf<uint8_t> {
+    static constexpr TfLiteType value = kTfLiteUInt8;
+};
+
+template<>
+struct TensorTypeOf<int8_t> {
+    static constexpr TfLiteType value = kTfLiteInt8;
+};
+
+template<>
+struct TensorTypeOf<int16_t> {
+    static constexpr TfLiteType value = kTfLiteInt16;
+};
+
+template<>
+struct TensorTypeOf<TfLiteFloat16> {
+    static constexpr TfLiteType value = kTfLiteFloat16;
+};
+
+//! True when T has a TensorTypeOf, so it can be the element type of a tensor
+template<typename T, typename = void>
+struct is_tensor_type : std::false_type {
+};
+
+template<typename T>
+struct is_tensor_type<T, std::void_t<decltype(TensorTypeOf<T>::value)>> : std::true_type {
+};
+
+//! A writable, row-major view over tensor memory owned by the interpreter (or bound by the caller)
+template<typename T, int Rank>
+using TensorView = Eigen::TensorMap<Eigen::Tensor<T, Rank, Eigen::RowMajor>>;
+
 //! The TFLite class wraps Tensorflow Lite
 /*!
  * This class abstracts and interfaces with Tensorflow Lite, taking care of any small details required to use it.
@@ -33,80 +84,441 @@ struct ExternalContextPair {
  */
 class TFLite {
     /*!
-    * Build the FlatBufferModel from a FlatBuffer Tensorflow Lite file
+    * Build the FlatBufferModel from a FlatBuffer Tensorflow Lite file, the file is mapped once through ModelCache and
+    * shared with every other instance using the same file
     * @param model_path The boost path to the FlatBuffer Tensorflow Lite file
     */
     void build_model(const boost::filesystem::path &model_path);
 
+    /*!
+    * Build the FlatBufferModel from a FlatBuffer Tensorflow Lite model in memory
+    * @param model_buffer Pointer to the model, owned by the caller
+    * @param buffer_size Size of the model in bytes
+    */
+    void build_model(const char *model_buffer, size_t buffer_size);
+
     /*!
      * Builds the interpreter, It is required for the model private variable be build before running this
-     * @param op_resolver The op resolver
+     * @param op_resolver The op resolver, kept to build interpreters for other input shapes
      */
     void build_interpreter(const tflite::OpResolver &op_resolver);
 
+    //! Frees a delegate created for an interpreter
+    struct DelegateDeleter {
+        void operator()(TfLiteDelegate *delegate) const;
+    };
+
+    //! A delegate owned alongside the interpreter it was applied to
+    using DelegatePtr = std::unique_ptr<TfLiteDelegate, DelegateDeleter>;
+
+    //! An interpreter, its delegate and its tensor descriptors, the delegate outlives the interpreter
+    struct ShapedInterpreter {
+        //! The delegate applied to the interpreter, null without one
+        DelegatePtr delegate;
+        //! The interpreter
+        std::unique_ptr<tflite::Interpreter> interpreter;
+        //! Descriptors of every tensor of the interpreter, by tensor index
+        std::vector<TensorDescriptor> descriptors;
+    };
+
+    /*!
+     * Builds a new interpreter from the model with the stored op resolver, external context and settings
+     * @return The interpreter, its tensors aren't allocated
+     */
+    std::unique_ptr<tflite::Interpreter> make_interpreter();
+
+    /*!
+     * Applies the thread count, precision and profiler to an interpreter, done whenever an interpreter becomes the
+     * current one
+     * @param target The interpreter
+     */
+    void apply_settings(tflite::Interpreter &target);
+
+    /*!
+     * Applies the delegate the execution config asks for to an interpreter whose input shapes are final, then
+     * allocates its tensors
+     * @param entry The interpreter, its delegate is set
+     */
+    void delegate_and_allocate(ShapedInterpreter &entry);
+
+    /*!
+     * Reads the descriptors of every tensor of an interpreter whose tensors are allocated
+     * @param entry The interpreter, its descriptors are rebuilt
+     */
+    static void build_descriptors(ShapedInterpreter &entry);
+
+    /*!
+     * Reads the parts of a descriptor that change when a tensor is reallocated
+     * @param tensor The tensor
+     * @param descriptor Its descriptor, dims, element count, bytes and data are updated
+     */
+    static void read_allocation(const TfLiteTensor &tensor, TensorDescriptor &descriptor);
+
+    /*!
+     * Gets a descriptor without checking the index, reading a dynamic tensor's allocation again
+     * @param tensor_index Index of the tensor
+     * @return The descriptor
+     */
+    const TensorDescriptor &live_descriptor(int tensor_index) const {
+        TensorDescriptor &descriptor = descriptors[tensor_index];
+        if (descriptor.dynamic)
+            read_allocation(*interpreter->tensor(tensor_index), descriptor);
+        return descriptor;
+    }
+
     /*!
-     * Allocates tensors, runs interpreter->AllocateTensors()
+     * Allocates the current interpreter's tensors, applying its delegate first if it has none yet
      */
     void allocate_tensors();
 
+    /*!
+     * Times the candidate execution configs on the current input shapes and keeps the fastest, or the one cached on
+     * disk for this model and host
+     */
+    void autotune();
+
+    /*!
+     * Times invokes of the current interpreter on synthetic inputs
+     * @param n_invokes Timed invokes, after one warm-up invoke
+     * @return The median invoke time in seconds
+     */
+    double time_invokes(int n_invokes);
+
+    /*!
+     * Fills the current interpreter's inputs with synthetic data, a ramp between -1 and 1 for float inputs and zeros
+     * for the others
+     */
+    void fill_synthetic_inputs();
+
+    /*!
+     * Checks that tensor_index is one of the model's input tensors and that its type matches T, stops otherwise
+     * @tparam T The expected element type
+     * @param tensor_index Index of the tensor to check
+     */
+    template<typename T>
+    void check_input_tensor(int tensor_index) {
+        const std::vector<int> &inputs = input_tensors();
+        if (std::find(inputs.begin(), inputs.end(), tensor_index) == inputs.end())
+            LOG(FATAL) << "Error: tensor " << tensor_index << " is not an input tensor\n";
+        if (get_tensor_type(tensor_index) != TensorTypeOf<T>::value)
+            LOG(FATAL) << "Error: input tensor " << tensor_index << " has type " << get_tensor_type(tensor_index)
+                       << " which does not match the requested type\n";
+    }
+
+    /*!
+     * Quantizes float data into an integer tensor using the tensor's own quantization parameters
+     * @tparam T The tensor's integer type
+     * @param data The float data, as many values as the tensor has elements
+     * @param output The tensor's memory
+     * @param tensor_index Index of the tensor
+     */
+    template<typename T>
+    void quantize_tensor(const float *data, T *output, int tensor_index) {
+        const QuantizationParams &params = get_quantization(tensor_index);
+        if (!params.quantized())
+            LOG(FATAL) << "Error: tensor " << tensor_index << " is an integer tensor without quantization parameters\n";
+        if (params.per_channel())
+            quantize(data, output, get_tensor_dims(tensor_index), params);
+        else
+            quantize(data, output, get_tensor_element_count(tensor_index), params.scales[0], params.zero_points[0]);
+    }
+
+    /*!
+     * Dequantizes an integer tensor into float data using the tensor's own quantization parameters
+     * @tparam T The tensor's integer type
+     * @param input The tensor's memory
+     * @param output Where the float data is written, as many values as the tensor has elements
+     * @param tensor_index Index of the tensor
+     */
+    template<typename T>
+    void dequantize_tensor(const T *input, float *output, int tensor_index) {
+        const QuantizationParams &params = get_quantization(tensor_index);
+        if (!params.quantized())
+            LOG(FATAL) << "Error: tensor " << tensor_index << " is an integer tensor without quantization parameters\n";
+        if (params.per_channel())
+            dequantize(input, output, get_tensor_dims(tensor_index), params);
+        else
+            dequantize(input, output, get_tensor_element_count(tensor_index), params.scales[0], params.zero_points[0]);
+    }
+
+    /*!
+     * Checks that a tensor's type matches T and its rank matches Rank, stops otherwise
+     * @tparam T The expected element type
+     * @tparam Rank The expected rank
+     * @param tensor_index Index of the tensor to check
+     * @return The tensor's dimensions
+     */
+    template<typename T, int Rank>
+    Eigen::array<Eigen::Index, Rank> check_tensor(int tensor_index) {
+        const TfLiteTensor *tensor = interpreter->tensor(tensor_index);
+        if (tensor->type != TensorTypeOf<T>::value)
+            LOG(FATAL) << "Error: tensor " << tensor_index << " has type " << tensor->type
+                       << " which does not match the requested type\n";
+        if (tensor->dims->size != Rank)
+            LOG(FATAL) << "Error: number of dimensions in model does not match template variable Rank\n";
+        Eigen::array<Eigen::Index, Rank> dims;
+        std::copy(tensor->dims->data, tensor->dims->data + Rank, dims.begin());
+        return dims;
+    }
+
+    //! The op resolver built by constructors that don't take one, or the one handed over to them
+    std::shared_ptr<const tflite::OpResolver> owned_resolver;
+    //! The op resolver interpreters are built with, either owned_resolver or the caller's, which must outlive this
+    const tflite::OpResolver *resolver = nullptr;
+    //! The external context set on every interpreter, unused when its ctx is null
+    ExternalContextPair external_context = {kTfLiteEigenContext, nullptr};
+    //! Threads, delegate and precision of every interpreter built
+    ExecutionConfig execution_config;
+    //! The model's fingerprint, 0 until it is first needed
+    uint64_t fingerprint = 0;
+    //! The delegate applied to the current interpreter, declared first so it outlives it
+    DelegatePtr delegate;
+    //! Descriptors of every tensor of the current interpreter, by tensor index, rebuilt when its shapes change. Those
+    //! of dynamic tensors are updated on read.
+    mutable std::vector<TensorDescriptor> descriptors;
+    //! Indexes of the input tensors, the same for every interpreter of the model
+    std::vector<int> model_inputs;
+    //! Indexes of the output tensors, the same for every interpreter of the model
+    std::vector<int> model_outputs;
+    //! Most input shapes kept allocated besides the current one
+    size_t max_cached_shapes = 3;
+
 protected:
+    //! Recycles the storage of stable tensor copies, created on first use
+    std::shared_ptr<TensorBufferPool> buffer_pool;
     //! An error reporting object
     tflite::StderrReporter error_reporter;
-    //! Contains the model information, must be alive for the life of the interpreter
-    std::unique_ptr<tflite::FlatBufferModel> model;
+    //! Contains the model information, must be alive for the life of the interpreter, may be shared between instances
+    std::shared_ptr<const tflite::FlatBufferModel> model;
+    //! Records operator and stage timings, null unless profiling is enabled. Outlives the interpreter it is attached to
+    std::unique_ptr<InferenceProfiler> profiler;
+    //! Invoke counts and stage and entry point latencies, null unless metrics are enabled
+    std::unique_ptr<ModelMetrics> metrics;
     //! The Tensorflow Lite interpreter
     std::unique_ptr<tflite::Interpreter> interpreter;
+    //! Interpreters parked with their tensors allocated for recently used input shapes, most recently used first
+    std::list<ShapedInterpreter> shape_cache;
 
 public:
+    //! Alignment in bytes required by the interpreter for externally bound tensor buffers
+    static constexpr size_t tensor_alignment = 64;
+
     /*!
      * This function initialized TFLite with the built-in Ops.
      * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
      */
-    explicit TFLite(const boost::filesystem::path &model_path);
+    explicit TFLite(const boost::filesystem::path &model_path, const ExecutionConfig &config = ExecutionConfig());
 
     /*!
      * You can use this function, and define your own OpResolver for custom operators.
      * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
      * @param op_resolver An instance that implements the OpResolver interface. (You can have a custom
-     * Resolver with custom ops)
+     * Resolver with custom ops) It isn't copied and must outlive this object, new input shapes, set_execution_config
+     * and autotune build interpreters with it. The std::shared_ptr overload hands it over instead.
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(const boost::filesystem::path &model_path, const tflite::OpResolver &op_resolver,
+           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Same as the constructor taking an OpResolver reference, but the resolver is kept alive by this object
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param op_resolver An instance that implements the OpResolver interface, owned along with this object
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
      */
-    TFLite(const boost::filesystem::path &model_path, const tflite::OpResolver &op_resolver);
+    TFLite(const boost::filesystem::path &model_path, std::shared_ptr<const tflite::OpResolver> op_resolver,
+           const ExecutionConfig &config = ExecutionConfig());
 
     /*!
      * You can use this constructor to also set the external context (e.g. EdgeTPU)
      * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
      * @param external_context The external context (e.g. EdgeTPU)
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
      */
-    TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context);
+    TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
+           const ExecutionConfig &config = ExecutionConfig());
 
     /*!
      * You can use this constructor to also set the external context and a custom OpResolver
      * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
      * @param external_context The external context (e.g. EdgeTPU)
      * @param op_resolver An instance that implements the OpResolver interface. (You can have a custom
-     * Resolver with custom ops)
+     * Resolver with custom ops) It isn't copied and must outlive this object, new input shapes, set_execution_config
+     * and autotune build interpreters with it. The std::shared_ptr overload hands it over instead.
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
+           const tflite::OpResolver &op_resolver, const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Same as the constructor taking an OpResolver reference, but the resolver is kept alive by this object
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param external_context The external context (e.g. EdgeTPU)
+     * @param op_resolver An instance that implements the OpResolver interface, owned along with this object
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
      */
     TFLite(const boost::filesystem::path &model_path, const ExternalContextPair &external_context,
-           const tflite::OpResolver &op_resolver);
+           std::shared_ptr<const tflite::OpResolver> op_resolver, const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Builds an interpreter with the built-in Ops from an already loaded model. The model is immutable, so any number
+     * of TFLite instances can share it without loading or parsing the file again.
+     * @param shared_model A model loaded with TFLite::load_model
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    explicit TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                    const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Builds an interpreter from an already loaded model with a custom OpResolver
+     * @param shared_model A model loaded with TFLite::load_model
+     * @param op_resolver An instance that implements the OpResolver interface. (You can have a custom
+     * Resolver with custom ops) It isn't copied and must outlive this object, new input shapes, set_execution_config
+     * and autotune build interpreters with it. The std::shared_ptr overload hands it over instead.
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model, const tflite::OpResolver &op_resolver,
+           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Same as the constructor taking an OpResolver reference, but the resolver is kept alive by this object
+     * @param shared_model A model loaded with TFLite::load_model
+     * @param op_resolver An instance that implements the OpResolver interface, owned along with this object
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+           std::shared_ptr<const tflite::OpResolver> op_resolver, const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Builds an interpreter with the built-in Ops from a model in memory, for instance one embedded in the binary or
+     * received over the network. The buffer is not copied, it must outlive this object.
+     * @param model_buffer Pointer to the FlatBuffer Tensorflow Lite model
+     * @param buffer_size Size of the model in bytes
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(const char *model_buffer, size_t buffer_size, const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Builds an interpreter from a model in memory with a custom OpResolver. The buffer is not copied, it must outlive
+     * this object.
+     * @param model_buffer Pointer to the FlatBuffer Tensorflow Lite model
+     * @param buffer_size Size of the model in bytes
+     * @param op_resolver An instance that implements the OpResolver interface. (You can have a custom
+     * Resolver with custom ops) It isn't copied and must outlive this object, new input shapes, set_execution_config
+     * and autotune build interpreters with it. The std::shared_ptr overload hands it over instead.
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(const char *model_buffer, size_t buffer_size, const tflite::OpResolver &op_resolver,
+           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Same as the constructor taking an OpResolver reference, but the resolver is kept alive by this object. The
+     * buffer is not copied, it must outlive this object.
+     * @param model_buffer Pointer to the FlatBuffer Tensorflow Lite model
+     * @param buffer_size Size of the model in bytes
+     * @param op_resolver An instance that implements the OpResolver interface, owned along with this object
+     * @param config How the interpreter executes, threads, delegate, precision and autotuning
+     */
+    TFLite(const char *model_buffer, size_t buffer_size, std::shared_ptr<const tflite::OpResolver> op_resolver,
+           const ExecutionConfig &config = ExecutionConfig());
+
+    /*!
+     * Loads a FlatBuffer Tensorflow Lite model so it can be shared between several TFLite instances. The model comes
+     * from the process wide ModelCache, so loading the same file twice maps it once.
+     * @param model_path A boost path object containing the path to the Tensorflow Lite Flatbuffer model
+     * @param options How the file is mapped if it isn't in the cache yet
+     * @return The loaded model
+     */
+    static std::shared_ptr<const tflite::FlatBufferModel> load_model(const boost::filesystem::path &model_path,
+                                                                     const ModelLoadOptions &options = ModelLoadOptions());
+
+    /*!
+     * Resizes an input tensor, for instance its batch dimension, same as set_input_shape
+     * @param tensor_index Index of the input tensor to resize
+     * @param dims The new dimensions
+     */
+    void resize_input_tensor(int tensor_index, const std::vector<int> &dims);
+
+    /*!
+     * Sets the shape of an input tensor, for models that accept several resolutions or batch sizes. Nothing happens
+     * when the shape is the current one. Otherwise the current interpreter is parked and an interpreter allocated for
+     * the new shapes becomes current, either one parked earlier or a newly built one. Switching between a handful of
+     * shapes therefore doesn't allocate tensors again, see set_shape_cache_size. Pointers and views to tensors, and
+     * buffers bound with bind_input_buffer, belong to the interpreter of the shape they were taken with.
+     * @param tensor_index Index of the input tensor
+     * @param dims The new dimensions
+     */
+    void set_input_shape(int tensor_index, const std::vector<int> &dims);
+
+    /*!
+     * Sets the shapes of every input tensor at once, see set_input_shape
+     * @param dims The dimensions of every input, in the order of input_tensors()
+     */
+    void set_input_shapes(const std::vector<std::vector<int>> &dims);
+
+    /*!
+     * Sets how many input shapes are kept allocated besides the current one, 3 by default. Each keeps its own
+     * interpreter and tensor arena. With 0 the current interpreter is reallocated on every shape change.
+     * @param max_shapes Most parked shapes
+     */
+    void set_shape_cache_size(size_t max_shapes);
+
+    /*!
+     * Sets the number of threads the interpreter's kernels may use. A delegate's threads are set when it is created, so
+     * with one attached the interpreter is rebuilt through set_execution_config.
+     * @param num_threads Number of threads, -1 lets Tensorflow Lite decide
+     */
+    void set_num_threads(int num_threads);
+
+    /*!
+     * Rebuilds the interpreter with another execution config, keeping the current input shapes. Parked shapes are
+     * dropped and so are pointers, views and bound buffers of the current interpreter. Autotuning isn't run again.
+     * @param config The execution config
+     */
+    void set_execution_config(const ExecutionConfig &config);
+
+    /*!
+     * Gets the execution config in use, after autotuning it holds the chosen thread count and delegate
+     * @return The execution config
+     */
+    const ExecutionConfig &get_execution_config() const {
+        return execution_config;
+    }
+
+    /*!
+     * Runs invokes on synthetic inputs shaped like the current input tensors, so lazily prepared kernels, packed
+     * weights and the model's pages are ready before the first real frame. The inputs are overwritten. Metrics don't
+     * count these invokes and the profiler is detached while they run, so neither sees them. Run by the constructors
+     * when the execution config's warmup_invokes is set.
+     * @param n_invokes Number of invokes
+     */
+    void warmup(int n_invokes = 3);
+
+    /*!
+     * Gets the model's fingerprint, computed once per shared model on first use
+     * @return 64 bit hash of the model's flatbuffer, see model_fingerprint
+     */
+    uint64_t get_model_fingerprint();
 
     /*!
      * Gets indexes of all input tensors
-     * @return A vector of ints indicating input tensor indexes
+     * @return A vector of ints indicating input tensor indexes, valid for the life of this object
      */
-    std::vector<int> input_tensors();
+    const std::vector<int> &input_tensors() const;
 
     /*!
      * Gets indexes of all output tensors
-     * @return A vector of ints indicating output tensor indexes
+     * @return A vector of ints indicating output tensor indexes, valid for the life of this object
      */
-    std::vector<int> output_tensors();
+    const std::vector<int> &output_tensors() const;
 
     /*!
      * Get dimension of tensor
      * @param tensor_index Index of tensor to get dimensions for
-     * @return A vector containing dimension of tensor
+     * @return A vector containing dimension of tensor, valid until the input shapes change
      */
-    std::vector<int> get_tensor_dims(int tensor_index);
+    const std::vector<int> &get_tensor_dims(int tensor_index) const;
 
     /*!
      * Get the tensor type
@@ -114,66 +526,183 @@ public:
      * @return A TfLiteType enum denoting type (Probably either it is kTfLiteFloat32 denoting 32 bit float or
      * kTfLiteUint8 denoting unsigned 8 bit integer)
      */
-    TfLiteType get_tensor_type(int tensor_index);
+    TfLiteType get_tensor_type(int tensor_index) const;
 
     /*!
      * Gets the number of elements in a tensor
      * @param tensor_index Index of tensor
      * @return The number of elements in the tensor with tensor_index
      */
-    int get_tensor_element_count(int tensor_index);
+    int get_tensor_element_count(int tensor_index) const;
+
+    /*!
+     * Gets the descriptor of a tensor, read once when the interpreter's tensors were allocated. Descriptors move with
+     * their interpreter when the input shapes change, so switching shapes doesn't read them again. Tensors that
+     * Tensorflow Lite resizes during invoke, those of models with dynamic output shapes, are read again on every call.
+     * @param tensor_index Index of the tensor
+     * @return The descriptor, valid until the input shapes change
+     */
+    const TensorDescriptor &tensor_descriptor(int tensor_index) const;
+
+    /*!
+     * Finds a tensor's descriptor by name, see tensor_descriptor
+     * @param name The tensor's name in the model
+     * @return The descriptor, valid until the input shapes change
+     */
+    const TensorDescriptor &tensor_descriptor(const std::string &name) const;
+
+    /*!
+     * Gets the descriptors of every tensor, see tensor_descriptor
+     * @return The descriptors, by tensor index
+     */
+    const std::vector<TensorDescriptor> &tensor_descriptors() const {
+        for (const TensorDescriptor &descriptor : descriptors)
+            if (descriptor.dynamic)
+                live_descriptor(descriptor.index);
+        return descriptors;
+    }
+
+    /*!
+     * Makes a handle to a tensor, its type and rank are checked once here instead of on every access
+     * @tparam T The tensor type, must match the tensor's type
+     * @tparam Rank Tensor rank, must match the tensor's rank
+     * @param tensor_index Index of the tensor
+     * @return The handle
+     */
+    template<typename T, int Rank>
+    TensorHandle<T, Rank> tensor_handle(int tensor_index) {
+        static_assert(is_tensor_type<T>::value, "T must be float, TfLiteFloat16, uint8_t, int8_t or int16_t");
+        check_tensor<T, Rank>(tensor_index);
+        return TensorHandle<T, Rank>(tensor_index);
+    }
+
+    /*!
+     * Makes a handle to a tensor found by name, see tensor_handle
+     * @tparam T The tensor type, must match the tensor's type
+     * @tparam Rank Tensor rank, must match the tensor's rank
+     * @param name The tensor's name in the model
+     * @return The handle
+     */
+    template<typename T, int Rank>
+    TensorHandle<T, Rank> tensor_handle(const std::string &name) {
+        return tensor_handle<T, Rank>(tensor_descriptor(name).index);
+    }
+
+    /*!
+     * Gets a writable, row-major view over a tensor's memory without checks or allocations, valid until the input
+     * shapes change, or until the next invoke for dynamic tensors. Writing to anything but an input is undefined.
+     * @tparam T The tensor type
+     * @tparam Rank Tensor rank
+     * @param handle The tensor's handle
+     * @return A row-major Eigen::TensorMap over the tensor
+     */
+    template<typename T, int Rank>
+    TensorView<T, Rank> tensor(TensorHandle<T, Rank> handle) {
+        const TensorDescriptor &descriptor = live_descriptor(handle.index());
+        Eigen::array<Eigen::Index, Rank> dims;
+        std::copy(descriptor.dims.begin(), descriptor.dims.end(), dims.begin());
+        return TensorView<T, Rank>(static_cast<T *>(descriptor.data), dims);
+    }
+
+    /*!
+     * Gets a read-only, row-major view over a tensor's memory, see the non-const overload
+     * @tparam T The tensor type
+     * @tparam Rank Tensor rank
+     * @param handle The tensor's handle
+     * @return A row-major Eigen::TensorMap over the constant tensor
+     */
+    template<typename T, int Rank>
+    ConstTensorView<T, Rank> tensor(TensorHandle<T, Rank> handle) const {
+        const TensorDescriptor &descriptor = live_descriptor(handle.index());
+        Eigen::array<Eigen::Index, Rank> dims;
+        std::copy(descriptor.dims.begin(), descriptor.dims.end(), dims.begin());
+        return ConstTensorView<T, Rank>(static_cast<const T *>(descriptor.data), dims);
+    }
 
     /*!
      * Fills tensor
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @param data Pointer to data
      * @param tensor_index Index of the tensor to fill
      */
     template<typename T>
-    void fill_tensor(T *data, int tensor_index) {
-        // Stops if T is not uint8_t or float
-        BOOST_STATIC_ASSERT(boost::mpl::contains<boost::variant<uint8_t, float>::types, T>::value);
+    void fill_tensor(const T *data, int tensor_index) {
+        static_assert(is_tensor_type<T>::value, "T must be float, TfLiteFloat16, uint8_t, int8_t or int16_t");
         auto *tensor_ptr = interpreter->typed_tensor<T>(tensor_index);
+        // Nothing to copy when the caller wrote straight into the tensor through a view
+        if (tensor_ptr == data)
+            return;
+        ScopedStage stage(profiler.get(), "fill", metrics.get());
         int n_elements = get_tensor_element_count(tensor_index);
-        for (int i = 0; i < n_elements; i++)
-            tensor_ptr[i] = data[i];
+        std::copy_n(data, n_elements, tensor_ptr);
     }
 
+    /*!
+     * Gets a tensor's quantization parameters, read once from the model
+     * @param tensor_index Index of the tensor
+     * @return The quantization parameters, without scales if the tensor isn't quantized
+     */
+    const QuantizationParams &get_quantization(int tensor_index);
+
+    /*!
+     * Fills a tensor from float data whatever the tensor's type, so callers can keep working in float with quantized
+     * models. Integer tensors (uint8, int8 and int16) are quantized with the tensor's per-tensor or per-channel
+     * parameters, float16 tensors are converted, float tensors are copied.
+     * @param data Pointer to the float data, as many values as the tensor has elements
+     * @param tensor_index Index of the tensor to fill
+     */
+    void fill_tensor_quantized(const float *data, int tensor_index);
+
+    /*!
+     * Reads a tensor as float data whatever the tensor's type, integer tensors are dequantized with the tensor's own
+     * parameters and float16 tensors are converted
+     * @param tensor_index Index of the tensor to read
+     * @param output Where the float data is written, must hold as many values as the tensor has elements
+     */
+    void get_tensor_dequantized(int tensor_index, float *output);
+
+    /*!
+     * Reads a tensor as float data, see get_tensor_dequantized, into a vector whose capacity is reused between calls
+     * @param tensor_index Index of the tensor to read
+     * @param output Resized to the tensor's number of elements and filled
+     */
+    void get_tensor_dequantized(int tensor_index, std::vector<float> &output);
+
     /*!
      * Fill tensor from an Eigen::Tensor
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor rank
      * @param tensor The tensor in the form of a Eigen::Tensor
      * @param tensor_index Index of the tensor to fill
      */
     template<typename T, int Rank>
     void fill_tensor(const Eigen::Tensor<T, Rank> &tensor, int tensor_index) {
-        int n_elements = static_cast<int>(tensor.size());
-        T *input_tensor_ptr = tensor.data();
-        fill_input_tensor(input_tensor_ptr, tensor_index, n_elements);
+        if (tensor.size() != get_tensor_element_count(tensor_index))
+            LOG(FATAL) << "Error: number of elements in tensor does not match the model's tensor\n";
+        fill_tensor(tensor.data(), tensor_index);
     }
 
     /*!
      * Fill tensors from a hashtable of tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor rank
      * @param tensors A map where the key is the tensor index and the value is the Eigen::Tensor tensor
      */
     template<typename T, int Rank>
     void fill_tensors(const std::map<int, Eigen::Tensor<T, Rank>> &tensors) {
         for (const auto &tensor : tensors) {
-            fill_input_tensor(tensor.second, tensor.first);
+            fill_tensor(tensor.second, tensor.first);
         }
     }
 
     /*!
      * Fill input tensors from a vector of pointers
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @param tensors A vector of pointers that point to tensor data
      */
     template<typename T>
     void fill_input_tensors(const std::vector<T *> &tensors) {
-        auto input_indexes = input_tensors();
+        const std::vector<int> &input_indexes = input_tensors();
         if (input_indexes.size() != tensors.size())
             LOG(FATAL) << "Error: number of tensors does not match the number of inputs\n";
         for (int i = 0; i < input_indexes.size(); i++)
@@ -182,13 +711,13 @@ public:
 
     /*!
      * Fill input tensors from a vector of tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor rank
      * @param tensors A vector of tensors where the first tensor corresponds to the first input and so on
      */
     template<typename T, int Rank>
     void fill_input_tensors(const std::vector<Eigen::Tensor<T, Rank>> &tensors) {
-        auto input_indexes = input_tensors();
+        const std::vector<int> &input_indexes = input_tensors();
         if (input_indexes.size() != tensors.size())
             LOG(FATAL) << "Error: number of tensors does not match the number of inputs\n";
         for (int i = 0; i < input_indexes.size(); i++)
@@ -197,26 +726,26 @@ public:
 
     /*!
      * Gets the pointer to the data of a tensor
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @param tensor_index Index of the tensor to get
      * @return Type T pointer to the data of a tensor
      */
     template<typename T>
     T *get_tensor_ptr(int tensor_index) {
-        // Stops if T is not uint8_t or float
-        BOOST_STATIC_ASSERT(boost::mpl::contains<boost::variant<uint8_t, float>::types, T>::value);
+        static_assert(is_tensor_type<T>::value, "T must be float, TfLiteFloat16, uint8_t, int8_t or int16_t");
         return interpreter->typed_tensor<T>(tensor_index);
     }
 
     /*!
      * Gets the pointers to the data of multi tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @param tensor_indexes A vector of indexes of the tensors to get
      * @return A vector of pointers that point to the tensors
      */
     template<typename T>
     std::vector<T *> get_tensor_ptrs(const std::vector<int> &tensor_indexes) {
         std::vector<T *> output;
+        output.reserve(tensor_indexes.size());
         for (int index : tensor_indexes)
             output.push_back(get_tensor_ptr<T>(index));
         return output;
@@ -224,23 +753,26 @@ public:
 
     /*!
      * Gets a tensor
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor rank
      * @param tensor_index Index of the tensor to get
      * @return A tensor in the from of Eigen::Tensor
      */
     template<typename T, int Rank>
     Eigen::Tensor<T, Rank> get_tensor(int tensor_index) {
-        // Stops if T is not uint8_t or float
-        BOOST_STATIC_ASSERT(boost::mpl::contains<boost::variant<uint8_t, float>::types, T>::value);
-        auto dims = get_tensor_dims(tensor_index);
+        static_assert(is_tensor_type<T>::value, "T must be float, TfLiteFloat16, uint8_t, int8_t or int16_t");
+        const std::vector<int> &dims = get_tensor_dims(tensor_index);
         if (dims.size() != Rank)
             LOG(FATAL) << "Error: number of dimensions in model does not match template variable Rank\n";
 
+        ScopedStage stage(profiler.get(), "output_copy", metrics.get());
+
         // Get tensor's pointer
         auto tensor_ptr = interpreter->typed_tensor<T>(tensor_index);
         // Allocate tensor
-        Eigen::Tensor<T, Rank> output_tensor(dims);
+        std::array<Eigen::Index, Rank> shape;
+        std::copy(dims.begin(), dims.end(), shape.begin());
+        Eigen::Tensor<T, Rank> output_tensor(shape);
         // Get number of elements
         int size = output_tensor.size();
         // Copy tensor data over
@@ -248,9 +780,56 @@ public:
         return output_tensor;
     }
 
+    /*!
+     * Gets a read-only view directly over a tensor's memory, nothing is copied. The view is row-major, like the
+     * interpreter's memory, and is only valid until the next invoke() (or until tensors are reallocated), use
+     * get_tensor_stable when the data must outlive it.
+     * @tparam T The tensor type, must match the tensor's type
+     * @tparam Rank Tensor rank, must match the tensor's rank
+     * @param tensor_index Index of the tensor
+     * @return A row-major Eigen::TensorMap over the tensor
+     */
+    template<typename T, int Rank>
+    ConstTensorView<T, Rank> get_tensor_view(int tensor_index) {
+        Eigen::array<Eigen::Index, Rank> dims = check_tensor<T, Rank>(tensor_index);
+        return ConstTensorView<T, Rank>(interpreter->typed_tensor<T>(tensor_index), dims);
+    }
+
+    /*!
+     * Gets read-only views over all output tensors, see get_tensor_view for how long they are valid
+     * @tparam T The tensor type, all outputs must have this type
+     * @tparam Rank Tensor rank, all outputs must have this rank
+     * @return A vector of views where the first view corresponds to the first output and so on
+     */
+    template<typename T, int Rank>
+    std::vector<ConstTensorView<T, Rank>> get_output_views() {
+        std::vector<ConstTensorView<T, Rank>> output;
+        output.reserve(interpreter->outputs().size());
+        for (int index : interpreter->outputs())
+            output.push_back(get_tensor_view<T, Rank>(index));
+        return output;
+    }
+
+    /*!
+     * Copies a tensor into storage that outlives the next invoke(). The storage comes from a pool and goes back to it
+     * when the copy is destroyed, so copying same sized outputs every frame doesn't allocate once the pool is warm.
+     * @tparam T The tensor type, must match the tensor's type
+     * @tparam Rank Tensor rank, must match the tensor's rank
+     * @param tensor_index Index of the tensor
+     * @return The copy
+     */
+    template<typename T, int Rank>
+    StableTensor<T, Rank> get_tensor_stable(int tensor_index) {
+        Eigen::array<Eigen::Index, Rank> dims = check_tensor<T, Rank>(tensor_index);
+        ScopedStage stage(profiler.get(), "output_copy", metrics.get());
+        if (buffer_pool == nullptr)
+            buffer_pool = TensorBufferPool::create();
+        return StableTensor<T, Rank>(*buffer_pool, interpreter->typed_tensor<T>(tensor_index), dims);
+    }
+
     /*!
      * Get a list of tensors from interpreter
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor Rank
      * @param tensor_indexes a vector containing the indexes of the wanted tensors
      * @return A vector of wanted Eigen Tensors
@@ -258,6 +837,7 @@ public:
     template<typename T, int Rank>
     std::vector<Eigen::Tensor<T, Rank>> get_tensors(const std::vector<int> &tensor_indexes) {
         std::vector<Eigen::Tensor<T, Rank>> output;
+        output.reserve(tensor_indexes.size());
         for (int index : tensor_indexes)
             output.push_back(get_tensor<T, Rank>(index));
         return output;
@@ -265,19 +845,19 @@ public:
 
     /*!
      * Get the output tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @tparam Rank Tensor Rank
      * @return A vector of Eigen Tensors containing the model outputs
      */
     template<typename T, int Rank>
     std::vector<Eigen::Tensor<T, Rank>> get_output_tensors() {
-        auto output_tensor_indexes = output_tensors();
+        const std::vector<int> &output_tensor_indexes = output_tensors();
         return get_tensors<T, Rank>(output_tensor_indexes);
     }
 
     /*!
      * Gets the pointers to the output tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @return A vector of pointers, each pointing to an output tensor
      */
     template<typename T>
@@ -287,7 +867,7 @@ public:
 
     /*!
      * Gets the pointer to the input tensors
-     * @tparam T The tensor type, must be uint8_t or float, depending if model is quantized or not
+     * @tparam T The tensor type, must match the tensor's type
      * @return A vector of pointers, each pointing to an input tensor
      */
     template<typename T>
@@ -295,10 +875,126 @@ public:
         return get_tensor_ptrs<T>(input_tensors());
     }
 
+    /*!
+     * Gets a writable view directly over an input tensor's memory, anything written to the view is what the next
+     * invoke() sees, so preprocessing can write into the interpreter without an intermediate buffer. The view is
+     * row-major, like the interpreter's memory, and stays valid until tensors are reallocated.
+     * @tparam T The tensor type, must match the input tensor's type
+     * @tparam Rank Tensor rank, must match the input tensor's rank
+     * @param tensor_index Index of the input tensor
+     * @return A row-major Eigen::TensorMap over the input tensor
+     */
+    template<typename T, int Rank>
+    TensorView<T, Rank> get_input_view(int tensor_index) {
+        check_input_tensor<T>(tensor_index);
+        const std::vector<int> &dims = get_tensor_dims(tensor_index);
+        if (dims.size() != Rank)
+            LOG(FATAL) << "Error: number of dimensions in model does not match template variable Rank\n";
+        Eigen::array<Eigen::Index, Rank> eigen_dims;
+        std::copy(dims.begin(), dims.end(), eigen_dims.begin());
+        return TensorView<T, Rank>(interpreter->typed_tensor<T>(tensor_index), eigen_dims);
+    }
+
+    /*!
+     * Gets a flat writable view over an input tensor's memory, see get_input_view
+     * @tparam T The tensor type, must match the input tensor's type
+     * @param tensor_index Index of the input tensor
+     * @return A rank 1 Eigen::TensorMap covering every element of the input tensor
+     */
+    template<typename T>
+    TensorView<T, 1> get_input_span(int tensor_index) {
+        check_input_tensor<T>(tensor_index);
+        return TensorView<T, 1>(interpreter->typed_tensor<T>(tensor_index), get_tensor_element_count(tensor_index));
+    }
+
+    /*!
+     * Gets writable views over all input tensors, see get_input_view
+     * @tparam T The tensor type, all inputs must have this type
+     * @tparam Rank Tensor rank, all inputs must have this rank
+     * @return A vector of views where the first view corresponds to the first input and so on
+     */
+    template<typename T, int Rank>
+    std::vector<TensorView<T, Rank>> get_input_views() {
+        std::vector<TensorView<T, Rank>> output;
+        output.reserve(input_tensors().size());
+        for (int index : input_tensors())
+            output.push_back(get_input_view<T, Rank>(index));
+        return output;
+    }
+
+    /*!
+     * Uses a caller owned buffer as the storage of an input tensor, so data written to the buffer is read directly
+     * by invoke() and never copied. The buffer must be aligned to tensor_alignment bytes, be at least as large as
+     * the tensor and outlive this object (or until it is bound again). Tensors are reallocated after binding.
+     * Requires Tensorflow Lite 2.5 or newer.
+     * @param tensor_index Index of the input tensor to bind
+     * @param buffer Pointer to the caller's buffer
+     * @param bytes Size of the caller's buffer in bytes
+     */
+    void bind_input_buffer(int tensor_index, void *buffer, size_t bytes);
+
+    /*!
+     * Typed version of bind_input_buffer, checks that T matches the input tensor's type
+     * @tparam T The tensor type, must match the input tensor's type
+     * @param buffer Pointer to the caller's buffer
+     * @param n_elements Number of T elements in the caller's buffer
+     * @param tensor_index Index of the input tensor to bind
+     */
+    template<typename T>
+    void bind_input_buffer(T *buffer, size_t n_elements, int tensor_index) {
+        check_input_tensor<T>(tensor_index);
+        bind_input_buffer(tensor_index, static_cast<void *>(buffer), n_elements * sizeof(T));
+    }
+
     /*!
      * Invokes the interpreter (performs the model's operations)
      */
     void invoke();
+
+    /*!
+     * Starts recording the latency of every operator and of the library's stages (preprocess, resize, convert, fill,
+     * invoke and output_copy). When profiling is disabled, the default, the only cost is a null pointer check per
+     * stage.
+     * @param max_events Most events kept for the Chrome trace, and most samples kept per stage or operator
+     */
+    void enable_profiling(size_t max_events = 10000);
+
+    /*!
+     * Stops profiling and discards everything recorded
+     */
+    void disable_profiling();
+
+    /*!
+     * Discards everything recorded so far and keeps profiling, to summarize a window after warm-up for instance
+     */
+    void reset_profiling();
+
+    /*!
+     * Summarizes what was recorded since profiling was enabled
+     * @param top_n Most operators and operator types listed
+     * @return The summary, empty if profiling is disabled
+     */
+    ProfileSummary profiling_summary(size_t top_n = 10) const;
+
+    /*!
+     * Formats the most recent events as a Chrome trace, viewable in chrome://tracing or https://ui.perfetto.dev
+     * @return The trace as JSON, an empty trace if profiling is disabled
+     */
+    std::string profiling_chrome_trace() const;
+
+    /*!
+     * Starts counting invokes and failures and recording the latency of every stage and inference entry point in a
+     * metrics registry, labeled with the model's name. Unlike profiling it keeps no per sample state, so it is meant to
+     * stay enabled in production. When metrics are disabled, the default, the only cost is a null pointer check.
+     * @param model_name Value of the model label, instances sharing a name share their metrics
+     * @param registry The registry the metrics are kept in, must outlive the object
+     */
+    void enable_metrics(const std::string &model_name, MetricsRegistry &registry = MetricsRegistry::global());
+
+    /*!
+     * Stops recording metrics, what was recorded stays in the registry
+     */
+    void disable_metrics();
 };
 
 
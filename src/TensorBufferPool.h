@@ -0,0 +1,164 @@
+#ifndef EASYTFLITE_TENSORBUFFERPOOL_H
+#define EASYTFLITE_TENSORBUFFERPOOL_H
+
+#include <new>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <eigen3/unsupported/Eigen/CXX11/Tensor>
+
+//! A read-only, row-major view over tensor memory
+template<typename T, int Rank>
+using ConstTensorView = Eigen::TensorMap<const Eigen::Tensor<T, Rank, Eigen::RowMajor>>;
+
+//! The TensorBufferPool class recycles aligned byte buffers used to copy tensors out of the interpreter
+/*!
+ * Buffers are handed out as shared pointers, when the last copy of one is destroyed it goes back to the pool instead
+ * of being freed, so copying outputs of the same size every frame stops allocating after the first few frames. The
+ * pool is kept alive by the buffers it handed out. It is safe to use from several threads.
+ */
+class TensorBufferPool : public std::enable_shared_from_this<TensorBufferPool> {
+    //! An aligned allocation and its size
+    struct Buffer {
+        //! The allocation
+        void *data;
+        //! Size of the allocation in bytes
+        size_t capacity;
+    };
+
+    //! Alignment of every buffer in bytes
+    static constexpr size_t alignment = 64;
+    //! Most idle buffers kept, larger pools free the buffers returned to them
+    size_t max_idle;
+    //! Guards idle
+    std::mutex mutex;
+    //! Buffers ready to be handed out again
+    std::vector<Buffer> idle;
+
+    /*!
+     * Takes a buffer back, or frees it if the pool is full
+     * @param buffer The buffer being released
+     */
+    void recycle(Buffer buffer) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (idle.size() < max_idle) {
+                idle.push_back(buffer);
+                return;
+            }
+        }
+        ::operator delete(buffer.data, std::align_val_t(alignment));
+    }
+
+    explicit TensorBufferPool(size_t max_idle) : max_idle(max_idle) {}
+
+public:
+    /*!
+     * Creates a pool, always owned by a shared pointer since the buffers it hands out keep it alive
+     * @param max_idle Most idle buffers kept
+     * @return The pool
+     */
+    static std::shared_ptr<TensorBufferPool> create(size_t max_idle = 8) {
+        return std::shared_ptr<TensorBufferPool>(new TensorBufferPool(max_idle));
+    }
+
+    ~TensorBufferPool() {
+        for (Buffer &buffer : idle)
+            ::operator delete(buffer.data, std::align_val_t(alignment));
+    }
+
+    TensorBufferPool(const TensorBufferPool &) = delete;
+
+    TensorBufferPool &operator=(const TensorBufferPool &) = delete;
+
+    /*!
+     * Hands out the smallest idle buffer of at least bytes, allocating one if none is large enough
+     * @param bytes Size needed in bytes
+     * @return The buffer, returned to the pool when its last copy is destroyed
+     */
+    std::shared_ptr<void> acquire(size_t bytes) {
+        Buffer buffer{nullptr, 0};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto best = idle.end();
+            for (auto it = idle.begin(); it != idle.end(); ++it)
+                if (it->capacity >= bytes && (best == idle.end() || it->capacity < best->capacity))
+                    best = it;
+            if (best != idle.end()) {
+                buffer = *best;
+                *best = idle.back();
+                idle.pop_back();
+            }
+        }
+        if (buffer.data == nullptr)
+            buffer = Buffer{::operator new(std::max<size_t>(bytes, 1), std::align_val_t(alignment)), bytes};
+
+        std::shared_ptr<TensorBufferPool> self = shared_from_this();
+        return std::shared_ptr<void>(buffer.data, [self, buffer](void *) { self->recycle(buffer); });
+    }
+
+    /*!
+     * Gets the number of idle buffers
+     * @return The number of buffers waiting to be handed out
+     */
+    size_t idle_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return idle.size();
+    }
+};
+
+//! A copy of a tensor that outlives the next invoke, its storage is recycled through a TensorBufferPool
+/*!
+ * @tparam T The tensor's element type
+ * @tparam Rank The tensor's rank
+ */
+template<typename T, int Rank>
+class StableTensor {
+    //! The pooled storage holding the copy
+    std::shared_ptr<void> storage;
+    //! The copy's dimensions
+    Eigen::array<Eigen::Index, Rank> dims{};
+
+public:
+    StableTensor() = default;
+
+    /*!
+     * Copies a tensor into a buffer from the pool
+     * @param pool The pool the storage comes from
+     * @param source The tensor's memory
+     * @param tensor_dims The tensor's dimensions
+     */
+    StableTensor(TensorBufferPool &pool, const T *source, const Eigen::array<Eigen::Index, Rank> &tensor_dims)
+            : dims(tensor_dims) {
+        Eigen::Index size = 1;
+        for (Eigen::Index dim : dims)
+            size *= dim;
+        storage = pool.acquire(size * sizeof(T));
+        std::copy_n(source, size, static_cast<T *>(storage.get()));
+    }
+
+    /*!
+     * Gets a row-major view over the copy, valid as long as this object or a copy of it is alive
+     * @return The view
+     */
+    ConstTensorView<T, Rank> view() const {
+        return ConstTensorView<T, Rank>(data(), dims);
+    }
+
+    /*!
+     * Gets the copy's data
+     * @return Pointer to the first element
+     */
+    const T *data() const {
+        return static_cast<const T *>(storage.get());
+    }
+
+    //! Whether the object holds a copy
+    explicit operator bool() const {
+        return storage != nullptr;
+    }
+};
+
+#endif //EASYTFLITE_TENSORBUFFERPOOL_H
@@ -0,0 +1,61 @@
+#ifndef EASYTFLITE_TENSORDESCRIPTOR_H
+#define EASYTFLITE_TENSORDESCRIPTOR_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <tensorflow/lite/c/common.h>
+#include "Quantization.h"
+
+//! Everything about a tensor of the current interpreter, read once after its tensors are allocated, dynamic tensors
+//! excepted
+struct TensorDescriptor {
+    //! The tensor's index
+    int index = -1;
+    //! The tensor's name in the model
+    std::string name;
+    //! The element type
+    TfLiteType type = kTfLiteNoType;
+    //! The dimensions
+    std::vector<int> dims;
+    //! Number of elements
+    int element_count = 0;
+    //! Size of the tensor's memory in bytes
+    size_t bytes = 0;
+    //! The quantization parameters, without scales if the tensor isn't quantized
+    QuantizationParams quantization;
+    //! The tensor's memory, null until allocated
+    void *data = nullptr;
+    //! Whether Tensorflow Lite reallocates the tensor during invoke, its dims, element count, bytes and data are then
+    //! read again whenever the descriptor is asked for
+    bool dynamic = false;
+};
+
+//! A tensor whose element type and rank were checked once, so views over it need no checks or allocations
+/*!
+ * Handles are made by TFLite::tensor_handle and stay valid across shape changes, the rank of a tensor never changes.
+ * @tparam T The tensor's element type
+ * @tparam Rank The tensor's rank
+ */
+template<typename T, int Rank>
+class TensorHandle {
+    //! The tensor's index
+    int tensor_index = -1;
+
+    friend class TFLite;
+
+    explicit TensorHandle(int tensor_index) : tensor_index(tensor_index) {}
+
+public:
+    TensorHandle() = default;
+
+    /*!
+     * Gets the tensor's index
+     * @return The index, -1 for a default constructed handle
+     */
+    int index() const {
+        return tensor_index;
+    }
+};
+
+#endif //EASYTFLITE_TENSORDESCRIPTOR_H
@@ -0,0 +1,104 @@
+#include "TiledDetector.h"
+
+#include <cmath>
+
+/*!
+ * Counts the tiles needed to cover an extent
+ * @param extent Size of the frame along one axis
+ * @param tile Size of a tile along that axis
+ * @param overlap Fraction of a tile shared with its neighbour
+ * @return The number of tiles
+ */
+static int tile_count(int extent, int tile, float overlap) {
+    if (tile >= extent)
+        return 1;
+    int stride = std::max(1, static_cast<int>(static_cast<float>(tile) * (1.0f - overlap)));
+    return (extent - tile + stride - 1) / stride + 1;
+}
+
+/*!
+ * Makes the pool's checkouts wait for an instance, a timed out checkout would drop its tiles
+ * @param pool_options The options the pool is built with
+ * @return The options, PoolExhaustion::Timeout replaced by PoolExhaustion::Block
+ */
+static InterpreterPoolOptions blocking(InterpreterPoolOptions pool_options) {
+    if (pool_options.exhaustion == PoolExhaustion::Timeout)
+        pool_options.exhaustion = PoolExhaustion::Block;
+    return pool_options;
+}
+
+TiledDetector::TiledDetector(const boost::filesystem::path &model_path, const TilingOptions &tiling_options,
+                             const InterpreterPoolOptions &pool_options)
+        : TiledDetector(TFLite::load_model(model_path), tiling_options, pool_options) {}
+
+TiledDetector::TiledDetector(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                             const TilingOptions &tiling_options, const InterpreterPoolOptions &pool_options)
+        : pool(std::move(shared_model), blocking(pool_options)), options(tiling_options) {
+    if (options.tile_width < 1 || options.tile_height < 1)
+        LOG(FATAL) << "Error: tiles must be at least 1 pixel wide and high\n";
+    if (options.overlap < 0.0f || options.overlap >= 1.0f)
+        LOG(FATAL) << "Error: tile overlap must be in [0, 1)\n";
+}
+
+void TiledDetector::compute_tiles(cv::Size frame_size) {
+    int tile_width = std::min(options.tile_width, frame_size.width);
+    int tile_height = std::min(options.tile_height, frame_size.height);
+
+    // Enlarges the tiles until the grid fits, each step grows them by a quarter
+    while (options.max_tiles > 0 &&
+           tile_count(frame_size.width, tile_width, options.overlap) *
+           tile_count(frame_size.height, tile_height, options.overlap) > options.max_tiles) {
+        tile_width = std::min(frame_size.width, tile_width + std::max(1, tile_width / 4));
+        tile_height = std::min(frame_size.height, tile_height + std::max(1, tile_height / 4));
+    }
+
+    // Spreads the tiles evenly so the last ones end on the frame's edges
+    int nx = tile_count(frame_size.width, tile_width, options.overlap);
+    int ny = tile_count(frame_size.height, tile_height, options.overlap);
+    tiles.clear();
+    for (int j = 0; j < ny; j++) {
+        int y = ny == 1 ? 0 : j * (frame_size.height - tile_height) / (ny - 1);
+        for (int i = 0; i < nx; i++) {
+            int x = nx == 1 ? 0 : i * (frame_size.width - tile_width) / (nx - 1);
+            tiles.emplace_back(x, y, tile_width, tile_height);
+        }
+    }
+}
+
+void TiledDetector::detect(const cv::Mat &frame, std::vector<Detection> &detections, float threshold,
+                           const std::vector<int> &classes) {
+    detections.clear();
+    if (frame.empty())
+        return;
+    compute_tiles(frame.size());
+
+    // The full frame pass, when enabled, is the last slot
+    bool full_frame = options.full_frame && tiles.size() > 1;
+    size_t n_passes = tiles.size() + (full_frame ? 1 : 0);
+    if (tile_detections.size() < n_passes)
+        tile_detections.resize(n_passes);
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(n_passes)), [&](const cv::Range &range) {
+        // Waits for an instance, or grows the pool, every pass must run
+        auto detector = pool.checkout();
+        for (int i = range.start; i < range.end; i++) {
+            std::vector<Detection> &found = tile_detections[i];
+            if (static_cast<size_t>(i) == tiles.size()) {
+                detector->detect(frame, found, threshold, classes);
+                continue;
+            }
+
+            // The tile is a view of the frame, nothing is copied before the fused preprocessing pass
+            const cv::Rect &tile = tiles[i];
+            detector->detect(frame(tile), found, threshold, classes);
+            for (Detection &detection : found) {
+                detection.box.x += static_cast<float>(tile.x);
+                detection.box.y += static_cast<float>(tile.y);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < n_passes; i++)
+        detections.insert(detections.end(), tile_detections[i].begin(), tile_detections[i].end());
+    non_max_suppression(detections, options.merge_threshold, options.merge_metric);
+}
@@ -0,0 +1,91 @@
+#ifndef EASYTFLITE_TILEDDETECTOR_H
+#define EASYTFLITE_TILEDDETECTOR_H
+
+#include "SSD_EasyTFLite.h"
+#include "InterpreterPool.h"
+#include "Detection.h"
+
+//! Options for TiledDetector
+struct TilingOptions {
+    //! Width of a tile in pixels of the full frame, tiles are then resized to the model's input
+    int tile_width = 512;
+    //! Height of a tile in pixels of the full frame
+    int tile_height = 512;
+    //! Fraction of a tile shared with its neighbour, so objects on a seam are whole in at least one tile
+    float overlap = 0.2f;
+    //! Most tiles per frame, tiles are enlarged until the grid fits, 0 for no limit
+    int max_tiles = 16;
+    //! Also run the whole frame, for objects larger than a tile
+    bool full_frame = true;
+    //! Largest overlap two detections of the same class may have after merging
+    float merge_threshold = 0.5f;
+    //! How overlap is measured when merging, IoMin also merges a box cut by a seam into the whole one
+    OverlapMetric merge_metric = OverlapMetric::IoMin;
+};
+
+//! The TiledDetector class finds small objects in large frames by running a detector on overlapping tiles
+/*!
+ * The frame is cut into a grid of overlapping tiles which are zero-copy ROI views of the frame. The tiles run in
+ * parallel across an InterpreterPool of SSD_EasyTFLite instances sharing one model. Boxes are mapped back to frame
+ * coordinates and duplicates across seams are merged with a class-aware non-maximum suppression.
+ */
+class TiledDetector {
+    //! The detectors the tiles run on
+    InterpreterPool<SSD_EasyTFLite> pool;
+    //! The tiling options
+    TilingOptions options;
+    //! The tiles of the last frame, reused between frames
+    std::vector<cv::Rect> tiles;
+    //! Detections of every tile, reused between frames
+    std::vector<std::vector<Detection>> tile_detections;
+
+    /*!
+     * Computes the tile grid for a frame size into tiles
+     * @param frame_size The frame's size
+     */
+    void compute_tiles(cv::Size frame_size);
+
+public:
+    /*!
+     * Loads the detector and builds the pool
+     * @param model_path The path to a Single Shot MultiBox Detector Tensorflow Lite Flatbuffer Model
+     * @param tiling_options The tiling options
+     * @param pool_options The options of the pool the tiles run on, PoolExhaustion::Timeout waits like Block since
+     * every tile must run
+     */
+    explicit TiledDetector(const boost::filesystem::path &model_path,
+                           const TilingOptions &tiling_options = TilingOptions(),
+                           const InterpreterPoolOptions &pool_options = InterpreterPoolOptions());
+
+    /*!
+     * Builds the pool from an already loaded detector
+     * @param shared_model A Single Shot MultiBox Detector model loaded with TFLite::load_model
+     * @param tiling_options The tiling options
+     * @param pool_options The options of the pool the tiles run on, PoolExhaustion::Timeout waits like Block since
+     * every tile must run
+     */
+    explicit TiledDetector(std::shared_ptr<const tflite::FlatBufferModel> shared_model,
+                           const TilingOptions &tiling_options = TilingOptions(),
+                           const InterpreterPoolOptions &pool_options = InterpreterPoolOptions());
+
+    /*!
+     * Runs the detector on every tile and merges the results, see SSD_EasyTFLite::detect
+     * @param frame The full resolution frame
+     * @param detections Cleared, then filled with the merged detections, boxes are in pixels of frame
+     * @param threshold Lowest score kept
+     * @param classes Class indexes kept, every class is kept when empty
+     */
+    void detect(const cv::Mat &frame, std::vector<Detection> &detections, float threshold = 0.5f,
+                const std::vector<int> &classes = std::vector<int>());
+
+    /*!
+     * Gets the tiles the last frame was cut into, the full frame pass isn't included
+     * @return The tiles, in pixels of the frame
+     */
+    const std::vector<cv::Rect> &last_tiles() const {
+        return tiles;
+    }
+};
+
+
+#endif //EASYTFLITE_TILEDDETECTOR_H
@@ -0,0 +1,139 @@
+#include "Tracker.h"
+
+#include <cmath>
+#include <algorithm>
+#include <eigen3/Eigen/LU>
+#include <glog/logging.h>
+
+namespace {
+    using State = Eigen::Matrix<float, 7, 1>;
+    using Measurement = Eigen::Matrix<float, 4, 1>;
+
+    // The box as a measurement, [center x, center y, area, aspect ratio]
+    Measurement to_measurement(const cv::Rect2f &box) {
+        Measurement z;
+        z << box.x + box.width / 2.0f, box.y + box.height / 2.0f, box.width * box.height,
+                box.width / std::max(box.height, 1e-6f);
+        return z;
+    }
+
+    // The state's box
+    cv::Rect2f to_box(const State &x) {
+        float area = std::max(x(2), 0.0f);
+        float width = std::sqrt(area * std::max(x(3), 0.0f));
+        float height = width > 0.0f ? area / width : 0.0f;
+        return cv::Rect2f(x(0) - width / 2.0f, x(1) - height / 2.0f, width, height);
+    }
+
+    // Constant velocity transition, the position and area move by their velocity every frame
+    Eigen::Matrix<float, 7, 7> transition() {
+        Eigen::Matrix<float, 7, 7> F = Eigen::Matrix<float, 7, 7>::Identity();
+        F(0, 4) = F(1, 5) = F(2, 6) = 1.0f;
+        return F;
+    }
+}
+
+Tracker::Tracker(const TrackingOptions &tracking_options) : options(tracking_options),
+                                                            frames_since_detection(tracking_options.detection_interval) {
+    if (options.detection_interval < 1)
+        LOG(FATAL) << "Error: the detection interval must be at least 1\n";
+}
+
+void Tracker::predict() {
+    static const Eigen::Matrix<float, 7, 7> F = transition();
+    // Process noise, from SORT
+    static const Eigen::Matrix<float, 7, 1> Q = (Eigen::Matrix<float, 7, 1>() << 1, 1, 1, 1, 0.01f, 0.01f, 0.0001f)
+            .finished();
+
+    for (Track &track : tracks) {
+        // Keep the area from going negative
+        if (track.state(2) + track.state(6) <= 0.0f)
+            track.state(6) = 0.0f;
+        track.state = F * track.state;
+        track.covariance = F * track.covariance * F.transpose();
+        track.covariance.diagonal() += Q;
+        track.detection.box = to_box(track.state);
+        track.detection.score *= options.confidence_decay;
+    }
+    frames_since_detection++;
+    frame_count++;
+}
+
+bool Tracker::needs_detection() const {
+    if (frames_since_detection >= options.detection_interval)
+        return true;
+    for (const Track &track : tracks)
+        if (track.hits >= options.min_hits && track.detection.score < options.min_confidence)
+            return true;
+    return false;
+}
+
+void Tracker::update(const std::vector<Detection> &frame_detections) {
+    // Measurement noise, from SORT
+    static const Eigen::Matrix<float, 4, 1> R = (Eigen::Matrix<float, 4, 1>() << 1, 1, 10, 10).finished();
+
+    // Greedy matching, the most overlapping pairs of the same class first
+    candidates.clear();
+    for (size_t t = 0; t < tracks.size(); t++)
+        for (size_t d = 0; d < frame_detections.size(); d++) {
+            if (tracks[t].detection.class_id != frame_detections[d].class_id)
+                continue;
+            float overlap = box_overlap(tracks[t].detection.box, frame_detections[d].box);
+            if (overlap >= options.match_threshold)
+                candidates.push_back({overlap, t, d});
+        }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.overlap > b.overlap;
+    });
+
+    matched.assign(frame_detections.size(), false);
+    for (Track &track : tracks)
+        track.misses++;
+    for (const Candidate &candidate : candidates) {
+        Track &track = tracks[candidate.track];
+        if (matched[candidate.detection] || track.misses == 0)
+            continue;
+        matched[candidate.detection] = true;
+
+        // Kalman correction, only the box is measured
+        const Detection &detection = frame_detections[candidate.detection];
+        Eigen::Matrix<float, 4, 4> S = track.covariance.topLeftCorner<4, 4>();
+        S.diagonal() += R;
+        Eigen::Matrix<float, 7, 4> K = track.covariance.leftCols<4>() * S.inverse();
+        track.state += K * (to_measurement(detection.box) - track.state.head<4>());
+        track.covariance -= K * track.covariance.topRows<4>();
+
+        track.detection = detection;
+        track.detection.box = to_box(track.state);
+        track.hits++;
+        track.misses = 0;
+    }
+
+    // Drop the tracks lost for too long, then start a track for every unmatched detection
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [this](const Track &track) {
+        return track.misses > options.max_misses;
+    }), tracks.end());
+    for (size_t d = 0; d < frame_detections.size(); d++) {
+        if (matched[d])
+            continue;
+        Track track;
+        track.id = next_id++;
+        track.detection = frame_detections[d];
+        track.hits = 1;
+        track.state << to_measurement(frame_detections[d].box), 0.0f, 0.0f, 0.0f;
+        // Unknown velocities start with a large uncertainty, from SORT
+        track.covariance.setZero();
+        track.covariance.diagonal() << 10, 10, 10, 10, 10000, 10000, 10000;
+        tracks.push_back(track);
+    }
+
+    frames_since_detection = 0;
+    detection_count++;
+}
+
+void Tracker::report() {
+    reported.clear();
+    for (const Track &track : tracks)
+        if (track.hits >= options.min_hits)
+            reported.push_back(track);
+}
@@ -0,0 +1,148 @@
+#ifndef EASYTFLITE_TRACKER_H
+#define EASYTFLITE_TRACKER_H
+
+#include <vector>
+#include <cstdint>
+#include <eigen3/Eigen/Core>
+#include "Detection.h"
+
+//! Options for Tracker
+struct TrackingOptions {
+    //! The detector runs at least once every this many frames, 1 runs it on every frame
+    int detection_interval = 5;
+    //! The detector also runs as soon as a track's confidence falls below this
+    float min_confidence = 0.3f;
+    //! A track's confidence is multiplied by this on every frame it is only predicted
+    float confidence_decay = 0.95f;
+    //! Lowest intersection over union for a detection to be matched with a track of the same class
+    float match_threshold = 0.3f;
+    //! Detector runs a track may go unmatched before it is dropped
+    int max_misses = 2;
+    //! Times a track must be matched before it is reported
+    int min_hits = 1;
+};
+
+//! An object followed from frame to frame
+struct Track {
+    //! Identifies the object for as long as it's tracked
+    uint64_t id = 0;
+    //! The predicted box, the class and the confidence, which decays between detector runs
+    Detection detection;
+    //! Times the track was matched with a detection
+    int hits = 0;
+    //! Consecutive detector runs the track wasn't matched in
+    int misses = 0;
+    //! Kalman state, [center x, center y, area, aspect ratio] followed by the velocity of the first three
+    Eigen::Matrix<float, 7, 1> state;
+    //! Kalman state covariance
+    Eigen::Matrix<float, 7, 7> covariance;
+};
+
+//! The Tracker class propagates detections between detector runs so the detector only runs every few frames
+/*!
+ * A SORT-style tracker, every track's box follows a constant velocity Kalman filter and detections are matched with
+ * tracks of the same class by intersection over union. Between detector runs the tracks are only predicted and their
+ * confidence decays, the detector runs again every detection_interval frames or as soon as a track's confidence drops
+ * below min_confidence. Matched tracks keep their ids.
+ */
+class Tracker {
+    //! A possible match, its overlap, the track and the detection
+    struct Candidate {
+        float overlap;
+        size_t track;
+        size_t detection;
+    };
+
+    //! The tracking options
+    TrackingOptions options;
+    //! The live tracks
+    std::vector<Track> tracks;
+    //! The reported tracks, reused between frames
+    std::vector<Track> reported;
+    //! The detector's output, reused between frames
+    std::vector<Detection> detections;
+    //! Match candidates, reused between frames
+    std::vector<Candidate> candidates;
+    //! Whether each detection was matched, reused between frames
+    std::vector<bool> matched;
+    //! The next track id
+    uint64_t next_id = 1;
+    //! Frames since the detector last ran
+    int frames_since_detection;
+    //! Number of frames tracked
+    uint64_t frame_count = 0;
+    //! Number of detector runs
+    uint64_t detection_count = 0;
+
+    //! Copies the tracks matched at least min_hits times to reported
+    void report();
+
+public:
+    /*!
+     * Creates an empty tracker
+     * @param tracking_options The tracking options
+     */
+    explicit Tracker(const TrackingOptions &tracking_options = TrackingOptions());
+
+    //! Advances every track by one frame, their boxes move along their velocity and their confidence decays
+    void predict();
+
+    /*!
+     * Whether the detector should run on the current frame
+     * @return True every detection_interval frames or when a track's confidence is too low
+     */
+    bool needs_detection() const;
+
+    /*!
+     * Corrects the tracks with the detector's output on the current frame, unmatched detections start new tracks
+     * @param frame_detections The detections, boxes in pixels of the frame
+     */
+    void update(const std::vector<Detection> &frame_detections);
+
+    /*!
+     * Tracks one frame, the detector only runs when needs_detection is true
+     * @tparam Detector A type with detect(frame, detections, threshold, classes) like SSD_EasyTFLite or TiledDetector
+     * @param frame The frame
+     * @param detector The detector
+     * @param threshold Lowest detection score kept
+     * @param classes Detection class indexes kept, every class is kept when empty
+     * @return The reported tracks, valid until the next call
+     */
+    template<typename Detector>
+    const std::vector<Track> &track(const cv::Mat &frame, Detector &detector, float threshold = 0.5f,
+                                    const std::vector<int> &classes = std::vector<int>()) {
+        predict();
+        if (needs_detection()) {
+            detector.detect(frame, detections, threshold, classes);
+            update(detections);
+        }
+        report();
+        return reported;
+    }
+
+    /*!
+     * Gets the reported tracks of the last frame
+     * @return The tracks matched at least min_hits times
+     */
+    const std::vector<Track> &current_tracks() const {
+        return reported;
+    }
+
+    /*!
+     * Gets the number of frames tracked
+     * @return The number of frames
+     */
+    uint64_t frames() const {
+        return frame_count;
+    }
+
+    /*!
+     * Gets the number of times the detector ran
+     * @return The number of detector runs
+     */
+    uint64_t detector_runs() const {
+        return detection_count;
+    }
+};
+
+#endif //EASYTFLITE_TRACKER_H
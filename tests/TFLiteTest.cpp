@@ -3,18 +3,108 @@
 //
 
 #include "TFLite.h"
+#include "EasyTFLite.h"
+#include "InterpreterPool.h"
+#include "BatchScheduler.h"
+#include "ModelHandle.h"
+#include "Pipeline.h"
+#include "Detection.h"
+#include "TiledDetector.h"
+#include "Tracker.h"
+#include "ChangeGate.h"
+#include "SSDPostProcessor.h"
+#include "Preprocess.h"
+#include "Metrics.h"
+#include "Profiling.h"
+#include "Quantization.h"
+#include "ScaleLUT.h"
+#include "Cascade.h"
 #include "gtest/gtest.h"
 
 #include <array>
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <future>
 #include <memory>
+#include <thread>
+#include <type_traits>
+#include <opencv2/imgcodecs.hpp>
 #include <boost/random/random_device.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/normal_distribution.hpp>
 
 namespace {
+    //! Reads the input shared by the single_input_multi_output tests
+    std::array<float, 4096> read_random_data() {
+        std::array<float, 4096> input = {0.0};
+        std::ifstream input_data_file("../../tests/random-data.txt");
+        std::string line;
+        for (size_t i = 0; i < input.size() && getline(input_data_file, line); i++)
+            input[i] = std::stof(line);
+        return input;
+    }
+
+    //! Checks quantize and dequantize of one type round trip, saturate and keep zero exact
+    template<typename T>
+    void check_quantization(float scale, int32_t zero_point) {
+        // Every quantized value dequantizes and quantizes back to itself
+        std::vector<T> quantized;
+        for (long value = std::numeric_limits<T>::lowest(); value <= std::numeric_limits<T>::max(); value++)
+            quantized.push_back(static_cast<T>(value));
+        std::vector<float> real(quantized.size());
+        std::vector<T> requantized(quantized.size());
+        dequantize(quantized.data(), real.data(), quantized.size(), scale, zero_point);
+        quantize(real.data(), requantized.data(), real.size(), scale, zero_point);
+        ASSERT_EQ(requantized, quantized);
 
+        // Real values come back within half a step
+        auto low = static_cast<float>(std::numeric_limits<T>::lowest() + 1 - zero_point);
+        auto high = static_cast<float>(std::numeric_limits<T>::max() - 1 - zero_point);
+        std::vector<float> values = {(low + 0.3f) * scale, (low - 0.26f) * scale, (high - 0.49f) * scale,
+                                     (high + 0.45f) * scale};
+        std::vector<T> values_quantized(values.size());
+        std::vector<float> values_real(values.size());
+        quantize(values.data(), values_quantized.data(), values.size(), scale, zero_point);
+        dequantize(values_quantized.data(), values_real.data(), values.size(), scale, zero_point);
+        for (size_t i = 0; i < values.size(); i++)
+            ASSERT_LE(std::abs(values_real[i] - values[i]), scale / 2 + 0.00001f);
+
+        // Zero is exact, values out of range saturate
+        std::vector<float> edges = {0.0f, -1e9f, 1e9f};
+        std::vector<T> edges_quantized(edges.size());
+        quantize(edges.data(), edges_quantized.data(), edges.size(), scale, zero_point);
+        ASSERT_EQ(edges_quantized[0], static_cast<T>(zero_point));
+        ASSERT_EQ(edges_quantized[1], std::numeric_limits<T>::lowest());
+        ASSERT_EQ(edges_quantized[2], std::numeric_limits<T>::max());
+        float zero = 1.0f;
+        dequantize(&edges_quantized[0], &zero, 1, scale, zero_point);
+        ASSERT_EQ(zero, 0.0f);
+    }
+
+    //! Checks a ScaleLUT applies like its scale function over every byte, through the vector loop and its tails
+    template<typename T, typename ScaleFunc>
+    void check_scale_lut(ScaleFunc scale_func) {
+        ScaleLUT<T> lut(scale_func);
+        std::vector<unsigned char> input(256 * 3 + 7);
+        for (size_t i = 0; i < input.size(); i++)
+            input[i] = static_cast<unsigned char>((i * 37 + 11) % 256);
+        for (size_t n : {static_cast<size_t>(0), static_cast<size_t>(3), static_cast<size_t>(17), input.size()}) {
+            std::vector<T> output(n + 1, T(42));
+            lut.apply(input.data(), output.data(), n);
+            for (size_t i = 0; i < n; i++)
+                ASSERT_EQ(output[i], static_cast<T>(scale_func(input[i])));
+            ASSERT_EQ(output[n], T(42));
+        }
+
+        // Copies keep the table
+        ScaleLUT<T> copy(lut);
+        for (int i = 0; i < 256; i++)
+            ASSERT_EQ(copy(static_cast<unsigned char>(i)), lut(static_cast<unsigned char>(i)));
+    }
 
     ////////////// Tests to make sure the input tensors remain allocated over life of object //////////////
     TEST(TFLiteTest, MultiInput_SingleOutput_PointerFill_Test) {
@@ -279,6 +369,955 @@ namespace {
             ASSERT_NEAR(output_inter[i], output[i], abs_error);
 
     }
+
+    ////////////// Tests to make sure input views and bound buffers feed the interpreter //////////////
+    TEST(TFLiteTest, SingleInput_MultiOutput_InputView_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+
+        // Create model
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        std::vector<int> input_tensor_indexes = tflite.input_tensors();
+
+        // Write input data straight into the interpreter's memory
+        auto input_view = tflite.get_input_span<float>(input_tensor_indexes[0]);
+        std::array<float, 4096> input = read_random_data();
+        std::copy_n(input.data(), input_view.size(), input_view.data());
+
+        // Invoke
+        tflite.invoke();
+
+        auto *output_inter = tflite.get_tensor_ptr<float>(tflite.output_tensors()[0]);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output_inter[i], output1[i], 0.00001);
+    }
+
+    TEST(TFLiteTest, SingleInput_MultiOutput_TensorHandle_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+
+        // Create model, tensors are found by name through the descriptor table
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        const TensorDescriptor &input = tflite.tensor_descriptor(tflite.input_tensors()[0]);
+        ASSERT_EQ(tflite.tensor_descriptor(input.name).index, input.index);
+        ASSERT_EQ(input.bytes, input.element_count * sizeof(float));
+        auto input_handle = tflite.tensor_handle<float, 4>(input.name);
+        auto output_handle = tflite.tensor_handle<float, 2>(tflite.output_tensors()[0]);
+
+        auto input_view = tflite.tensor(input_handle);
+        std::array<float, 4096> input_data = read_random_data();
+        std::copy_n(input_data.data(), input_view.size(), input_view.data());
+        tflite.invoke();
+
+        // Read through a constant object the view is read-only
+        const TFLite &const_tflite = tflite;
+        auto output_view = const_tflite.tensor(output_handle);
+        static_assert(std::is_same<decltype(output_view), ConstTensorView<float, 2>>::value, "view must be const");
+        ASSERT_EQ(output_view.dimension(1), 6);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output_view(0, i), output1[i], 0.00001);
+    }
+
+    TEST(TFLiteTest, SingleInput_MultiOutput_OutputView_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+
+        // Create model
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        auto input_view = tflite.get_input_span<float>(tflite.input_tensors()[0]);
+        std::array<float, 4096> input = read_random_data();
+        std::copy_n(input.data(), input_view.size(), input_view.data());
+        tflite.invoke();
+
+        // The view reads the interpreter's memory, the stable copy survives the next invoke
+        int output_index = tflite.output_tensors()[0];
+        auto output_view = tflite.get_tensor_view<float, 2>(output_index);
+        ASSERT_EQ(output_view.data(), tflite.get_tensor_ptr<float>(output_index));
+        StableTensor<float, 2> stable = tflite.get_tensor_stable<float, 2>(output_index);
+        input_view.setZero();
+        tflite.invoke();
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(stable.view()(0, i), output1[i], 0.00001);
+    }
+
+    TEST(TFLiteTest, SingleInput_MultiOutput_BoundBuffer_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+
+        // Create model
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        int input_index = tflite.input_tensors()[0];
+
+        // Bind an aligned buffer as the input tensor's storage
+        alignas(TFLite::tensor_alignment) static std::array<float, 4096> input = {0.0};
+        tflite.bind_input_buffer(input.data(), input.size(), input_index);
+
+        // Write to the bound buffer after binding, no fill is needed
+        input = read_random_data();
+
+        // Invoke
+        tflite.invoke();
+
+        ASSERT_EQ(tflite.get_tensor_ptr<float>(input_index), input.data());
+        auto *output_inter = tflite.get_tensor_ptr<float>(tflite.output_tensors()[0]);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output_inter[i], output1[i], 0.00001);
+    }
+
+    ////////////// Tests to make sure input shapes switch between allocated interpreters //////////////
+    TEST(TFLiteTest, SingleInput_MultiOutput_SetInputShape_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+        std::array<float, 4096> input = read_random_data();
+
+        // The fully connected layers take any batch size
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        int input_index = tflite.input_tensors()[0];
+        int output_index = tflite.output_tensors()[0];
+        tflite.set_input_shape(input_index, {3, 64, 64, 1});
+        ASSERT_EQ(tflite.get_tensor_dims(input_index), std::vector<int>({3, 64, 64, 1}));
+        ASSERT_EQ(tflite.get_tensor_element_count(input_index), 3 * 4096);
+        ASSERT_EQ(tflite.get_tensor_dims(output_index), std::vector<int>({3, 6}));
+
+        auto *input_data = tflite.get_tensor_ptr<float>(input_index);
+        for (int b = 0; b < 3; b++)
+            std::copy(input.begin(), input.end(), input_data + b * 4096);
+        tflite.invoke();
+
+        auto *output_inter = tflite.get_tensor_ptr<float>(output_index);
+        for (int b = 0; b < 3; b++)
+            for (int i = 0; i < 6; i++)
+                ASSERT_NEAR(output_inter[b * 6 + i], output1[i], 0.00001);
+    }
+
+    TEST(TFLiteTest, SingleInput_MultiOutput_ShapeCacheLRU_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+        std::array<float, 4096> input = read_random_data();
+
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        tflite.set_shape_cache_size(1);
+        int input_index = tflite.input_tensors()[0];
+        int output_index = tflite.output_tensors()[0];
+        auto *batch1_input = tflite.get_tensor_ptr<float>(input_index);
+
+        // Batch 1 is parked while batch 2 runs, then comes back with its own tensors
+        tflite.set_input_shape(input_index, {2, 64, 64, 1});
+        ASSERT_EQ(tflite.get_tensor_element_count(input_index), 2 * 4096);
+        tflite.set_input_shape(input_index, {1, 64, 64, 1});
+        ASSERT_EQ(tflite.get_tensor_ptr<float>(input_index), batch1_input);
+
+        // Batch 3 evicts batch 2, the least recently used, and keeps batch 1
+        tflite.set_input_shape(input_index, {3, 64, 64, 1});
+        ASSERT_EQ(tflite.get_tensor_dims(output_index), std::vector<int>({3, 6}));
+        tflite.set_input_shape(input_index, {1, 64, 64, 1});
+        ASSERT_EQ(tflite.get_tensor_ptr<float>(input_index), batch1_input);
+
+        // The interpreter switched back to still computes correctly
+        tflite.fill_tensor(input.data(), input_index);
+        tflite.invoke();
+        auto *output_inter = tflite.get_tensor_ptr<float>(output_index);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output_inter[i], output1[i], 0.00001);
+    }
+
+    TEST(TFLiteTest, EasyTFLite_NativeResolution_Test) {
+        // The fully connected layers only need 4096 pixels, whatever the height and width
+        EasyTFLite model(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        int input_index = model.input_tensors()[0];
+        cv::Mat image(45, 140, CV_8UC1, cv::Scalar(128));
+
+        // Rounded down to multiples of 32, 45x140 runs at 32x128
+        model.set_native_resolution(true, 32);
+        std::vector<float *> native_outputs = model.run_inference_ptrs(image);
+        ASSERT_EQ(native_outputs.size(), 2u);
+        ASSERT_EQ(model.get_tensor_dims(input_index), std::vector<int>({1, 32, 128, 1}));
+        ASSERT_EQ(model.get_tensor_dims(model.output_tensors()[0]), std::vector<int>({1, 6}));
+
+        // Disabled, images are resized to the model's own input again
+        model.set_native_resolution(false);
+        model.run_inference_ptrs(image);
+        ASSERT_EQ(model.get_tensor_dims(input_index), std::vector<int>({1, 64, 64, 1}));
+    }
+
+    ////////////// Tests to make sure a batch computes what its images do one at a time //////////////
+    TEST(TFLiteTest, EasyTFLite_RunInferenceBatch_Test) {
+        EasyTFLite model(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        std::vector<cv::Mat> images;
+        cv::RNG rng(3);
+        for (int i = 0; i < 3; i++) {
+            images.emplace_back(64, 64, CV_8UC1);
+            rng.fill(images.back(), cv::RNG::UNIFORM, 0, 256);
+        }
+
+        // Every image alone, outputs copied before the next run
+        std::vector<std::vector<std::vector<float>>> singles;
+        for (const cv::Mat &image : images) {
+            std::vector<float *> outputs = model.run_inference_ptrs(image, PreprocessOptions::minus_one_to_one());
+            singles.push_back({std::vector<float>(outputs[0], outputs[0] + 6),
+                               std::vector<float>(outputs[1], outputs[1] + 6)});
+        }
+
+        // Exactly batched, then in a larger batch whose last slot isn't used
+        for (int batch_size : {0, 4}) {
+            std::vector<std::vector<float *>> batch = model.run_inference_batch<float>(
+                    images, PreprocessOptions::minus_one_to_one(), batch_size);
+            ASSERT_EQ(batch.size(), images.size());
+            ASSERT_EQ(model.get_tensor_dims(model.input_tensors()[0])[0], batch_size == 0 ? 3 : batch_size);
+            for (size_t i = 0; i < images.size(); i++)
+                for (size_t j = 0; j < 2; j++)
+                    for (int k = 0; k < 6; k++)
+                        ASSERT_NEAR(batch[i][j][k], singles[i][j][k], 0.00001);
+        }
+    }
+
+    ////////////// Tests to make sure pooled interpreters share the model and compute independently //////////////
+    TEST(TFLiteTest, InterpreterPool_ConcurrentCalculation_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+
+        std::array<float, 4096> input = read_random_data();
+
+        InterpreterPoolOptions options;
+        options.size = 2;
+        InterpreterPool<> pool(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"),
+                               options);
+
+        // More threads than interpreters, so some checkouts have to wait
+        std::vector<std::thread> threads;
+        std::vector<float> max_errors(4, 0.0f);
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&, t]() {
+                for (int iteration = 0; iteration < 8; iteration++) {
+                    auto lease = pool.checkout();
+                    lease->fill_tensor(input.data(), lease->input_tensors()[0]);
+                    lease->invoke();
+                    auto *output_inter = lease->get_tensor_ptr<float>(lease->output_tensors()[0]);
+                    for (int i = 0; i < 6; i++)
+                        max_errors[t] = std::max(max_errors[t], std::abs(output_inter[i] - output1[i]));
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        for (float error : max_errors)
+            ASSERT_LT(error, 0.00001);
+        ASSERT_EQ(pool.size(), 2u);
+        ASSERT_EQ(pool.idle_count(), 2u);
+    }
+
+    ////////////// Tests to make sure concurrent requests are batched and get their own outputs //////////////
+    TEST(TFLiteTest, BatchScheduler_FullBatch_Test) {
+        boost::filesystem::path model_path("../../tests/test-models/single_input_multi_output.tflite");
+        std::vector<cv::Mat> images = {cv::Mat(64, 64, CV_8UC1, cv::Scalar(0)),
+                                       cv::Mat(64, 64, CV_8UC1, cv::Scalar(128)),
+                                       cv::Mat(64, 64, CV_8UC1, cv::Scalar(255))};
+
+        // The outputs of every image run on its own
+        EasyTFLite single(model_path);
+        std::vector<std::vector<std::vector<float>>> expected;
+        for (const cv::Mat &image : images) {
+            std::vector<float *> outputs = single.run_inference_ptrs(image);
+            expected.push_back({std::vector<float>(outputs[0], outputs[0] + 6),
+                                std::vector<float>(outputs[1], outputs[1] + 6)});
+        }
+
+        // A full batch runs right away, well before the delay
+        MetricsRegistry registry;
+        BatchSchedulerOptions options;
+        options.max_batch_size = images.size();
+        options.max_queue_delay = std::chrono::seconds(60);
+        options.metrics = &registry;
+        options.name = "full_batch";
+        BatchScheduler scheduler(model_path, options);
+        std::vector<std::future<BatchScheduler::Result>> results;
+        for (const cv::Mat &image : images)
+            results.push_back(scheduler.submit(image));
+
+        // Every request gets its own slice of the single invoke
+        for (size_t i = 0; i < images.size(); i++) {
+            ASSERT_EQ(results[i].wait_for(std::chrono::seconds(10)), std::future_status::ready);
+            BatchScheduler::Result result = results[i].get();
+            ASSERT_EQ(result.size(), 2u);
+            for (size_t j = 0; j < result.size(); j++) {
+                ASSERT_EQ(result[j].size(), 6u);
+                for (int k = 0; k < 6; k++)
+                    ASSERT_NEAR(result[j][k], expected[i][j][k], 0.00001);
+            }
+        }
+        ASSERT_EQ(registry.counter("easytflite_invocations_total", "", {{"model", "full_batch"}}).get(), 1u);
+    }
+
+    TEST(TFLiteTest, BatchScheduler_MaxDelayFlush_Test) {
+        MetricsRegistry registry;
+        BatchSchedulerOptions options;
+        options.max_batch_size = 8;
+        options.max_queue_delay = std::chrono::milliseconds(20);
+        options.metrics = &registry;
+        options.name = "max_delay";
+        BatchScheduler scheduler(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"),
+                                 options);
+
+        // A lone request runs once the delay is over instead of waiting for the batch to fill
+        auto begin = std::chrono::steady_clock::now();
+        auto result = scheduler.submit(cv::Mat(64, 64, CV_8UC1, cv::Scalar(64)));
+        ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+        ASSERT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+        ASSERT_EQ(result.get()[0].size(), 6u);
+        ASSERT_EQ(registry.counter("easytflite_invocations_total", "", {{"model", "max_delay"}}).get(), 1u);
+    }
+
+    ////////////// Tests to make sure pipeline frames arrive in order, or the oldest are dropped //////////////
+    TEST(TFLiteTest, Pipeline_InOrderDelivery_Test) {
+        // Stages of uneven speed, every frame reaches the sink once and in the source's order
+        int next = 0;
+        std::vector<int> values;
+        std::vector<uint64_t> sequences;
+        Pipeline<int> pipeline(
+                [&next](int &item) {
+                    item = next++;
+                    return next <= 200;
+                },
+                {[](int &item) { item *= 2; },
+                 [](int &item) {
+                     if (item % 7 == 0)
+                         std::this_thread::sleep_for(std::chrono::microseconds(200));
+                     item += 1;
+                 }},
+                [&values, &sequences](int &item, uint64_t sequence) {
+                    values.push_back(item);
+                    sequences.push_back(sequence);
+                });
+        pipeline.start();
+        pipeline.wait();
+        ASSERT_EQ(pipeline.frames_delivered(), 200u);
+        ASSERT_EQ(pipeline.frames_dropped(), 0u);
+        for (int i = 0; i < 200; i++) {
+            ASSERT_EQ(sequences[i], static_cast<uint64_t>(i));
+            ASSERT_EQ(values[i], i * 2 + 1);
+        }
+    }
+
+    TEST(TFLiteTest, Pipeline_DropOldest_Test) {
+        // A slow stage skips to the newest waiting frame, the last one always makes it through
+        PipelineOptions options;
+        options.overflow = OverflowPolicy::DropOldest;
+        int next = 0;
+        std::atomic<int> processed{0};
+        int processed_at_end = -1;
+        std::vector<uint64_t> sequences;
+        Pipeline<int> pipeline(
+                [&next, &processed, &processed_at_end](int &item) {
+                    item = next++;
+                    if (next > 50)
+                        processed_at_end = processed.load();
+                    return next <= 50;
+                },
+                {[&processed](int &) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    processed++;
+                }},
+                [&sequences](int &item, uint64_t sequence) {
+                    ASSERT_EQ(static_cast<uint64_t>(item), sequence);
+                    sequences.push_back(sequence);
+                }, options);
+        pipeline.start();
+        pipeline.wait();
+        // The source never waited for the slow stage
+        ASSERT_LT(processed_at_end, 10);
+        ASSERT_GT(pipeline.frames_dropped(), 0u);
+        ASSERT_EQ(pipeline.frames_delivered() + pipeline.frames_dropped(), 50u);
+        ASSERT_EQ(sequences.size(), pipeline.frames_delivered());
+        ASSERT_TRUE(std::is_sorted(sequences.begin(), sequences.end()));
+        ASSERT_EQ(std::adjacent_find(sequences.begin(), sequences.end()), sequences.end());
+        ASSERT_EQ(sequences.back(), 49u);
+    }
+
+    ////////////// Tests to make sure a reloaded model doesn't disturb calls in flight //////////////
+    TEST(TFLiteTest, ModelHandle_HotReload_Test) {
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+        std::array<float, 4096> input = read_random_data();
+
+        boost::filesystem::path first_path("../../tests/test-models/single_input_multi_output.tflite");
+        boost::filesystem::path second_path("../../tests/test-models/single_volume_input.tflite");
+        ModelHandle<TFLite> handle(first_path);
+
+        // A call pins the model, a reload in the middle of it publishes another one
+        std::shared_ptr<TFLite> in_flight = handle.get();
+        in_flight->fill_tensor(input.data(), in_flight->input_tensors()[0]);
+        ASSERT_TRUE(handle.reload(second_path));
+        ASSERT_NE(handle.get(), in_flight);
+        ASSERT_EQ(handle.reloads(), 1u);
+
+        // The pinned model is untouched
+        in_flight->invoke();
+        auto *output1_inter = in_flight->get_tensor_ptr<float>(in_flight->output_tensors()[0]);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output1_inter[i], output1[i], 0.00001);
+        in_flight.reset();
+
+        // A missing file keeps the current model, a background reload publishes and retires
+        ASSERT_FALSE(handle.reload("../../tests/test-models/missing.tflite"));
+
+        // So does a truncated file
+        boost::filesystem::path truncated_path = boost::filesystem::temp_directory_path() / "truncated.tflite";
+        {
+            std::ifstream model_file(first_path.string(), std::ios::binary);
+            std::vector<char> model_buffer((std::istreambuf_iterator<char>(model_file)),
+                                           std::istreambuf_iterator<char>());
+            std::ofstream truncated_file(truncated_path.string(), std::ios::binary);
+            truncated_file.write(model_buffer.data(), static_cast<std::streamsize>(model_buffer.size() / 2));
+        }
+        ASSERT_FALSE(handle.reload(truncated_path));
+        boost::filesystem::remove(truncated_path);
+        ASSERT_EQ(handle.reloads(), 1u);
+        ASSERT_TRUE(handle.reload_async(first_path).get());
+        ASSERT_EQ(handle.reloads(), 2u);
+        ASSERT_EQ(handle.get()->input_tensors().size(), 1u);
+
+        // A background reload isn't done until the previous model's last call releases it
+        in_flight = handle.get();
+        std::weak_ptr<TFLite> previous = in_flight;
+        std::future<bool> reloaded = handle.reload_async(second_path);
+        ASSERT_EQ(reloaded.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+        in_flight.reset();
+        ASSERT_TRUE(reloaded.get());
+        ASSERT_TRUE(previous.expired());
+        ASSERT_EQ(handle.reloads(), 3u);
+    }
+
+    ////////////// Tests to make sure models can be shared and loaded from memory //////////////
+    TEST(TFLiteTest, ModelCache_SharedMapping_Test) {
+        boost::filesystem::path model_path("../../tests/test-models/single_volume_input.tflite");
+        auto first = TFLite::load_model(model_path);
+        auto second = TFLite::load_model(model_path);
+
+        // Both loads map the file once
+        ASSERT_EQ(first.get(), second.get());
+        ASSERT_GE(ModelCache::instance().size(), 1u);
+
+        // Concurrent loads of a file nobody uses wait for a single load
+        first.reset();
+        second.reset();
+        boost::filesystem::path other_path("../../tests/test-models/multi_input_single_output.tflite");
+        std::vector<std::shared_ptr<const tflite::FlatBufferModel>> loaded(8);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < loaded.size(); i++)
+            threads.emplace_back([&loaded, &model_path, &other_path, i]() {
+                loaded[i] = TFLite::load_model(i % 2 == 0 ? model_path : other_path);
+            });
+        for (std::thread &thread : threads)
+            thread.join();
+        ASSERT_NE(loaded[0], loaded[1]);
+        for (size_t i = 2; i < loaded.size(); i++)
+            ASSERT_EQ(loaded[i], loaded[i % 2]);
+    }
+
+    TEST(TFLiteTest, SingleVolumeInput_BufferModel_Test) {
+        // Expected output data
+        std::array<float, 10> output = {0.21751887, 0.7512632, 0.13513072, 0.12721045, 0.923916, -0.9657576, -0.3309331,
+                                        0.2791444, 1.629914, 2.21699};
+
+        // Read the model into memory owned by the test
+        std::ifstream model_file("../../tests/test-models/single_volume_input.tflite", std::ios::binary);
+        std::vector<char> model_buffer((std::istreambuf_iterator<char>(model_file)), std::istreambuf_iterator<char>());
+
+        // Grab input data
+        std::array<float, 4096> input = read_random_data();
+
+        // Create model from the buffer
+        TFLite tflite(model_buffer.data(), model_buffer.size());
+        tflite.fill_tensor(input.data(), tflite.input_tensors()[0]);
+        tflite.invoke();
+
+        auto *output_inter = tflite.get_tensor_ptr<float>(tflite.output_tensors()[0]);
+        for (int i = 0; i < 10; i++)
+            ASSERT_NEAR(output_inter[i], output[i], 0.00001);
+    }
+
+    ////////////// Tests to make sure warm-up invokes are invisible to callers //////////////
+    TEST(TFLiteTest, SingleInput_MultiOutput_Warmup_Test) {
+        // Expected output data
+        std::array<float, 6> output1 = {-0.14983515, 0.47272223, -0.73745316, 0.46977115, -0.07364011, 0.26235366};
+        std::array<float, 4096> input = read_random_data();
+
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        int input_index = tflite.input_tensors()[0];
+        MetricsRegistry registry;
+        tflite.enable_metrics("warmup", registry);
+        tflite.enable_profiling();
+
+        // Synthetic inputs ramp from -1 to 1, neither the profiler nor the metrics see the invokes
+        tflite.warmup(2);
+        auto *input_data = tflite.get_tensor_ptr<float>(input_index);
+        ASSERT_FLOAT_EQ(input_data[0], -1.0f);
+        ASSERT_FLOAT_EQ(input_data[4095], 1.0f);
+        ASSERT_TRUE(tflite.profiling_summary().ops.empty());
+        ASSERT_EQ(registry.counter("easytflite_invocations_total", "", {{"model", "warmup"}}).get(), 0u);
+
+        // The next real invoke is profiled and computes as usual
+        tflite.fill_tensor(input.data(), input_index);
+        tflite.invoke();
+        ASSERT_FALSE(tflite.profiling_summary().ops.empty());
+        ASSERT_EQ(registry.counter("easytflite_invocations_total", "", {{"model", "warmup"}}).get(), 1u);
+        auto *output_inter = tflite.get_tensor_ptr<float>(tflite.output_tensors()[0]);
+        for (int i = 0; i < 6; i++)
+            ASSERT_NEAR(output_inter[i], output1[i], 0.00001);
+    }
+
+    ////////////// Tests to make sure operators and stages are profiled and the profile can be reset //////////////
+    TEST(TFLiteTest, SingleInput_MultiOutput_Profiling_Test) {
+        std::array<float, 4096> input = read_random_data();
+        TFLite tflite(boost::filesystem::path("../../tests/test-models/single_input_multi_output.tflite"));
+        ASSERT_TRUE(tflite.profiling_summary().ops.empty());
+
+        // Every invoke times every operator and the stages around it
+        tflite.enable_profiling();
+        for (int i = 0; i < 3; i++) {
+            tflite.fill_tensor(input.data(), tflite.input_tensors()[0]);
+            tflite.invoke();
+        }
+        ProfileSummary summary = tflite.profiling_summary();
+        ASSERT_FALSE(summary.ops.empty());
+        ASSERT_FALSE(summary.op_types.empty());
+        for (const ProfileStat &op : summary.ops) {
+            ASSERT_FALSE(op.name.empty());
+            ASSERT_EQ(op.count, 3u);
+            ASSERT_GE(op.p99_us, op.p50_us);
+        }
+        auto invoke_stage = std::find_if(summary.stages.begin(), summary.stages.end(),
+                                         [](const ProfileStat &stage) { return stage.name == "invoke"; });
+        ASSERT_NE(invoke_stage, summary.stages.end());
+        ASSERT_EQ(invoke_stage->count, 3u);
+        ASSERT_NE(tflite.profiling_chrome_trace().find(summary.ops[0].name), std::string::npos);
+
+        // A reset forgets the samples and keeps profiling
+        tflite.reset_profiling();
+        ASSERT_TRUE(tflite.profiling_summary().ops.empty());
+        ASSERT_TRUE(tflite.profiling_summary().stages.empty());
+        tflite.invoke();
+        ASSERT_EQ(tflite.profiling_summary().ops[0].count, 1u);
+
+        tflite.disable_profiling();
+        ASSERT_TRUE(tflite.profiling_summary().ops.empty());
+        ASSERT_EQ(tflite.profiling_chrome_trace(), "{\"traceEvents\":[]}");
+    }
+
+    ////////////// Tests to make sure execution configs are cached per model and host //////////////
+    TEST(TFLiteTest, ModelFingerprint_Test) {
+        boost::filesystem::path first_path("../../tests/test-models/single_input_multi_output.tflite");
+        boost::filesystem::path second_path("../../tests/test-models/single_volume_input.tflite");
+
+        // The same bytes give the same fingerprint, loaded from a file or from memory
+        std::ifstream file(first_path.string(), std::ios::binary);
+        std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        auto buffer_model = tflite::FlatBufferModel::BuildFromBuffer(buffer.data(), buffer.size());
+        uint64_t fingerprint = model_fingerprint(*TFLite::load_model(first_path));
+        ASSERT_EQ(model_fingerprint(*buffer_model), fingerprint);
+        ASSERT_NE(model_fingerprint(*TFLite::load_model(second_path)), fingerprint);
+
+        TFLite tflite(first_path);
+        ASSERT_EQ(tflite.get_model_fingerprint(), fingerprint);
+    }
+
+    TEST(TFLiteTest, AutotuneCache_RewriteByKey_Test) {
+        boost::filesystem::path cache_path = boost::filesystem::temp_directory_path() /
+                                             boost::filesystem::unique_path() / "autotune.txt";
+        ExecutionConfig config;
+        ASSERT_FALSE(load_autotune_result(cache_path, 1, config));
+
+        ExecutionConfig first;
+        first.num_threads = 2;
+        ExecutionConfig second;
+        second.num_threads = 1;
+        second.use_xnnpack = true;
+        store_autotune_result(cache_path, 0xabcdef, first);
+        store_autotune_result(cache_path, 42, second);
+
+        // Storing a key again replaces its result instead of appending another line
+        first.num_threads = 4;
+        first.use_xnnpack = true;
+        store_autotune_result(cache_path, 0xabcdef, first);
+        std::ifstream file(cache_path.string());
+        ASSERT_EQ(std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n'), 2);
+
+        ASSERT_TRUE(load_autotune_result(cache_path, 0xabcdef, config));
+        ASSERT_EQ(config.num_threads, 4);
+        ASSERT_TRUE(config.use_xnnpack);
+        ASSERT_TRUE(load_autotune_result(cache_path, 42, config));
+        ASSERT_EQ(config.num_threads, 1);
+        ASSERT_FALSE(load_autotune_result(cache_path, 7, config));
+        boost::filesystem::remove_all(cache_path.parent_path());
+    }
+
+    ////////////// Tests to make sure duplicate detections are merged //////////////
+    TEST(TFLiteTest, NonMaxSuppression_ClassAware_Test) {
+        std::vector<Detection> detections = {
+                {cv::Rect2f(0, 0, 10, 10), 1, 0.9f},
+                {cv::Rect2f(1, 1, 10, 10), 1, 0.8f},  // Duplicate of the first
+                {cv::Rect2f(1, 1, 10, 10), 2, 0.7f},  // Same box, other class
+                {cv::Rect2f(2, 2, 4, 4), 1, 0.6f}     // Inside the first, like a box cut by a tile seam
+        };
+
+        non_max_suppression(detections, 0.5f);
+        ASSERT_EQ(detections.size(), 3u);
+        ASSERT_FLOAT_EQ(detections[0].score, 0.9f);
+        ASSERT_EQ(detections[1].class_id, 2);
+
+        non_max_suppression(detections, 0.5f, OverlapMetric::IoMin);
+        ASSERT_EQ(detections.size(), 2u);
+    }
+
+    ////////////// Tests to make sure detections are decoded in pixels of the image //////////////
+    TEST(TFLiteTest, SSD_EasyTFLite_Detect_Test) {
+        cv::Mat image = cv::imread("../../examples/galaxyclassification/110887.jpg");
+        ASSERT_FALSE(image.empty());
+        SSD_EasyTFLite detector(boost::filesystem::path("../../examples/objectdetection/detect.tflite"));
+
+        // Without a threshold every detection the post-process op reports is kept
+        std::vector<Detection> detections;
+        detector.detect(image, detections, 0.0f);
+        std::array<Eigen::Tensor<float, 2>, 4> outputs = detector.run_inference(image);
+        ASSERT_GT(detections.size(), 0u);
+        ASSERT_EQ(detections.size(), static_cast<size_t>(outputs[3](0, 0)));
+        ASSERT_LE(detections.size(), static_cast<size_t>(outputs[2].dimension(1)));
+        cv::Rect2f image_rect(0, 0, static_cast<float>(image.cols), static_cast<float>(image.rows));
+        for (size_t i = 0; i < detections.size(); i++) {
+            const Detection &detection = detections[i];
+            ASSERT_GE(detection.score, 0.0f);
+            ASSERT_LE(detection.score, 1.0f);
+            ASSERT_FLOAT_EQ(detection.score, outputs[2](0, i));
+            ASSERT_EQ(detection.class_id, static_cast<int>(outputs[1](0, i)));
+            ASSERT_GE(detection.class_id, 0);
+            ASSERT_LT(detection.class_id, 90);
+            ASSERT_GE(detection.box.width, 0.0f);
+            ASSERT_GE(detection.box.height, 0.0f);
+            ASSERT_EQ((detection.box & image_rect).area(), detection.box.area());
+        }
+
+        // The threshold and the class filter only keep a subset, in the same order
+        std::vector<Detection> filtered;
+        int class_id = detections[0].class_id;
+        detector.detect(image, filtered, detections[0].score, {class_id});
+        ASSERT_GE(filtered.size(), 1u);
+        ASSERT_LE(filtered.size(), detections.size());
+        for (const Detection &detection : filtered) {
+            ASSERT_EQ(detection.class_id, class_id);
+            ASSERT_GE(detection.score, detections[0].score);
+        }
+        ASSERT_EQ(filtered[0].box, detections[0].box);
+    }
+
+    ////////////// Tests to make sure frames are tiled with overlap and tile detections land on the frame //////////////
+    TEST(TFLiteTest, TiledDetector_Tiles_Test) {
+        boost::filesystem::path model_path("../../examples/objectdetection/detect.tflite");
+        cv::Mat frame(700, 1000, CV_8UC3, cv::Scalar(90, 120, 150));
+        cv::rectangle(frame, cv::Rect(100, 200, 300, 250), cv::Scalar(20, 200, 40), cv::FILLED);
+        InterpreterPoolOptions pool_options;
+        pool_options.size = 2;
+        pool_options.exhaustion = PoolExhaustion::Timeout;
+        pool_options.timeout = std::chrono::milliseconds(1);
+
+        // 400 pixel tiles sharing at least a fifth, spread so the last ones end on the frame's edges
+        TilingOptions options;
+        options.tile_width = 400;
+        options.tile_height = 400;
+        TiledDetector tiled(model_path, options, pool_options);
+        std::vector<Detection> detections;
+        tiled.detect(frame, detections, 0.3f);
+        std::vector<cv::Rect> expected = {{0, 0, 400, 400}, {300, 0, 400, 400}, {600, 0, 400, 400},
+                                          {0, 300, 400, 400}, {300, 300, 400, 400}, {600, 300, 400, 400}};
+        ASSERT_EQ(tiled.last_tiles(), expected);
+        cv::Rect2f frame_rect(0, 0, 1000, 700);
+        for (const Detection &detection : detections)
+            ASSERT_EQ((detection.box & frame_rect).area(), detection.box.area());
+
+        // Too many tiles, they're enlarged until two cover the frame
+        options.max_tiles = 2;
+        TiledDetector enlarged(model_path, options, pool_options);
+        enlarged.detect(frame, detections, 0.3f);
+        ASSERT_EQ(enlarged.last_tiles().size(), 2u);
+        ASSERT_EQ(enlarged.last_tiles()[0].x, 0);
+        ASSERT_EQ(enlarged.last_tiles()[1].br(), cv::Point(1000, 700));
+        ASSERT_GT(enlarged.last_tiles()[0].br().x, enlarged.last_tiles()[1].x);
+
+        // A tile covering the frame finds what the detector alone does, after the same merge
+        options.tile_width = 1000;
+        options.tile_height = 700;
+        TiledDetector single(model_path, options, pool_options);
+        single.detect(frame, detections, 0.3f);
+        ASSERT_EQ(single.last_tiles().size(), 1u);
+        SSD_EasyTFLite detector(model_path);
+        std::vector<Detection> expected_detections;
+        detector.detect(frame, expected_detections, 0.3f);
+        non_max_suppression(expected_detections, options.merge_threshold, options.merge_metric);
+        ASSERT_EQ(detections.size(), expected_detections.size());
+        for (size_t i = 0; i < detections.size(); i++) {
+            ASSERT_EQ(detections[i].class_id, expected_detections[i].class_id);
+            ASSERT_FLOAT_EQ(detections[i].score, expected_detections[i].score);
+            ASSERT_EQ(detections[i].box, expected_detections[i].box);
+        }
+    }
+
+    ////////////// Tests to make sure tracks keep their ids between detector runs //////////////
+    TEST(TFLiteTest, Tracker_InterleavedDetection_Test) {
+        // Two objects moving in opposite directions, detected by a stand-in detector
+        struct MovingObjects {
+            int frame = 0;
+            int runs = 0;
+
+            void detect(const cv::Mat &, std::vector<Detection> &detections, float, const std::vector<int> &) {
+                runs++;
+                detections = {{cv::Rect2f(10.0f + 5.0f * frame, 20, 40, 30), 1, 0.9f},
+                              {cv::Rect2f(300.0f - 3.0f * frame, 200, 20, 20), 2, 0.8f}};
+            }
+        } detector;
+
+        TrackingOptions options;
+        options.detection_interval = 3;
+        Tracker tracker(options);
+        cv::Mat frame;
+        for (; detector.frame < 30; detector.frame++) {
+            const std::vector<Track> &tracks = tracker.track(frame, detector);
+            ASSERT_EQ(tracks.size(), 2);
+            ASSERT_EQ(tracks[0].id, 1);
+            ASSERT_EQ(tracks[1].id, 2);
+            // Once the velocities are known from two detector runs, predicted boxes follow the objects
+            if (detector.frame < options.detection_interval)
+                continue;
+            ASSERT_NEAR(tracks[0].detection.box.x, 10.0f + 5.0f * detector.frame, 1.0f);
+            ASSERT_NEAR(tracks[1].detection.box.x, 300.0f - 3.0f * detector.frame, 1.0f);
+        }
+        ASSERT_EQ(detector.runs, 10);
+    }
+
+    ////////////// Tests to make sure static frames are skipped and changes are localized //////////////
+    TEST(TFLiteTest, ChangeGate_Decision_Test) {
+        ChangeGateOptions options;
+        options.max_stale_frames = 3;
+        ChangeGate gate(options);
+        cv::Mat frame(240, 320, CV_8UC3, cv::Scalar(64, 64, 64));
+        cv::Rect region;
+
+        // The first frame has nothing to compare with
+        ASSERT_EQ(gate.evaluate(frame, region), GateDecision::Full);
+        gate.accepted(GateDecision::Full);
+        ASSERT_EQ(gate.evaluate(frame, region), GateDecision::Skip);
+
+        // A small bright patch only needs its region inferred
+        cv::Rect patch(200, 40, 40, 40);
+        frame(patch).setTo(cv::Scalar(255, 255, 255));
+        ASSERT_EQ(gate.evaluate(frame, region), GateDecision::Region);
+        ASSERT_EQ(region & patch, patch);
+        gate.accepted(GateDecision::Region);
+
+        // The whole frame is inferred again once it's stale
+        ASSERT_EQ(gate.evaluate(frame, region), GateDecision::Full);
+    }
+
+    ////////////// Tests to make sure raw SSD outputs are decoded like the post-process op //////////////
+    TEST(TFLiteTest, SSDPostProcessor_Decode_Test) {
+        // ssd_mobilenet_v2's anchors
+        SSDPostProcessor::Anchors anchors = SSDPostProcessor::generate_anchors(AnchorOptions());
+        ASSERT_EQ(anchors.rows(), 1917);
+
+        // Zero encodings decode to the anchors themselves, only anchor 500 is confident, of class 2 after background
+        const int num_classes = 4;
+        std::vector<float> box_encodings(anchors.rows() * 4, 0.0f);
+        std::vector<float> class_scores(anchors.rows() * num_classes, -10.0f);
+        class_scores[500 * num_classes + 3] = 3.0f;
+
+        SSDPostProcessor post_processor(anchors);
+        std::vector<Detection> detections;
+        post_processor.process(box_encodings.data(), class_scores.data(), num_classes, cv::Size(300, 300), 0.5f,
+                               std::vector<int>(), detections);
+        ASSERT_EQ(detections.size(), 1u);
+        ASSERT_EQ(detections[0].class_id, 2);
+        ASSERT_NEAR(detections[0].score, 1.0f / (1.0f + std::exp(-3.0f)), 0.00001);
+        ASSERT_NEAR(detections[0].box.x + detections[0].box.width / 2, anchors(500, 1) * 300, 0.001);
+        ASSERT_NEAR(detections[0].box.height, anchors(500, 2) * 300, 0.001);
+    }
+
+    ////////////// Tests to make sure detections are cropped and classified in batches //////////////
+    TEST(TFLiteTest, Cascade_CropClampAndBatchSplit_Test) {
+        boost::filesystem::path detector_path("../../examples/objectdetection/detect.tflite");
+        boost::filesystem::path classifier_path("../../tests/test-models/single_input_multi_output.tflite");
+        cv::Mat frame(128, 128, CV_8UC1);
+        for (int y = 0; y < frame.rows; y++)
+            for (int x = 0; x < frame.cols; x++)
+                frame.at<uint8_t>(y, x) = static_cast<uint8_t>((x * 7 + y * 3) % 256);
+
+        // Three crops split in batches of two and one, the second box is clamped to the frame, the last two are
+        // outside of it or too small to classify
+        CascadeOptions options;
+        options.max_batch_size = 2;
+        Cascade cascade(detector_path, classifier_path, options);
+        std::vector<Detection> detections = {{cv::Rect2f(10, 10, 40, 40), 1, 0.9f},
+                                             {cv::Rect2f(100, 100, 60, 60), 1, 0.8f},
+                                             {cv::Rect2f(60, 20, 30, 50), 2, 0.7f},
+                                             {cv::Rect2f(200, 200, 20, 20), 1, 0.6f},
+                                             {cv::Rect2f(50, 50, 2, 2), 1, 0.5f}};
+        std::vector<CascadeDetection> results;
+        cascade.classify(frame, detections, results);
+        ASSERT_EQ(results.size(), 5u);
+        ASSERT_EQ(results[3].label, -1);
+        ASSERT_EQ(results[4].label, -1);
+        ASSERT_TRUE(results[3].scores.empty());
+
+        // Every crop scores like it does alone, padded by a tenth of the box on every side and clamped to the frame
+        EasyTFLite classifier(classifier_path);
+        std::vector<cv::Rect> crops = {cv::Rect(6, 6, 48, 48), cv::Rect(94, 94, 34, 34), cv::Rect(57, 15, 36, 60)};
+        for (size_t i = 0; i < crops.size(); i++) {
+            ASSERT_EQ(results[i].detection.score, detections[i].score);
+            ASSERT_EQ(results[i].scores.size(), 6u);
+            std::vector<float *> outputs = classifier.run_inference_ptrs(frame(crops[i]), options.preprocess);
+            for (int j = 0; j < 6; j++)
+                ASSERT_NEAR(results[i].scores[j], outputs[0][j], 0.0001);
+            ASSERT_GE(results[i].label, 0);
+            ASSERT_FLOAT_EQ(results[i].label_score, *std::max_element(outputs[0], outputs[0] + 6));
+        }
+    }
+
+    ////////////// Tests to make sure preprocessing stops allocating once warmed up //////////////
+    TEST(TFLiteTest, FusedPreprocessor_SteadyStateAllocation_Test) {
+        ScratchArena arena;
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(arena.get<float>(0, 3)) % 64, 0);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(arena.get<int16_t>(1, 5)) % 64, 0);
+
+        FusedPreprocessor preprocessor;
+        cv::Mat image(48, 64, CV_8UC3, cv::Scalar(10, 20, 30));
+        std::vector<float> output(32 * 32 * 3);
+        preprocessor.run(image, PreprocessOptions::zero_to_one(), output.data(), 32, 32, 3);
+        size_t warm_allocations = preprocessor.arena_stats().allocations;
+        ASSERT_GT(warm_allocations, 0);
+
+        // Same sized frames reuse the arena, smaller ones fit in it
+        for (int i = 0; i < 5; i++)
+            preprocessor.run(image, PreprocessOptions::zero_to_one(), output.data(), 32, 32, 3);
+        preprocessor.run(image(cv::Rect(0, 0, 32, 24)), PreprocessOptions::zero_to_one(), output.data(), 16, 16, 3);
+        ASSERT_EQ(preprocessor.arena_stats().allocations, warm_allocations);
+        ASSERT_NEAR(output[2], 30.0f / 255.0f, 0.0001);
+    }
+
+    ////////////// Tests to make sure the fused pass matches OpenCV's resize and normalization //////////////
+    TEST(TFLiteTest, FusedPreprocessor_MatchesResize_Test) {
+        cv::Mat image(37, 53, CV_8UC3);
+        cv::RNG rng(7);
+        rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+        // Resized, turned to RGB and scaled to between -1 and 1 by OpenCV
+        cv::Mat resized, rgb, expected;
+        cv::resize(image, resized, cv::Size(32, 24), 0, 0, cv::INTER_LINEAR);
+        cv::cvtColor(resized, rgb, cv::COLOR_BGR2RGB);
+        rgb.convertTo(expected, CV_32FC3, 1.0 / 127.5, -1.0);
+        ASSERT_TRUE(expected.isContinuous());
+        const auto *expected_data = expected.ptr<float>();
+
+        // OpenCV resizes 8 bit images in fixed point, so values may differ by one pixel level
+        PreprocessOptions options = PreprocessOptions::minus_one_to_one();
+        options.swap_rb = true;
+        FusedPreprocessor preprocessor;
+        std::vector<float> output(24 * 32 * 3);
+        preprocessor.run(image, options, output.data(), 24, 32, 3);
+        for (size_t i = 0; i < output.size(); i++)
+            ASSERT_NEAR(output[i], expected_data[i], 1.0 / 127.5 + 0.0001);
+    }
+
+    TEST(TFLiteTest, FusedPreprocessor_Quantized_Test) {
+        cv::Mat image(40, 30, CV_8UC1);
+        cv::RNG rng(11);
+        rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+        cv::Mat resized, expected;
+        cv::resize(image, resized, cv::Size(20, 16), 0, 0, cv::INTER_LINEAR);
+        resized.convertTo(expected, CV_32FC1, 1.0 / 127.5, -1.0);
+        std::vector<float> expected_values(expected.ptr<float>(), expected.ptr<float>() + expected.total());
+
+        // The normalized values are quantized with the tensor's scale and zero point, within a step of OpenCV's
+        FusedPreprocessor preprocessor;
+        std::vector<uint8_t> output_u8(expected_values.size()), expected_u8(expected_values.size());
+        preprocessor.run(image, PreprocessOptions::minus_one_to_one(), output_u8.data(), 16, 20, 1, 0.0078125f, 128);
+        quantize(expected_values.data(), expected_u8.data(), expected_values.size(), 0.0078125f, 128);
+        std::vector<int8_t> output_s8(expected_values.size()), expected_s8(expected_values.size());
+        preprocessor.run(image, PreprocessOptions::minus_one_to_one(), output_s8.data(), 16, 20, 1, 0.0078125f, 0);
+        quantize(expected_values.data(), expected_s8.data(), expected_values.size(), 0.0078125f, 0);
+        for (size_t i = 0; i < expected_values.size(); i++) {
+            ASSERT_NEAR(output_u8[i], expected_u8[i], 1);
+            ASSERT_NEAR(output_s8[i], expected_s8[i], 1);
+        }
+
+        // Without quantization parameters the default options write the pixels
+        std::vector<uint8_t> raw(expected_values.size());
+        preprocessor.run(image, PreprocessOptions(), raw.data(), 16, 20, 1);
+        for (size_t i = 0; i < raw.size(); i++)
+            ASSERT_NEAR(raw[i], resized.ptr<uint8_t>()[i], 1);
+    }
+
+    ////////////// Tests to make sure scale lookup tables match their scale function //////////////
+    TEST(TFLiteTest, ScaleLUT_MatchesScaleFunction_Test) {
+        // float takes the AVX2 gather, uint8_t the NEON lookup, int16_t only the scalar loop
+        check_scale_lut<float>([](unsigned char x) { return static_cast<float>(x) / 127.5f - 1.0f; });
+        check_scale_lut<int32_t>([](unsigned char x) { return static_cast<int32_t>(x) * -3; });
+        check_scale_lut<uint8_t>([](unsigned char x) { return static_cast<uint8_t>(255 - x); });
+        check_scale_lut<int8_t>([](unsigned char x) { return static_cast<int8_t>(x - 128); });
+        check_scale_lut<int16_t>([](unsigned char x) { return static_cast<int16_t>(x * 100 - 12800); });
+    }
+
+    ////////////// Tests to make sure quantized values round trip, saturate and keep their zero point //////////////
+    TEST(TFLiteTest, Quantization_RoundTrip_Test) {
+        check_quantization<uint8_t>(0.0078125f, 128);
+        check_quantization<uint8_t>(0.05f, 0);
+        check_quantization<int8_t>(0.0235f, -5);
+        check_quantization<int8_t>(0.5f, 127);
+        check_quantization<int16_t>(0.000123f, 0);
+        check_quantization<int16_t>(0.01f, -300);
+    }
+
+    TEST(TFLiteTest, Quantization_PerChannel_Test) {
+        // [2, 3] along dimension 1, every column has its own scale and zero point
+        QuantizationParams params;
+        params.scales = {0.5f, 0.1f, 2.0f};
+        params.zero_points = {0, 10, -3};
+        params.quantized_dimension = 1;
+        std::vector<int> dims = {2, 3};
+        std::vector<float> input = {1.0f, 0.0f, -6.0f, -100.0f, 0.3f, 300.0f};
+        std::vector<int8_t> quantized(input.size());
+        quantize(input.data(), quantized.data(), dims, params);
+        ASSERT_EQ(quantized, std::vector<int8_t>({2, 10, -6, -128, 13, 127}));
+
+        std::vector<float> real(input.size());
+        dequantize(quantized.data(), real.data(), dims, params);
+        std::vector<float> expected = {1.0f, 0.0f, -6.0f, -64.0f, 0.3f, 260.0f};
+        for (size_t i = 0; i < real.size(); i++)
+            ASSERT_NEAR(real[i], expected[i], 0.00001);
+    }
+
+    ////////////// Tests to make sure latency quantiles and the Prometheus text are right //////////////
+    TEST(TFLiteTest, Metrics_PrometheusText_Test) {
+        MetricsRegistry registry;
+        LatencyHistogram &histogram = registry.histogram("latency_seconds", "Latency", {{"model", "detect"}});
+        for (uint64_t us = 1; us <= 10000; us++)
+            histogram.record(us);
+        HistogramSnapshot snapshot = histogram.snapshot();
+        ASSERT_EQ(snapshot.count, 10000);
+        ASSERT_NEAR(snapshot.quantile(0.5), 5000, 5000 / LatencyHistogram::sub_buckets);
+        ASSERT_NEAR(snapshot.quantile(0.99), 9900, 9900 / LatencyHistogram::sub_buckets);
+
+        // Registering again finds the same metric
+        registry.counter("invokes_total", "Invokes", {{"model", "detect"}}).increment(2);
+        registry.counter("invokes_total", "Invokes", {{"model", "detect"}}).increment();
+        std::string text = registry.prometheus_text();
+        ASSERT_NE(text.find("# TYPE invokes_total counter\ninvokes_total{model=\"detect\"} 3\n"), std::string::npos);
+        ASSERT_NE(text.find("# TYPE latency_seconds histogram\n"), std::string::npos);
+        ASSERT_NE(text.find("latency_seconds_count{model=\"detect\"} 10000\n"), std::string::npos);
+        ASSERT_NE(text.find("latency_seconds_sum{model=\"detect\"} 50.005\n"), std::string::npos);
+
+        // Buckets are cumulative and exact, whatever the log-linear buckets' edges
+        ASSERT_NE(text.find("latency_seconds_bucket{model=\"detect\",le=\"0.0001\"} 100\n"), std::string::npos);
+        ASSERT_NE(text.find("latency_seconds_bucket{model=\"detect\",le=\"0.001\"} 1000\n"), std::string::npos);
+        ASSERT_NE(text.find("latency_seconds_bucket{model=\"detect\",le=\"0.01\"} 10000\n"), std::string::npos);
+        ASSERT_NE(text.find("latency_seconds_bucket{model=\"detect\",le=\"+Inf\"} 10000\n"), std::string::npos);
+    }
 }
 
 int main(int argc, char **argv) {